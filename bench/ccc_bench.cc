@@ -0,0 +1,446 @@
+// Benchmark harness. For each corpus size it generates (or reuses) a
+// deterministic corpus (corpus.h) and measures full-compile throughput,
+// artifact size, snapshot open time and lookup latency percentiles. Results
+// print as a table and, with --json, as a machine-readable file for
+// regression tracking. Needs nothing beyond this library and a writable
+// work directory.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "compiler.h"
+#include "corpus.h"
+#include "simd.h"
+#include "snapshot.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::vector<uint64_t> sizes = {1000, 10000, 100000, 1000000};
+  uint32_t namespaces = 0;
+  uint64_t seed = 1;
+  uint32_t reference_percent = 0;
+  int repetitions = 5;
+  uint64_t lookups = 1000000;
+  unsigned threads = 0;
+  std::string work_dir;
+  std::string json;
+};
+
+struct Result {
+  ccc::CorpusStats corpus;
+  double compile_median = 0;  // Seconds.
+  double compile_min = 0;
+  uint64_t templates = 0;     // Values with references,
+  double resolve_median = 0;  // and the seconds spent evaluating them.
+  uint64_t artifact_bytes = 0;
+  double open_median = 0;
+  double open_checksum_median = 0;
+  double lookup_mean_ns = 0;
+  // Per-lookup latency, timer overhead subtracted.
+  double p50_ns = 0, p90_ns = 0, p99_ns = 0, p999_ns = 0, max_ns = 0;
+  double timer_ns = 0;
+};
+
+void Usage() {
+  std::fprintf(
+      stderr,
+      "usage: ccc_bench [--keys N[,N...]] [--namespaces N] [--seed N]\n"
+      "                 [--references PERCENT] [--repetitions N]\n"
+      "                 [--lookups N] [-j THREADS] [--work DIR]\n"
+      "                 [--json FILE]\n"
+      "\n"
+      "  N accepts k and M suffixes (e.g. --keys 1k,10M).\n"
+      "  --references makes PERCENT of the values reference another key.\n"
+      "  Corpora are cached under DIR (default: $TMPDIR/ccc_bench).\n");
+}
+
+bool ParseCount(const char* s, uint64_t* out) {
+  char* end;
+  uint64_t v = std::strtoull(s, &end, 10);
+  if (end == s) return false;
+  if (*end == 'k' || *end == 'K') {
+    v *= 1000;
+    ++end;
+  } else if (*end == 'm' || *end == 'M') {
+    v *= 1000000;
+    ++end;
+  }
+  if (*end != '\0' || v == 0) return false;
+  *out = v;
+  return true;
+}
+
+bool ParseSizes(const char* s, std::vector<uint64_t>* out) {
+  out->clear();
+  std::string list = s;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = list.find(',', begin);
+    uint64_t v;
+    if (!ParseCount(list.substr(begin, end - begin).c_str(), &v)) {
+      return false;
+    }
+    out->push_back(v);
+    if (end == std::string::npos) return true;
+    begin = end + 1;
+  }
+}
+
+double Seconds(Clock::time_point a, Clock::time_point b) {
+  return std::chrono::duration<double>(b - a).count();
+}
+
+double Median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v.empty() ? 0 : v[v.size() / 2];
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+  return sorted[i];
+}
+
+std::string FormatTime(double seconds) {
+  char buf[32];
+  if (seconds >= 1) {
+    std::snprintf(buf, sizeof(buf), "%.3f s", seconds);
+  } else if (seconds >= 1e-3) {
+    std::snprintf(buf, sizeof(buf), "%.3f ms", seconds * 1e3);
+  } else if (seconds >= 1e-6) {
+    std::snprintf(buf, sizeof(buf), "%.3f us", seconds * 1e6);
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.1f ns", seconds * 1e9);
+  }
+  return buf;
+}
+
+std::string FormatCount(double v) {
+  char buf[32];
+  if (v >= 1e9) {
+    std::snprintf(buf, sizeof(buf), "%.2fG", v / 1e9);
+  } else if (v >= 1e6) {
+    std::snprintf(buf, sizeof(buf), "%.2fM", v / 1e6);
+  } else if (v >= 1e3) {
+    std::snprintf(buf, sizeof(buf), "%.2fk", v / 1e3);
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.1f", v);
+  }
+  return buf;
+}
+
+// Generates the corpus unless a complete one is already cached in `dir`.
+ccc::Status PrepareCorpus(const ccc::CorpusOptions& corpus,
+                          const std::string& dir, ccc::CorpusStats* stats) {
+  namespace fs = std::filesystem;
+  const std::string stamp = dir + "/.complete";
+  std::error_code ec;
+  if (fs::exists(stamp, ec)) {
+    *stats = ccc::CorpusStats();
+    stats->namespaces = ccc::CorpusNamespaces(corpus);
+    stats->keys = corpus.keys;
+    for (const fs::directory_entry& e : fs::directory_iterator(dir, ec)) {
+      if (e.path().extension() == ccc::kSourceExtension) {
+        stats->source_bytes += e.file_size(ec);
+      }
+    }
+    if (!ec) return ccc::Status::Ok();
+  }
+  fs::remove_all(dir, ec);
+  CCC_RETURN_IF_ERROR(ccc::GenerateCorpus(corpus, dir, stats));
+  std::FILE* f = std::fopen(stamp.c_str(), "w");
+  if (f == nullptr) return ccc::Status::IoError("create " + stamp);
+  std::fclose(f);
+  return ccc::Status::Ok();
+}
+
+ccc::Status MeasureCompile(const Options& options, const std::string& corpus,
+                           const std::string& output, Result* result) {
+  std::vector<double> times;
+  std::vector<double> resolve;
+  for (int r = 0; r < options.repetitions; ++r) {
+    ccc::CompileOptions compile;
+    compile.inputs = {corpus};
+    compile.output = output;
+    compile.threads = options.threads;
+    ccc::Compiler compiler(std::move(compile));
+    Clock::time_point start = Clock::now();
+    CCC_RETURN_IF_ERROR(compiler.Run());
+    times.push_back(Seconds(start, Clock::now()));
+    resolve.push_back(compiler.stats().times.resolve);
+    result->templates = compiler.stats().templates;
+  }
+  result->compile_median = Median(times);
+  result->resolve_median = Median(resolve);
+  result->compile_min = *std::min_element(times.begin(), times.end());
+  std::error_code ec;
+  result->artifact_bytes = std::filesystem::file_size(output, ec);
+  return ccc::Status::Ok();
+}
+
+ccc::Status MeasureOpen(const Options& options, const std::string& path,
+                        Result* result) {
+  std::vector<double> open, open_checksum;
+  for (int r = 0; r < options.repetitions; ++r) {
+    ccc::Snapshot snap;
+    Clock::time_point start = Clock::now();
+    CCC_RETURN_IF_ERROR(ccc::Snapshot::Open(path, &snap));
+    Clock::time_point opened = Clock::now();
+    CCC_RETURN_IF_ERROR(snap.VerifyChecksum());
+    Clock::time_point verified = Clock::now();
+    open.push_back(Seconds(start, opened));
+    open_checksum.push_back(Seconds(start, verified));
+  }
+  result->open_median = Median(open);
+  result->open_checksum_median = Median(open_checksum);
+  return ccc::Status::Ok();
+}
+
+// Looks up keys drawn uniformly from the snapshot, by namespace name as a
+// typical client does. The mean comes from an untimed loop; percentiles
+// come from timing each lookup on its own.
+ccc::Status MeasureLookups(const Options& options, const std::string& path,
+                           Result* result) {
+  ccc::Snapshot snap;
+  CCC_RETURN_IF_ERROR(ccc::Snapshot::Open(path, &snap));
+  if (snap.entry_count() == 0) return ccc::Status::Ok();
+
+  struct Probe {
+    std::string ns;
+    std::string key;
+  };
+  const size_t sample = static_cast<size_t>(
+      std::min<uint64_t>(options.lookups, uint64_t{1} << 20));
+  std::vector<Probe> probes(sample);
+  uint64_t x = options.seed;
+  for (Probe& p : probes) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t e = static_cast<uint32_t>((x >> 32) % snap.entry_count());
+    const ccc::NamespaceRecord& ns = snap.namespace_at(snap.EntryNamespace(e));
+    p.ns.assign(snap.namespace_name(ns));
+    p.key.assign(snap.key(ns, snap.entry_at(e)));
+  }
+
+  uint64_t found = 0;
+  for (const Probe& p : probes) found += snap.Find(p.ns, p.key).found();
+
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < options.lookups; ++i) {
+    const Probe& p = probes[i % sample];
+    found += snap.Find(p.ns, p.key).found();
+  }
+  result->lookup_mean_ns = Seconds(start, Clock::now()) * 1e9 /
+                           static_cast<double>(options.lookups);
+
+  std::vector<double> timer(10000);
+  for (double& t : timer) {
+    Clock::time_point a = Clock::now();
+    t = std::chrono::duration<double, std::nano>(Clock::now() - a).count();
+  }
+  result->timer_ns = Median(timer);
+
+  std::vector<double> ns(options.lookups);
+  for (uint64_t i = 0; i < options.lookups; ++i) {
+    const Probe& p = probes[i % sample];
+    Clock::time_point a = Clock::now();
+    found += snap.Find(p.ns, p.key).found();
+    Clock::time_point b = Clock::now();
+    ns[i] = std::max(
+        0.0, std::chrono::duration<double, std::nano>(b - a).count() -
+                 result->timer_ns);
+  }
+  std::sort(ns.begin(), ns.end());
+  result->p50_ns = Percentile(ns, 0.50);
+  result->p90_ns = Percentile(ns, 0.90);
+  result->p99_ns = Percentile(ns, 0.99);
+  result->p999_ns = Percentile(ns, 0.999);
+  result->max_ns = ns.back();
+
+  // Every probe is a key of the snapshot.
+  if (found != sample + 2 * options.lookups) {
+    return ccc::Status::Corrupt(path + ": lookup missed a present key");
+  }
+  return ccc::Status::Ok();
+}
+
+void PrintRow(const std::string& name, const std::string& time,
+              const std::string& counters) {
+  std::printf("%-24s %14s%s%s\n", name.c_str(), time.c_str(),
+              counters.empty() ? "" : "  ", counters.c_str());
+}
+
+void PrintResult(const Result& r) {
+  const std::string n = "/" + std::to_string(r.corpus.keys);
+  const double keys = static_cast<double>(r.corpus.keys);
+  const double bytes = static_cast<double>(r.corpus.source_bytes);
+  PrintRow("compile" + n, FormatTime(r.compile_median),
+           "min=" + FormatTime(r.compile_min) +
+               " keys/s=" + FormatCount(keys / r.compile_median) +
+               " source_B/s=" + FormatCount(bytes / r.compile_median) +
+               " namespaces=" + std::to_string(r.corpus.namespaces));
+  if (r.templates > 0) {
+    PrintRow("resolve" + n, FormatTime(r.resolve_median),
+             "templates=" + FormatCount(static_cast<double>(r.templates)));
+  }
+  PrintRow("artifact" + n, "-",
+           "bytes=" + FormatCount(static_cast<double>(r.artifact_bytes)) +
+               " bytes/key=" +
+               FormatCount(static_cast<double>(r.artifact_bytes) / keys) +
+               " source_bytes=" + FormatCount(bytes));
+  PrintRow("open" + n, FormatTime(r.open_median), "");
+  PrintRow("open+checksum" + n, FormatTime(r.open_checksum_median), "");
+  char buf[160];
+  std::snprintf(buf, sizeof(buf),
+                "p50=%.0fns p90=%.0fns p99=%.0fns p99.9=%.0fns max=%.0fns",
+                r.p50_ns, r.p90_ns, r.p99_ns, r.p999_ns, r.max_ns);
+  PrintRow("lookup" + n, FormatTime(r.lookup_mean_ns * 1e-9), buf);
+}
+
+bool WriteJson(const Options& options, const std::vector<Result>& results) {
+  std::FILE* f = std::fopen(options.json.c_str(), "w");
+  if (f == nullptr) return false;
+  std::fprintf(f,
+               "{\n  \"context\": {\"cpus\": %u, \"simd\": \"%s\", "
+               "\"threads\": %u, \"repetitions\": %d, \"lookups\": %llu, "
+               "\"seed\": %llu, \"reference_percent\": %u},\n"
+               "  \"results\": [",
+               std::thread::hardware_concurrency(),
+               ccc::SimdLevelName(ccc::ActiveSimdKernels().level),
+               options.threads, options.repetitions,
+               static_cast<unsigned long long>(options.lookups),
+               static_cast<unsigned long long>(options.seed),
+               options.reference_percent);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    const double keys = static_cast<double>(r.corpus.keys);
+    std::fprintf(
+        f,
+        "%s\n    {\"keys\": %llu, \"namespaces\": %u, "
+        "\"source_bytes\": %llu,\n"
+        "     \"compile_seconds\": %.9g, \"compile_seconds_min\": %.9g,\n"
+        "     \"compile_keys_per_second\": %.9g, "
+        "\"compile_source_bytes_per_second\": %.9g,\n"
+        "     \"templates\": %llu, \"resolve_seconds\": %.9g,\n"
+        "     \"artifact_bytes\": %llu, \"artifact_bytes_per_key\": %.9g,\n"
+        "     \"open_seconds\": %.9g, \"open_checksum_seconds\": %.9g,\n"
+        "     \"lookup_mean_ns\": %.6g, \"lookup_p50_ns\": %.6g, "
+        "\"lookup_p90_ns\": %.6g,\n"
+        "     \"lookup_p99_ns\": %.6g, \"lookup_p999_ns\": %.6g, "
+        "\"lookup_max_ns\": %.6g,\n"
+        "     \"timer_overhead_ns\": %.6g}",
+        i == 0 ? "" : ",", static_cast<unsigned long long>(r.corpus.keys),
+        r.corpus.namespaces,
+        static_cast<unsigned long long>(r.corpus.source_bytes),
+        r.compile_median, r.compile_min, keys / r.compile_median,
+        static_cast<double>(r.corpus.source_bytes) / r.compile_median,
+        static_cast<unsigned long long>(r.templates), r.resolve_median,
+        static_cast<unsigned long long>(r.artifact_bytes),
+        static_cast<double>(r.artifact_bytes) / keys, r.open_median,
+        r.open_checksum_median, r.lookup_mean_ns, r.p50_ns, r.p90_ns,
+        r.p99_ns, r.p999_ns, r.max_ns, r.timer_ns);
+  }
+  std::fprintf(f, "\n  ]\n}\n");
+  return std::fclose(f) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    uint64_t v;
+    if (std::strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+      if (!ParseSizes(argv[++i], &options.sizes)) {
+        Usage();
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--namespaces") == 0 && i + 1 < argc &&
+               ParseCount(argv[i + 1], &v)) {
+      options.namespaces = static_cast<uint32_t>(v);
+      ++i;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      options.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--references") == 0 && i + 1 < argc) {
+      options.reference_percent = static_cast<uint32_t>(
+          std::min(std::strtoul(argv[++i], nullptr, 10), 100ul));
+    } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc &&
+               ParseCount(argv[i + 1], &v)) {
+      options.repetitions = static_cast<int>(v);
+      ++i;
+    } else if (std::strcmp(argv[i], "--lookups") == 0 && i + 1 < argc &&
+               ParseCount(argv[i + 1], &v)) {
+      options.lookups = v;
+      ++i;
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--work") == 0 && i + 1 < argc) {
+      options.work_dir = argv[++i];
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      options.json = argv[++i];
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (options.work_dir.empty()) {
+    std::error_code ec;
+    options.work_dir =
+        (std::filesystem::temp_directory_path(ec) / "ccc_bench").string();
+  }
+
+  std::printf("%u CPUs, SIMD %s, %s compile threads, %d repetitions\n",
+              std::thread::hardware_concurrency(),
+              ccc::SimdLevelName(ccc::ActiveSimdKernels().level),
+              options.threads == 0 ? "all"
+                                   : std::to_string(options.threads).c_str(),
+              options.repetitions);
+  std::printf("%-24s %14s  %s\n%s\n", "Benchmark", "Time", "Counters",
+              std::string(72, '-').c_str());
+
+  std::vector<Result> results;
+  for (uint64_t keys : options.sizes) {
+    ccc::CorpusOptions corpus;
+    corpus.keys = keys;
+    corpus.namespaces = options.namespaces;
+    corpus.seed = options.seed;
+    corpus.reference_percent = options.reference_percent;
+    std::string dir =
+        options.work_dir + "/corpus-k" + std::to_string(keys) + "-n" +
+        std::to_string(ccc::CorpusNamespaces(corpus)) + "-s" +
+        std::to_string(options.seed);
+    // Corpora without references keep the names they always had.
+    if (corpus.reference_percent > 0) {
+      dir += "-r" + std::to_string(corpus.reference_percent);
+    }
+    const std::string snapshot = dir + ".snap";
+
+    Result result;
+    ccc::Status status = PrepareCorpus(corpus, dir, &result.corpus);
+    if (status.ok()) status = MeasureCompile(options, dir, snapshot, &result);
+    if (status.ok()) status = MeasureOpen(options, snapshot, &result);
+    if (status.ok()) status = MeasureLookups(options, snapshot, &result);
+    if (!status.ok()) {
+      std::fprintf(stderr, "ccc_bench: %s\n", status.message().c_str());
+      return 1;
+    }
+    PrintResult(result);
+    results.push_back(result);
+  }
+
+  if (!options.json.empty() && !WriteJson(options, results)) {
+    std::fprintf(stderr, "ccc_bench: cannot write %s\n", options.json.c_str());
+    return 1;
+  }
+  return 0;
+}
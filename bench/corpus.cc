@@ -0,0 +1,232 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "file_writer.h"
+
+namespace ccc {
+
+namespace {
+
+// SplitMix64: tiny, fast, and fully specified, unlike the standard
+// library's distributions.
+class Rng {
+ public:
+  explicit Rng(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  // Uniform enough for corpus shaping; the modulo bias is irrelevant here.
+  uint32_t Below(uint32_t n) { return static_cast<uint32_t>(Next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+constexpr const char* kWords[] = {
+    "api",     "auth",    "billing", "cache",   "cluster", "db",
+    "feature", "gateway", "http",    "limits",  "log",     "metrics",
+    "pool",    "queue",   "region",  "replica", "retry",   "search",
+    "server",  "session", "shard",   "storage", "timeout", "tls",
+    "upload",  "user",    "worker",  "zone",
+};
+constexpr uint32_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+constexpr const char* kText[] = {
+    "Welcome back",     "été sale",        "naïve café",
+    "日本語のテキスト", "Ünïcödé",         "rate limited",
+    "maintenance 02:00", "contact support", "Добро пожаловать",
+};
+constexpr uint32_t kTextCount = sizeof(kText) / sizeof(kText[0]);
+
+void AppendKey(Rng* rng, uint64_t i, std::string* out) {
+  const uint32_t depth = 2 + rng->Below(3);
+  for (uint32_t d = 0; d < depth; ++d) {
+    if (d > 0) *out += '.';
+    *out += kWords[rng->Below(kWordCount)];
+  }
+  char suffix[24];
+  std::snprintf(suffix, sizeof(suffix), "_%llx",
+                static_cast<unsigned long long>(i));
+  *out += suffix;
+}
+
+void AppendQuoted(Rng* rng, std::string* out) {
+  *out += '"';
+  uint32_t parts = 1 + rng->Below(3);
+  // About one value in a hundred is long, to exercise the bulk copy paths.
+  if (rng->Below(100) == 0) parts = 20 + rng->Below(200);
+  for (uint32_t p = 0; p < parts; ++p) {
+    if (p > 0) {
+      switch (rng->Below(4)) {
+        case 0: *out += "\\n"; break;
+        case 1: *out += "\\t"; break;
+        case 2: *out += "\\\""; break;
+        default: *out += ' '; break;
+      }
+    }
+    if (rng->Below(8) == 0) {
+      *out += "\\u00e9";
+    } else {
+      *out += kText[rng->Below(kTextCount)];
+    }
+  }
+  *out += '"';
+}
+
+void AppendValue(Rng* rng, std::string* out) {
+  char buf[64];
+  uint32_t kind = rng->Below(100);
+  if (kind < 30) {
+    std::snprintf(buf, sizeof(buf), "%lld",
+                  static_cast<long long>(rng->Next() % 2000000) - 1000000);
+    *out += buf;
+  } else if (kind < 40) {
+    // Built from integers so the text never depends on float formatting.
+    std::snprintf(buf, sizeof(buf), "%u.%03u%s", rng->Below(10000),
+                  rng->Below(1000), rng->Below(4) == 0 ? "e-3" : "");
+    *out += buf;
+  } else if (kind < 50) {
+    *out += rng->Below(2) ? "true" : "false";
+  } else if (kind < 85) {
+    switch (rng->Below(3)) {
+      case 0:
+        std::snprintf(buf, sizeof(buf), "%s-%u.%s.internal",
+                      kWords[rng->Below(kWordCount)], rng->Below(64),
+                      kWords[rng->Below(kWordCount)]);
+        break;
+      case 1:
+        std::snprintf(buf, sizeof(buf), "/var/lib/%s/%u",
+                      kWords[rng->Below(kWordCount)], rng->Below(1000));
+        break;
+      default:
+        std::snprintf(buf, sizeof(buf), "https://%s.example.com/v%u/%s",
+                      kWords[rng->Below(kWordCount)], 1 + rng->Below(3),
+                      kWords[rng->Below(kWordCount)]);
+        break;
+    }
+    *out += buf;
+  } else {
+    AppendQuoted(rng, out);
+  }
+}
+
+void AppendNamespaceName(uint32_t n, std::string* out) {
+  char name[16];
+  std::snprintf(name, sizeof(name), "ns%03u", n);
+  *out += name;
+}
+
+// Keys of one namespace a later namespace may reference.
+constexpr size_t kReferenceSamples = 64;
+
+// A value that interpolates `ref`, either alone (so it is typed after
+// interpolation), inside a quoted string, or inside a raw string. One
+// reference per value keeps chains of templates from growing
+// exponentially.
+void AppendReference(Rng* rng, const std::string& ref, std::string* out) {
+  switch (rng->Below(3)) {
+    case 0:
+      *out += "${" + ref + "}";
+      break;
+    case 1:
+      *out += '"';
+      *out += kWords[rng->Below(kWordCount)];
+      *out += ": ${" + ref + "}\"";
+      break;
+    default:
+      *out += kWords[rng->Below(kWordCount)];
+      *out += "-${" + ref + "}";
+      break;
+  }
+}
+
+}  // namespace
+
+uint32_t CorpusNamespaces(const CorpusOptions& options) {
+  if (options.namespaces != 0) return options.namespaces;
+  return static_cast<uint32_t>(
+      std::clamp<uint64_t>(options.keys / 10000, 1, 256));
+}
+
+Status GenerateCorpus(const CorpusOptions& options, const std::string& dir,
+                      CorpusStats* stats) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) return Status::IoError("create " + dir + ": " + ec.message());
+
+  const uint32_t namespaces = CorpusNamespaces(options);
+  *stats = CorpusStats();
+  stats->namespaces = namespaces;
+  std::string text;
+  // Key offsets and lengths in `text`, and the first keys of every
+  // namespace so far, for references.
+  std::vector<std::pair<size_t, size_t>> keys_here;
+  std::vector<std::vector<std::string>> samples;
+  std::string ref;
+  for (uint32_t n = 0; n < namespaces; ++n) {
+    // Each namespace has its own stream, so its text does not depend on
+    // how many namespaces precede it.
+    Rng rng(options.seed * 0x100000001b3ULL + n);
+    const uint64_t keys =
+        options.keys / namespaces + (n < options.keys % namespaces ? 1 : 0);
+    text.clear();
+    text += "# synthetic corpus, seed " + std::to_string(options.seed) + "\n";
+    keys_here.clear();
+    samples.emplace_back();
+    for (uint64_t i = 0; i < keys; ++i) {
+      if (rng.Below(64) == 0) text += "\n# section\n";
+      const size_t key_begin = text.size();
+      AppendKey(&rng, i, &text);
+      const size_t key_size = text.size() - key_begin;
+      text += " = ";
+      if (options.reference_percent > 0 && i > 0 &&
+          rng.Below(100) < options.reference_percent) {
+        ref.clear();
+        const uint32_t other = n > 0 && rng.Below(4) == 0 ? rng.Below(n) : n;
+        if (other != n && !samples[other].empty()) {
+          const std::vector<std::string>& keys_there = samples[other];
+          AppendNamespaceName(other, &ref);
+          ref += '/';
+          ref += keys_there[rng.Below(
+              static_cast<uint32_t>(keys_there.size()))];
+        } else {
+          const auto [begin, size] = keys_here[rng.Below(
+              static_cast<uint32_t>(keys_here.size()))];
+          ref.assign(text, begin, size);
+        }
+        AppendReference(&rng, ref, &text);
+        ++stats->references;
+      } else {
+        AppendValue(&rng, &text);
+      }
+      text += '\n';
+      keys_here.emplace_back(key_begin, key_size);
+      if (samples.back().size() < kReferenceSamples) {
+        samples.back().push_back(text.substr(key_begin, key_size));
+      }
+    }
+
+    std::string path = dir + "/";
+    AppendNamespaceName(n, &path);
+    path += ".conf";
+    FileWriter out;
+    CCC_RETURN_IF_ERROR(out.Open(path));
+    out.Append(text);
+    CCC_RETURN_IF_ERROR(out.Commit());
+    stats->keys += keys;
+    stats->source_bytes += text.size();
+  }
+  return Status::Ok();
+}
+
+}  // namespace ccc
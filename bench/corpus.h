@@ -0,0 +1,49 @@
+// Deterministic synthetic config corpora for benchmarks. The same options
+// always produce byte-identical sources, on every platform, so results
+// from different machines and revisions compare like for like.
+//
+// Keys are dotted paths over a small vocabulary (so namespaces share
+// prefixes the way real configs do) with a unique suffix. Values mix every
+// source form: ints, doubles, bools, raw strings, and quoted strings with
+// escapes and non-ASCII text, a few of them long. Optionally, a share of
+// the values interpolate other keys with `${...}` (references.h).
+
+#ifndef CCC_BENCH_CORPUS_H_
+#define CCC_BENCH_CORPUS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "status.h"
+
+namespace ccc {
+
+struct CorpusOptions {
+  uint64_t keys = 100000;
+  // 0 picks one namespace per 10k keys, between 1 and 256.
+  uint32_t namespaces = 0;
+  uint64_t seed = 1;
+  // Percentage (0-100) of values that reference one earlier key, a
+  // quarter of them in an earlier namespace, so there are no cycles. With
+  // 0 no random draws are spent on it, and corpora are unchanged.
+  uint32_t reference_percent = 0;
+};
+
+struct CorpusStats {
+  uint32_t namespaces = 0;
+  uint64_t keys = 0;
+  uint64_t source_bytes = 0;
+  uint64_t references = 0;  // Values with a reference.
+};
+
+// Resolves `namespaces` == 0 to the default for `keys`.
+uint32_t CorpusNamespaces(const CorpusOptions& options);
+
+// Writes the corpus into directory `dir` (created if missing) as
+// `nsNNN.conf` files. Existing files of the same name are replaced.
+Status GenerateCorpus(const CorpusOptions& options, const std::string& dir,
+                      CorpusStats* stats);
+
+}  // namespace ccc
+
+#endif  // CCC_BENCH_CORPUS_H_
@@ -0,0 +1,59 @@
+// Writes a synthetic corpus (corpus.h) for profiling or for comparing
+// builds outside the benchmark harness.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "corpus.h"
+
+namespace {
+
+void Usage() {
+  std::fprintf(stderr,
+               "usage: ccc_gen_corpus -o DIR [--keys N] [--namespaces N]\n"
+               "                      [--seed N] [--references PERCENT]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ccc::CorpusOptions options;
+  std::string dir;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      dir = argv[++i];
+    } else if (std::strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+      options.keys = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--namespaces") == 0 && i + 1 < argc) {
+      options.namespaces =
+          static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      options.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--references") == 0 && i + 1 < argc) {
+      options.reference_percent = static_cast<uint32_t>(
+          std::min(std::strtoul(argv[++i], nullptr, 10), 100ul));
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (dir.empty()) {
+    Usage();
+    return 2;
+  }
+  ccc::CorpusStats stats;
+  ccc::Status status = ccc::GenerateCorpus(options, dir, &stats);
+  if (!status.ok()) {
+    std::fprintf(stderr, "ccc_gen_corpus: %s\n", status.message().c_str());
+    return 1;
+  }
+  std::printf("%s: %u namespaces, %llu keys, %llu references, %llu bytes\n",
+              dir.c_str(), stats.namespaces,
+              static_cast<unsigned long long>(stats.keys),
+              static_cast<unsigned long long>(stats.references),
+              static_cast<unsigned long long>(stats.source_bytes));
+  return 0;
+}
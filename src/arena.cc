@@ -0,0 +1,85 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace ccc {
+
+Arena::Arena(size_t chunk_size) : chunk_size_(chunk_size) {
+  current_.store(NewChunk(chunk_size_), std::memory_order_relaxed);
+}
+
+Arena::~Arena() {
+  FreeList(current_.load(std::memory_order_relaxed));
+  FreeList(retired_);
+  FreeList(large_);
+}
+
+Arena::Chunk* Arena::NewChunk(size_t size) {
+  void* mem = std::malloc(kHeaderSize + size);
+  if (mem == nullptr) throw std::bad_alloc();
+  Chunk* chunk = new (mem) Chunk;
+  chunk->next = nullptr;
+  chunk->size = size;
+  chunk->used.store(0, std::memory_order_relaxed);
+  bytes_reserved_.fetch_add(kHeaderSize + size, std::memory_order_relaxed);
+  return chunk;
+}
+
+void Arena::FreeList(Chunk* chunk) {
+  while (chunk != nullptr) {
+    Chunk* next = chunk->next;
+    chunk->~Chunk();
+    std::free(chunk);
+    chunk = next;
+  }
+}
+
+void* Arena::Allocate(size_t bytes, size_t alignment) {
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  bytes_allocated_.fetch_add(bytes, std::memory_order_relaxed);
+  const size_t padded = bytes + alignment - 1;
+
+  // Large requests get a chunk of their own instead of retiring a mostly
+  // unused current chunk.
+  if (padded > chunk_size_ / 4) {
+    Chunk* chunk = NewChunk(padded);
+    std::lock_guard<std::mutex> lock(mu_);
+    chunk->next = large_;
+    large_ = chunk;
+    uintptr_t p = reinterpret_cast<uintptr_t>(chunk->data());
+    return reinterpret_cast<void*>((p + alignment - 1) & ~(alignment - 1));
+  }
+
+  for (;;) {
+    Chunk* chunk = current_.load(std::memory_order_acquire);
+    size_t offset = chunk->used.fetch_add(padded, std::memory_order_relaxed);
+    if (offset + padded <= chunk->size) {
+      uintptr_t p = reinterpret_cast<uintptr_t>(chunk->data() + offset);
+      return reinterpret_cast<void*>((p + alignment - 1) & ~(alignment - 1));
+    }
+    // Full: the first thread to get here installs a fresh chunk; the rest
+    // retry on it.
+    std::lock_guard<std::mutex> lock(mu_);
+    if (current_.load(std::memory_order_relaxed) == chunk) {
+      Chunk* fresh = NewChunk(chunk_size_);
+      chunk->next = retired_;
+      retired_ = chunk;
+      current_.store(fresh, std::memory_order_release);
+    }
+  }
+}
+
+void Arena::Reset() {
+  FreeList(retired_);
+  FreeList(large_);
+  retired_ = nullptr;
+  large_ = nullptr;
+  Chunk* chunk = current_.load(std::memory_order_relaxed);
+  chunk->used.store(0, std::memory_order_relaxed);
+  allocations_.store(0, std::memory_order_relaxed);
+  bytes_allocated_.store(0, std::memory_order_relaxed);
+  bytes_reserved_.store(kHeaderSize + chunk->size, std::memory_order_relaxed);
+}
+
+}  // namespace ccc
@@ -0,0 +1,82 @@
+// Bump allocator backing all IR of one compilation. Allocation is a single
+// atomic add on the current chunk, safe from any number of threads;
+// deallocation is a no-op and everything is released at once when the
+// arena is reset or destroyed. Exposed as a std::pmr::memory_resource so
+// standard containers can live in it.
+
+#ifndef CCC_ARENA_H_
+#define CCC_ARENA_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+
+namespace ccc {
+
+class Arena : public std::pmr::memory_resource {
+ public:
+  static constexpr size_t kDefaultChunkSize = 1 << 20;
+
+  explicit Arena(size_t chunk_size = kDefaultChunkSize);
+  ~Arena() override;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+  // Releases every allocation. Keeps the most recent regular chunk for
+  // reuse. Must not race with Allocate().
+  void Reset();
+
+  uint64_t allocations() const {
+    return allocations_.load(std::memory_order_relaxed);
+  }
+  // Bytes handed out to callers.
+  uint64_t bytes_allocated() const {
+    return bytes_allocated_.load(std::memory_order_relaxed);
+  }
+  // Bytes obtained from the system, including unused chunk tails.
+  uint64_t bytes_reserved() const {
+    return bytes_reserved_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return Allocate(bytes, alignment);
+  }
+  void do_deallocate(void*, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    return this == &other;
+  }
+
+ private:
+  struct Chunk {
+    Chunk* next;
+    size_t size;
+    std::atomic<size_t> used;
+    // Data follows, aligned to alignof(std::max_align_t).
+    char* data() { return reinterpret_cast<char*>(this) + kHeaderSize; }
+  };
+  static constexpr size_t kHeaderSize =
+      (sizeof(Chunk) + alignof(std::max_align_t) - 1) &
+      ~(alignof(std::max_align_t) - 1);
+
+  Chunk* NewChunk(size_t size);
+  static void FreeList(Chunk* chunk);
+
+  const size_t chunk_size_;
+  std::atomic<Chunk*> current_;
+  Chunk* retired_ = nullptr;  // Full regular chunks.
+  Chunk* large_ = nullptr;    // Dedicated chunks for large allocations.
+  std::mutex mu_;             // Guards chunk switches and both lists.
+  std::atomic<uint64_t> allocations_{0};
+  std::atomic<uint64_t> bytes_allocated_{0};
+  std::atomic<uint64_t> bytes_reserved_{0};
+};
+
+}  // namespace ccc
+
+#endif  // CCC_ARENA_H_
@@ -0,0 +1,223 @@
+#include "codegen.h"
+
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <set>
+
+#include "file_writer.h"
+#include "snapshot_format.h"
+
+namespace ccc {
+
+namespace {
+
+bool IsIdentifier(const std::string& name) {
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+    return false;
+  }
+  for (char c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+  }
+  return true;
+}
+
+bool IsQualifiedName(const std::string& name) {
+  size_t begin = 0;
+  for (;;) {
+    size_t end = name.find("::", begin);
+    if (!IsIdentifier(name.substr(begin, end - begin))) return false;
+    if (end == std::string::npos) return true;
+    begin = end + 2;
+  }
+}
+
+// Keywords a joined name could collide with: the ones containing '_'.
+const std::set<std::string>& ReservedNames() {
+  static const std::set<std::string> names = {
+      "char16_t", "char32_t", "char8_t", "co_await", "co_return", "co_yield",
+      "const_cast", "dynamic_cast", "reinterpret_cast", "static_assert",
+      "static_cast", "thread_local", "wchar_t",
+      // Members of the generated class.
+      "Bind", "Load", "LoadString", "bound", "kFieldCount", "kSchemaHash",
+  };
+  return names;
+}
+
+// "payments" + "db.port" -> "payments_db_port". Runs of separators
+// collapse to one '_' and never lead or trail, which keeps the result
+// clear of reserved identifiers.
+std::string AccessorName(const SchemaField& field) {
+  std::string name;
+  for (const std::string* part : {&field.ns, &field.key}) {
+    if (!name.empty()) name += '_';
+    for (char c : *part) {
+      if (std::isalnum(static_cast<unsigned char>(c))) {
+        name += c;
+      } else if (!name.empty() && name.back() != '_') {
+        name += '_';
+      }
+    }
+  }
+  while (!name.empty() && name.back() == '_') name.pop_back();
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+    name.insert(0, "f");
+  }
+  return name;
+}
+
+const char* CppType(ValueType type) {
+  switch (type) {
+    case ValueType::kString: return "std::string_view";
+    case ValueType::kInt: return "int64_t";
+    case ValueType::kDouble: return "double";
+    case ValueType::kBool: return "bool";
+  }
+  return "void";
+}
+
+std::string Accessor(ValueType type, uint64_t offset) {
+  std::string at = std::to_string(offset);
+  switch (type) {
+    case ValueType::kString: return "LoadString(" + at + ")";
+    case ValueType::kInt: return "Load<int64_t>(base_, " + at + ")";
+    case ValueType::kDouble: return "Load<double>(base_, " + at + ")";
+    case ValueType::kBool: return "Load<uint8_t>(base_, " + at + ") != 0";
+  }
+  return std::string();
+}
+
+std::string Hex(uint64_t value) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "0x%016llxULL",
+                static_cast<unsigned long long>(value));
+  return buf;
+}
+
+std::string Hex(uint32_t value) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "0x%08xu", value);
+  return buf;
+}
+
+std::string IncludeGuard(const std::string& path) {
+  std::string guard = "CCC_GENERATED_";
+  for (char c : std::filesystem::path(path).filename().string()) {
+    unsigned char u = static_cast<unsigned char>(c);
+    guard += std::isalnum(u) ? static_cast<char>(std::toupper(u)) : '_';
+  }
+  return guard + "_";
+}
+
+}  // namespace
+
+Status GenerateAccessors(const Schema& schema, const CodegenOptions& options) {
+  if (!IsIdentifier(options.class_name) ||
+      ReservedNames().count(options.class_name) != 0) {
+    return Status::InvalidArgument("invalid class name '" +
+                                   options.class_name + "'");
+  }
+  if (!options.cpp_namespace.empty() &&
+      !IsQualifiedName(options.cpp_namespace)) {
+    return Status::InvalidArgument("invalid C++ namespace '" +
+                                   options.cpp_namespace + "'");
+  }
+
+  const uint32_t count = static_cast<uint32_t>(schema.fields.size());
+  const uint64_t hash = SchemaHash(schema);
+  const std::string& cls = options.class_name;
+  const std::string guard = IncludeGuard(options.output);
+
+  std::string accessors;
+  std::string listing;
+  std::set<std::string> used = ReservedNames();
+  used.insert(cls);
+  for (uint32_t i = 0; i < count; ++i) {
+    const SchemaField& field = schema.fields[i];
+    std::string name = AccessorName(field);
+    if (!used.insert(name).second) {
+      return Status::InvalidArgument("schema field " + field.ns + "/" +
+                                     field.key + " maps to accessor '" +
+                                     name + "', which is already taken");
+    }
+    listing += "//   " + field.ns + "/" + field.key + " " +
+               ValueTypeName(field.type) + "\n";
+    accessors += "  " + std::string(CppType(field.type)) + " " + name +
+                 "() const { return " +
+                 Accessor(field.type, SchemaSlotOffset(i)) + "; }\n";
+  }
+
+  std::string h;
+  h += "// Generated by configcentercompiler codegen. Do not edit.\n";
+  h += "//\n";
+  h += "// Typed accessors for snapshots compiled with this schema. Bind()\n";
+  h += "// checks once that a snapshot image carries it; every accessor is\n";
+  h += "// then a load at a constant offset. The image must stay mapped and\n";
+  h += "// unchanged while the class is bound to it.\n";
+  h += "//\n";
+  h += "// Schema " + Hex(hash) + ":\n";
+  h += listing;
+  h += "\n#ifndef " + guard + "\n#define " + guard + "\n\n";
+  h += "#include <cstddef>\n#include <cstdint>\n#include <cstring>\n";
+  h += "#include <string_view>\n\n";
+  if (!options.cpp_namespace.empty()) {
+    h += "namespace " + options.cpp_namespace + " {\n\n";
+  }
+  h += "class " + cls + " {\n public:\n";
+  h += "  static constexpr uint64_t kSchemaHash = " + Hex(hash) + ";\n";
+  h += "  static constexpr uint32_t kFieldCount = " + std::to_string(count) +
+       ";\n\n";
+  h += "  // Binds `out` to the snapshot image [data, data + size). Returns\n";
+  h += "  // false, leaving `out` untouched, if the image is not a format " +
+       std::to_string(kSnapshotVersion) + "\n";
+  h += "  // snapshot compiled with this schema.\n";
+  h += "  static bool Bind(const void* data, size_t size, " + cls +
+       "* out) {\n";
+  h += "    const char* p = static_cast<const char*>(data);\n";
+  h += "    if (size < " + std::to_string(SchemaSlotOffset(count)) +
+       " ||\n";
+  h += "        Load<uint32_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, magic)) + ") != " +
+       Hex(kSnapshotMagic) + " ||\n";
+  h += "        Load<uint32_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, version)) + ") != " +
+       std::to_string(kSnapshotVersion) + "u ||\n";
+  h += "        Load<uint64_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, file_size)) + ") != size ||\n";
+  h += "        Load<uint32_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, schema_field_count)) +
+       ") != kFieldCount ||\n";
+  h += "        Load<uint64_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, schema_hash)) +
+       ") != kSchemaHash ||\n";
+  h += "        Load<uint64_t>(p, " +
+       std::to_string(offsetof(SnapshotHeader, schema_offset)) + ") != " +
+       std::to_string(sizeof(SnapshotHeader)) + ") {\n";
+  h += "      return false;\n    }\n";
+  h += "    out->base_ = p;\n    return true;\n  }\n\n";
+  h += "  bool bound() const { return base_ != nullptr; }\n\n";
+  h += accessors;
+  h += "\n private:\n";
+  h += "  template <typename T>\n";
+  h += "  static T Load(const char* p, size_t offset) {\n";
+  h += "    T value;\n";
+  h += "    std::memcpy(&value, p + offset, sizeof(value));\n";
+  h += "    return value;\n  }\n";
+  h += "  std::string_view LoadString(size_t slot) const {\n";
+  h += "    return std::string_view(base_ + Load<uint64_t>(base_, slot),\n";
+  h += "                            Load<uint32_t>(base_, slot + " +
+       std::to_string(offsetof(SchemaSlot, value_length)) + "));\n  }\n\n";
+  h += "  const char* base_ = nullptr;\n};\n";
+  if (!options.cpp_namespace.empty()) {
+    h += "\n}  // namespace " + options.cpp_namespace + "\n";
+  }
+  h += "\n#endif  // " + guard + "\n";
+
+  FileWriter out;
+  CCC_RETURN_IF_ERROR(out.Open(options.output));
+  out.Append(h);
+  return out.Commit();
+}
+
+}  // namespace ccc
@@ -0,0 +1,31 @@
+// Generates a self-contained C++ header of typed accessors for a schema
+// (schema.h). The generated class binds to a snapshot image once, checking
+// its format version and schema hash; after that every accessor is a load
+// at a compile-time constant offset into the schema slot block, with no
+// string lookup and no type check. The header depends only on the standard
+// library, so clients need not link this library.
+
+#ifndef CCC_CODEGEN_H_
+#define CCC_CODEGEN_H_
+
+#include <string>
+
+#include "schema.h"
+#include "status.h"
+
+namespace ccc {
+
+struct CodegenOptions {
+  std::string output;         // Header path.
+  std::string cpp_namespace;  // e.g. "app::config"; empty for global.
+  std::string class_name = "Config";
+};
+
+// Accessor names join namespace and key with '_' and replace every other
+// non-alphanumeric character with '_'; two fields that map to the same
+// name are an error.
+Status GenerateAccessors(const Schema& schema, const CodegenOptions& options);
+
+}  // namespace ccc
+
+#endif  // CCC_CODEGEN_H_
@@ -0,0 +1,443 @@
+#include "compiler.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+#include "emitter.h"
+#include "hash.h"
+#include "lexer.h"
+#include "page_codec.h"
+#include "parser.h"
+#include "perfect_hash.h"
+#include "references.h"
+#include "thread_pool.h"
+
+namespace ccc {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Dictionary sizing for PageValues(): about 1/32 of the paged bytes, within
+// these bounds, trained on at most kMaxTrainingBytes of values.
+constexpr size_t kMinDictionarySize = 1 << 10;
+constexpr size_t kMaxDictionarySize = 64 << 10;
+constexpr size_t kMaxTrainingBytes = 1 << 20;
+
+// Returns the seconds elapsed since `*since` and restarts it.
+double Lap(Clock::time_point* since) {
+  Clock::time_point now = Clock::now();
+  double seconds = std::chrono::duration<double>(now - *since).count();
+  *since = now;
+  return seconds;
+}
+
+// Reads `path` into `memory`. The IR points into the text until Emit(), so
+// it is copied rather than mapped: a mapping would change under a source
+// rewritten in between, and fault once the file is truncated. A file that
+// shrinks while it is read yields what was there.
+Status ReadSource(const std::string& path, std::pmr::memory_resource* memory,
+                  std::string_view* out) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::IoError("open " + path + ": " + std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return Status::IoError("stat " + path + ": " + std::strerror(err));
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  char* data = size == 0 ? nullptr
+                         : static_cast<char*>(memory->allocate(size, 1));
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, data + done, size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      int err = errno;
+      close(fd);
+      return Status::IoError("read " + path + ": " + std::strerror(err));
+    }
+    if (n == 0) break;
+    done += static_cast<size_t>(n);
+  }
+  close(fd);
+  *out = std::string_view(data, done);
+  return Status::Ok();
+}
+
+}  // namespace
+
+StageTimes& StageTimes::operator+=(const StageTimes& other) {
+  read += other.read;
+  lex += other.lex;
+  parse += other.parse;
+  validate += other.validate;
+  resolve += other.resolve;
+  index += other.index;
+  compress += other.compress;
+  emit += other.emit;
+  return *this;
+}
+
+bool IsValidNamespaceName(const std::string& name) {
+  return !name.empty() && std::all_of(name.begin(), name.end(), IsKeyChar);
+}
+
+Status FinishNamespace(NamespaceIr* ns) {
+  if (ns->entries.size() >= kDirectSlot) {
+    return Status::InvalidArgument("namespace " + ns->name +
+                                   " exceeds 2^31 keys");
+  }
+  ns->key_size = ns->refs.size();
+  ns->value_size = 0;
+  ns->pages.clear();
+  ns->page_count = 0;
+  ns->dictionary_size = 0;
+  ns->compressed = false;
+  for (const Entry& entry : ns->entries) {
+    ns->key_size += entry.key.size();
+    if (entry.type == ValueType::kString) {
+      ns->value_size += EncodedValueLength(entry);
+    }
+  }
+  const std::pmr::vector<Entry>& entries = ns->entries;
+  std::pmr::vector<uint64_t> hashes(entries.get_allocator().resource());
+  if (!BuildIndexTable(static_cast<uint32_t>(entries.size()),
+                       [&](uint32_t i) { return entries[i].key; }, &hashes,
+                       &ns->index)) {
+    return Status::InvalidArgument("could not build the key index of " +
+                                   ns->name);
+  }
+  return Status::Ok();
+}
+
+void PageValues(NamespaceIr* ns) {
+  if (!PageCodecAvailable() || ns->compressed) return;
+  ns->compressed = true;
+  // Scratch space comes from the compilation's arena like the IR does;
+  // it is dropped with the rest once the snapshot is written.
+  std::pmr::memory_resource* memory = ns->entries.get_allocator().resource();
+  // Decode the paged values into their pages. Back to back, the pages are
+  // also the dictionary's training samples.
+  std::pmr::string raw(memory);
+  raw.reserve(ns->value_size);
+  std::pmr::vector<size_t> samples(memory);
+  std::pmr::vector<size_t> page_starts(memory);
+  PagePacker packer;
+  for (const Entry& entry : ns->entries) {
+    if (entry.type != ValueType::kString) continue;
+    const size_t length = EncodedValueLength(entry);
+    if (!IsPagedLength(length)) continue;
+    if ((packer.Place(length) >> 32) == page_starts.size()) {
+      page_starts.push_back(raw.size());
+    }
+    size_t at = raw.size();
+    raw.resize(at + entry.value.size());
+    raw.resize(at + EncodeStringValue(entry, raw.data() + at));
+    samples.push_back(length);
+  }
+  if (raw.size() < kValuePageSize) return;
+
+  // Training time grows with its input; a prefix of the samples is
+  // representative enough.
+  size_t train_bytes = 0;
+  size_t train_samples = 0;
+  while (train_samples < samples.size() &&
+         train_bytes + samples[train_samples] <= kMaxTrainingBytes) {
+    train_bytes += samples[train_samples++];
+  }
+  samples.resize(train_samples);
+  const size_t capacity = std::min(raw.size() / 32, kMaxDictionarySize);
+  std::pmr::string dictionary(memory);
+  if (capacity >= kMinDictionarySize) {
+    TrainPageDictionary(raw, samples, capacity, &dictionary);
+  }
+
+  // The page table, the dictionary and the pages, written in place; each
+  // table record is filled in once its page is compressed. Worth keeping
+  // only if it ends up smaller than the raw values.
+  const uint64_t plain_size = ns->value_size - raw.size();
+  const size_t table_size = page_starts.size() * sizeof(PageRecord);
+  std::pmr::string pages(memory);
+  pages.reserve(table_size + dictionary.size() + raw.size());
+  pages.resize(table_size);
+  pages += dictionary;
+  std::pmr::string compressed(memory);
+  PageCompressor compressor(dictionary);
+  for (size_t p = 0; p < page_starts.size(); ++p) {
+    size_t end = p + 1 < page_starts.size() ? page_starts[p + 1] : raw.size();
+    std::string_view page(raw.data() + page_starts[p], end - page_starts[p]);
+    if (!compressor.Compress(page, &compressed) ||
+        compressed.size() > std::numeric_limits<uint32_t>::max()) {
+      return;
+    }
+    PageRecord rec = {};
+    rec.offset = plain_size + pages.size();
+    rec.compressed_size = static_cast<uint32_t>(compressed.size());
+    rec.raw_size = static_cast<uint32_t>(page.size());
+    std::memcpy(pages.data() + p * sizeof(PageRecord), &rec, sizeof(rec));
+    pages += compressed;
+    if (pages.size() >= raw.size()) return;
+  }
+
+  ns->pages = std::move(pages);
+  ns->page_count = static_cast<uint32_t>(page_starts.size());
+  ns->dictionary_size = static_cast<uint32_t>(dictionary.size());
+  ns->value_size = plain_size + ns->pages.size();
+}
+
+Status ExpandInputs(const std::vector<std::string>& inputs,
+                    const char* extension, std::vector<std::string>* paths) {
+  paths->clear();
+  for (const std::string& input : inputs) {
+    std::error_code ec;
+    if (fs::is_directory(input, ec)) {
+      fs::directory_iterator it(input, ec), end;
+      for (; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != extension) continue;
+        if (!it->is_regular_file(ec)) continue;
+        paths->push_back(it->path().string());
+      }
+      if (ec) return Status::IoError("scan " + input + ": " + ec.message());
+    } else {
+      paths->push_back(input);
+    }
+  }
+  return Status::Ok();
+}
+
+Status Compiler::CollectSources() {
+  namespaces_.clear();
+  std::vector<std::string> paths;
+  CCC_RETURN_IF_ERROR(ExpandInputs(options_.inputs, kSourceExtension, &paths));
+  for (std::string& path : paths) {
+    NamespaceIr& ns = namespaces_.emplace_back(&arena_);
+    ns.name = fs::path(path).stem().string();
+    ns.path = std::move(path);
+  }
+
+  std::sort(namespaces_.begin(), namespaces_.end(),
+            [](const NamespaceIr& a, const NamespaceIr& b) {
+              return a.name < b.name;
+            });
+  for (size_t i = 0; i < namespaces_.size(); ++i) {
+    const NamespaceIr& ns = namespaces_[i];
+    if (!IsValidNamespaceName(ns.name)) {
+      return Status::InvalidArgument("invalid namespace name '" + ns.name +
+                                     "' from " + ns.path);
+    }
+    if (i > 0 && namespaces_[i - 1].name == ns.name) {
+      return Status::InvalidArgument("namespace '" + ns.name +
+                                     "' defined by both " +
+                                     namespaces_[i - 1].path + " and " +
+                                     ns.path);
+    }
+  }
+  return Status::Ok();
+}
+
+void Compiler::LoadBase() {
+  if (options_.base.empty()) return;
+  std::error_code ec;
+  if (!fs::exists(options_.base, ec)) return;
+  // The base is only a cache: an unreadable or stale one just means a full
+  // compile, and its content hashes are covered by the checksum.
+  stats_.base_loaded = Snapshot::Open(options_.base, &base_).ok() &&
+                       base_.VerifyChecksum().ok();
+}
+
+Status Compiler::LoadNamespace(NamespaceIr* ns, NamespaceStats* stats) {
+  Clock::time_point t = Clock::now();
+  stats->name = ns->name;
+  CCC_RETURN_IF_ERROR(ReadSource(
+      ns->path, ns->entries.get_allocator().resource(), &ns->source));
+  ns->content_hash = Hash64(ns->source);
+  stats->source_bytes = ns->source.size();
+  if (stats_.base_loaded) {
+    // Blocks compiled with another compression setting are not what this
+    // compile would produce.
+    const bool compress = options_.compress && PageCodecAvailable();
+    int64_t old = base_.FindNamespace(ns->name);
+    if (old >= 0 &&
+        base_.namespace_at(old).content_hash == ns->content_hash &&
+        ((base_.namespace_at(old).flags & kNamespaceCompressed) != 0) ==
+            compress) {
+      ns->base = &base_;
+      ns->base_index = static_cast<uint32_t>(old);
+      stats->reused = true;
+      stats->entries = base_.namespace_at(old).entry_count;
+      stats->times.read = Lap(&t);
+      return Status::Ok();
+    }
+  }
+  stats->times.read = Lap(&t);
+  return ParseNamespace(ns, stats);
+}
+
+Status Compiler::ParseNamespace(NamespaceIr* ns, NamespaceStats* stats) {
+  ParseTimes parse;
+  Status status =
+      ParseSource(ns->source, ns->path, &ns->entries, &parse);
+  stats->times.lex += parse.lex;
+  stats->times.parse += parse.parse;
+  stats->times.validate += parse.validate;
+  stats->entries = static_cast<uint32_t>(ns->entries.size());
+  return status;
+}
+
+Status Compiler::BuildNamespace(NamespaceIr* ns, NamespaceStats* stats) {
+  Clock::time_point t = Clock::now();
+  CCC_RETURN_IF_ERROR(FinishNamespace(ns));
+  stats->times.index = Lap(&t);
+  if (options_.compress) {
+    const uint64_t value_size = ns->value_size;
+    PageValues(ns);
+    stats->page_bytes = ns->pages.size();
+    stats->paged_bytes = value_size + ns->pages.size() - ns->value_size;
+    stats->times.compress = Lap(&t);
+  }
+  return Status::Ok();
+}
+
+Status Compiler::ResolveReferences(ThreadPool* pool) {
+  ReferenceResolver resolver(&namespaces_, pool);
+  for (;;) {
+    CCC_RETURN_IF_ERROR(resolver.Evaluate());
+    // A reused namespace whose references now evaluate differently is
+    // compiled after all. That can change values that other reused
+    // namespaces reference, so repeat until nothing is stale.
+    std::vector<uint32_t> stale = resolver.StaleNamespaces();
+    if (stale.empty()) break;
+    for (uint32_t n : stale) {
+      NamespaceIr& ns = namespaces_[n];
+      NamespaceStats& stats = stats_.namespaces[n];
+      ns.base = nullptr;
+      stats.reused = false;
+      ++stats_.namespaces_stale;
+      CCC_RETURN_IF_ERROR(ParseNamespace(&ns, &stats));
+    }
+  }
+  resolver.Apply();
+  stats_.templates = resolver.templates();
+  stats_.template_levels = resolver.levels();
+  return Status::Ok();
+}
+
+Status Compiler::CompileAll() {
+  // Namespaces are independent but for their references; each task touches
+  // only its own IR and status slot. Results are merged in name order, so
+  // the output does not depend on scheduling.
+  std::pmr::vector<Status> results(namespaces_.size(), &arena_);
+  stats_.namespaces.resize(namespaces_.size());
+  // The calling thread runs tasks too, so the pool gets one thread fewer
+  // than asked for.
+  unsigned threads = options_.threads;
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0 || namespaces_.size() < 2) threads = 1;
+  std::unique_ptr<ThreadPool> pool;
+  if (threads > 1) pool = std::make_unique<ThreadPool>(threads - 1);
+  stats_.threads = threads;
+  auto for_each = [&](auto&& fn) {
+    auto run = [&](size_t i) {
+      results[i] = fn(&namespaces_[i], &stats_.namespaces[i]);
+    };
+    if (pool != nullptr) {
+      pool->ParallelFor(namespaces_.size(), run);
+    } else {
+      for (size_t i = 0; i < namespaces_.size(); ++i) run(i);
+    }
+    for (const Status& status : results) CCC_RETURN_IF_ERROR(status);
+    return Status::Ok();
+  };
+
+  CCC_RETURN_IF_ERROR(for_each([&](NamespaceIr* ns, NamespaceStats* stats) {
+    return LoadNamespace(ns, stats);
+  }));
+  Clock::time_point t = Clock::now();
+  CCC_RETURN_IF_ERROR(ResolveReferences(pool.get()));
+  stats_.times.resolve += Lap(&t);
+  CCC_RETURN_IF_ERROR(for_each([&](NamespaceIr* ns, NamespaceStats* stats) {
+    if (ns->base != nullptr) return Status::Ok();
+    return BuildNamespace(ns, stats);
+  }));
+
+  for (const NamespaceStats& ns : stats_.namespaces) {
+    if (ns.reused) {
+      ++stats_.namespaces_reused;
+    } else {
+      ++stats_.namespaces_compiled;
+    }
+    stats_.entries += ns.entries;
+    stats_.source_bytes += ns.source_bytes;
+    stats_.paged_bytes += ns.paged_bytes;
+    stats_.page_bytes += ns.page_bytes;
+    stats_.times += ns.times;
+  }
+  return Status::Ok();
+}
+
+Status Compiler::Run() {
+  CCC_RETURN_IF_ERROR(Compile());
+  return Emit();
+}
+
+Status Compiler::Compile() {
+  Clock::time_point start = Clock::now();
+  Status status = CompileStages();
+  stats_.elapsed += Lap(&start);
+  UpdateAllocationStats();
+  return status;
+}
+
+Status Compiler::Emit() {
+  Clock::time_point start = Clock::now();
+  Status status = EmitSnapshot(namespaces_, schema_, options_.output);
+  const double emit = Lap(&start);
+  stats_.times.emit += emit;
+  stats_.elapsed += emit;
+  UpdateAllocationStats();
+  CCC_RETURN_IF_ERROR(status);
+  std::error_code ec;
+  stats_.output_bytes = fs::file_size(options_.output, ec);
+  return Status::Ok();
+}
+
+void Compiler::UpdateAllocationStats() {
+  stats_.allocations = arena_.allocations();
+  stats_.bytes_allocated = arena_.bytes_allocated();
+  stats_.bytes_reserved = arena_.bytes_reserved();
+}
+
+Status Compiler::CompileStages() {
+  if (options_.output.empty()) {
+    return Status::InvalidArgument("no output path given");
+  }
+  Clock::time_point t = Clock::now();
+  CCC_RETURN_IF_ERROR(CollectSources());
+  stats_.times.read += Lap(&t);
+  if (!options_.schemas.empty()) {
+    CCC_RETURN_IF_ERROR(LoadSchema(options_.schemas, &schema_));
+  }
+  stats_.times.validate += Lap(&t);
+  LoadBase();
+  stats_.times.read += Lap(&t);
+  return CompileAll();
+}
+
+}  // namespace ccc
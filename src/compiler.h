@@ -0,0 +1,170 @@
+// The compile pipeline: discover sources, map them, lex and parse each one
+// into a namespace, then emit the snapshot.
+//
+// Namespaces are compiled concurrently on a work-stealing pool and emitted
+// in name order. Between parsing and indexing, `${...}` references are
+// evaluated across namespaces (references.h). Given a base snapshot,
+// compilation is incremental: a namespace whose source hashes to the
+// content hash recorded in the base, and whose references to other
+// namespaces still resolve to the values recorded there, is not lexed or
+// parsed at all, and the emitter splices its blocks from the base.
+
+#ifndef CCC_COMPILER_H_
+#define CCC_COMPILER_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "ir.h"
+#include "schema.h"
+#include "snapshot.h"
+#include "status.h"
+#include "thread_pool.h"
+
+namespace ccc {
+
+// Source files use this extension; the file stem names the namespace.
+inline constexpr char kSourceExtension[] = ".conf";
+
+struct CompileOptions {
+  // Source files or directories. Directories contribute every `*.conf`
+  // file directly inside them.
+  std::vector<std::string> inputs;
+  std::string output;
+  // Previous snapshot to reuse unchanged namespaces from. A missing or
+  // unreadable base is not an error; everything is recompiled instead.
+  std::string base;
+  // Worker threads for per-namespace compilation; 0 uses every hardware
+  // thread. The output is identical for every value.
+  unsigned threads = 0;
+  // Schema files or directories (schema.h). Every declared field must be
+  // defined with its declared type, and gets a slot in the snapshot.
+  std::vector<std::string> schemas;
+  // Store long string values in dictionary-compressed pages where that
+  // saves space. Has no effect in builds without zstd.
+  bool compress = true;
+};
+
+// Seconds spent in each pipeline stage.
+struct StageTimes {
+  double read = 0;      // Scanning inputs, mapping and hashing sources,
+                        // loading the base.
+  double lex = 0;       // Tokenizing sources into raw entries.
+  double parse = 0;     // Typing values and ordering keys.
+  double validate = 0;  // UTF-8, duplicate keys, names, the schema.
+  double resolve = 0;   // Evaluating references between values.
+  double index = 0;     // Building the key indexes.
+  double compress = 0;  // Training dictionaries and compressing pages.
+  double emit = 0;      // Writing the snapshot.
+
+  StageTimes& operator+=(const StageTimes& other);
+};
+
+struct NamespaceStats {
+  std::string name;
+  uint64_t source_bytes = 0;
+  uint32_t entries = 0;
+  bool reused = false;  // Spliced from the base; not lexed or parsed.
+  uint64_t paged_bytes = 0;  // Value bytes stored in compressed pages,
+  uint64_t page_bytes = 0;   // which take this much with their dictionary.
+  // Everything but resolve and emit, which are not per namespace.
+  StageTimes times;
+};
+
+struct CompileStats {
+  uint32_t namespaces_compiled = 0;
+  uint32_t namespaces_reused = 0;
+  // Unchanged since the base, but compiled because a value they reference
+  // changed. Included in namespaces_compiled.
+  uint32_t namespaces_stale = 0;
+  bool base_loaded = false;
+  uint64_t templates = 0;  // Values with references, evaluated.
+  uint32_t template_levels = 0;  // Topological levels they formed.
+
+  unsigned threads = 0;  // Threads that compiled namespaces.
+  uint64_t entries = 0;
+  uint64_t source_bytes = 0;
+  uint64_t output_bytes = 0;
+  uint64_t paged_bytes = 0;  // Of the namespaces compiled, as above.
+  uint64_t page_bytes = 0;
+  double elapsed = 0;  // Wall-clock seconds for Run().
+  // Summed over namespaces, so with several threads the stages that run on
+  // the pool can add up to more than `elapsed`.
+  StageTimes times;
+  // IR, index and emitter allocations, all served by the arena.
+  uint64_t allocations = 0;
+  uint64_t bytes_allocated = 0;
+  uint64_t bytes_reserved = 0;  // Arena chunks obtained from the heap.
+  std::vector<NamespaceStats> namespaces;  // In name order.
+};
+
+// Lists every input file in `paths`. Files are taken as given;
+// directories contribute the regular files directly inside them whose
+// extension is `extension`.
+Status ExpandInputs(const std::vector<std::string>& inputs,
+                    const char* extension, std::vector<std::string>* paths);
+
+// Namespace names share the key alphabet and may not be empty.
+bool IsValidNamespaceName(const std::string& name);
+
+// Computes key_size, value_size and the key index of a namespace whose
+// entries are final (sorted and unique).
+Status FinishNamespace(NamespaceIr* ns);
+
+// Moves the long string values of a finished namespace into compressed
+// pages with a dictionary trained on them (see snapshot_format.h), if the
+// codec is available and that makes the value block smaller. Otherwise
+// leaves the namespace as it is. Deterministic for a given zstd version.
+void PageValues(NamespaceIr* ns);
+
+class Compiler {
+ public:
+  explicit Compiler(CompileOptions options) : options_(std::move(options)) {}
+
+  // Compile() then Emit().
+  Status Run();
+
+  // The halves of Run(), for callers that compile the next snapshot while
+  // this one is written (daemon.h). Emit() may only follow a successful
+  // Compile(). The base stays mapped in between, so it may be replaced.
+  Status Compile();
+  Status Emit();
+
+  const CompileStats& stats() const { return stats_; }
+
+ private:
+  Status CollectSources();
+  void LoadBase();
+  // Maps, hashes and (unless it can be reused from the base) parses one
+  // namespace. Safe to run concurrently for distinct namespaces, like
+  // ParseNamespace() and BuildNamespace().
+  Status LoadNamespace(NamespaceIr* ns, NamespaceStats* stats);
+  Status ParseNamespace(NamespaceIr* ns, NamespaceStats* stats);
+  // Indexes and compresses a parsed namespace whose references are
+  // resolved.
+  Status BuildNamespace(NamespaceIr* ns, NamespaceStats* stats);
+  // Evaluates references, recompiling the reused namespaces whose
+  // referenced values changed. `pool` may be null.
+  Status ResolveReferences(ThreadPool* pool);
+  // Compiles every namespace on a thread pool.
+  Status CompileAll();
+
+  Status CompileStages();
+  void UpdateAllocationStats();
+
+  CompileOptions options_;
+  CompileStats stats_;
+  Schema schema_;
+  Snapshot base_;
+  // Owns every IR allocation of this compilation; declared first among the
+  // IR so it is destroyed last.
+  Arena arena_;
+  std::pmr::vector<NamespaceIr> namespaces_{&arena_};  // Sorted by name.
+};
+
+}  // namespace ccc
+
+#endif  // CCC_COMPILER_H_
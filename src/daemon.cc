@@ -0,0 +1,374 @@
+#include "daemon.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+namespace ccc {
+
+namespace {
+
+// Longer request lines are refused; a publish naming every namespace of a
+// large deployment fits easily.
+constexpr size_t kMaxRequestSize = 1 << 20;
+constexpr int kListenBacklog = 128;
+
+Status SocketAddress(const std::string& path, sockaddr_un* addr) {
+  *addr = {};
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    return Status::InvalidArgument("invalid socket path '" + path + "'");
+  }
+  std::memcpy(addr->sun_path, path.data(), path.size());
+  return Status::Ok();
+}
+
+bool SendAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+  return true;
+}
+
+// Sends the reply line and closes the connection. Accepted sockets are
+// non-blocking, so a client that does not read its reply loses it rather
+// than stalling the thread that answers. Neither that nor a client that
+// has gone away is an error.
+void Reply(int fd, const std::string& line) {
+  std::string text = line;
+  std::replace(text.begin(), text.end(), '\n', ' ');
+  text += '\n';
+  SendAll(fd, text);
+  close(fd);
+}
+
+std::string ErrorReply(const Status& status) {
+  return "error " + status.message();
+}
+
+double Seconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+}  // namespace
+
+CompileDaemon::CompileDaemon(DaemonOptions options)
+    : options_(std::move(options)) {
+  options_.compile.base = options_.compile.output;
+  // Created here rather than in Serve(), so Stop() on another thread only
+  // reads what was set before that thread could see the daemon.
+  if (pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) != 0) {
+    pipe_errno_ = errno;
+    wake_fds_[0] = wake_fds_[1] = -1;
+  }
+}
+
+CompileDaemon::~CompileDaemon() {
+  if (listen_fd_ >= 0) close(listen_fd_);
+  for (int fd : wake_fds_) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+void CompileDaemon::Stop() {
+  stop_requested_.store(true);
+  if (wake_fds_[1] >= 0) {
+    char byte = 0;
+    ssize_t n = write(wake_fds_[1], &byte, 1);
+    (void)n;  // A full pipe already wakes poll().
+  }
+}
+
+Status CompileDaemon::Listen() {
+  const std::string& path = options_.socket_path;
+  sockaddr_un addr;
+  CCC_RETURN_IF_ERROR(SocketAddress(path, &addr));
+  const sockaddr* sa = reinterpret_cast<const sockaddr*>(&addr);
+
+  // A socket left behind by a daemon that died is replaced; one that a
+  // daemon still accepts on is not, and neither is anything else.
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      return Status::InvalidArgument(path + " exists and is not a socket");
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool live = probe >= 0 && connect(probe, sa, sizeof(addr)) == 0;
+    if (probe >= 0) close(probe);
+    if (live) {
+      return Status::InvalidArgument(path +
+                                     ": another daemon is serving on it");
+    }
+    unlink(path.c_str());
+  }
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return Status::IoError("socket: " + std::string(std::strerror(errno)));
+  }
+  if (bind(listen_fd_, sa, sizeof(addr)) != 0 ||
+      listen(listen_fd_, kListenBacklog) != 0) {
+    int err = errno;
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return Status::IoError("listen " + path + ": " + std::strerror(err));
+  }
+  return Status::Ok();
+}
+
+Status CompileDaemon::Serve() {
+  if (options_.compile.output.empty()) {
+    return Status::InvalidArgument("no output path given");
+  }
+  if (wake_fds_[0] < 0) {
+    return Status::IoError("pipe: " + std::string(std::strerror(pipe_errno_)));
+  }
+  CCC_RETURN_IF_ERROR(Listen());
+  compile_thread_ = std::thread(&CompileDaemon::CompileLoop, this);
+  write_thread_ = std::thread(&CompileDaemon::WriteLoop, this);
+
+  // Connections whose request line is still incomplete.
+  struct Connection {
+    int fd;
+    std::string line;
+  };
+  std::vector<Connection> connections;
+  std::vector<pollfd> fds;
+  Status status;
+  while (!stop_requested_.load()) {
+    fds.clear();
+    fds.push_back({listen_fd_, POLLIN, 0});
+    fds.push_back({wake_fds_[0], POLLIN, 0});
+    for (const Connection& c : connections) fds.push_back({c.fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      status = Status::IoError("poll: " + std::string(std::strerror(errno)));
+      break;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < connections.size(); ++i) {
+      Connection& c = connections[i];
+      if (fds[i + 2].revents != 0) {
+        char buf[4096];
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) c.line.append(buf, static_cast<size_t>(n));
+        size_t eol = c.line.find('\n');
+        if (eol != std::string::npos) {
+          c.line.resize(eol);
+          Dispatch(c.fd, c.line);
+          continue;
+        }
+        if (c.line.size() > kMaxRequestSize) {
+          Reply(c.fd, "error request too long");
+          continue;
+        }
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+          close(c.fd);
+          continue;
+        }
+      }
+      if (kept != i) connections[kept] = std::move(c);
+      ++kept;
+    }
+    connections.resize(kept);
+
+    if (fds[0].revents & POLLIN) {
+      int fd =
+          accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd >= 0) connections.push_back({fd, std::string()});
+    }
+    if (fds[1].revents & POLLIN) {
+      char buf[64];
+      while (read(wake_fds_[0], buf, sizeof(buf)) > 0) {
+      }
+    }
+  }
+
+  // Stop taking requests, then let the loops drain what was accepted.
+  close(listen_fd_);
+  listen_fd_ = -1;
+  unlink(options_.socket_path.c_str());
+  for (const Connection& c : connections) {
+    Reply(c.fd, "error daemon is shutting down");
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stopping_ = true;
+  }
+  pending_changed_.notify_all();
+  compile_thread_.join();
+  write_thread_.join();
+  for (int fd : shutdown_clients_) {
+    Reply(fd, "ok " + std::to_string(generation_.load()));
+  }
+  shutdown_clients_.clear();
+  return status;
+}
+
+void CompileDaemon::Dispatch(int fd, const std::string& line) {
+  std::istringstream words(line);
+  std::string command;
+  words >> command;
+  std::vector<std::string> args;
+  for (std::string word; words >> word;) args.push_back(std::move(word));
+
+  if (command == "shutdown" && args.empty()) {
+    std::lock_guard<std::mutex> lock(mu_);
+    shutdown_clients_.push_back(fd);
+    stop_requested_.store(true);
+    return;
+  }
+  if (command != "publish") {
+    Reply(fd, "error unknown request '" + command + "'");
+    return;
+  }
+  for (const std::string& name : args) {
+    if (!IsValidNamespaceName(name)) {
+      Reply(fd, "error invalid namespace name '" + name + "'");
+      return;
+    }
+  }
+
+  const Clock::time_point now = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    Batch& batch = pending_;
+    if (batch.requests++ == 0) batch.first = now;
+    batch.last = now;
+    batch.clients.push_back(fd);
+    for (std::string& name : args) {
+      auto it = std::lower_bound(batch.namespaces.begin(),
+                                 batch.namespaces.end(), name);
+      if (it == batch.namespaces.end() || *it != name) {
+        batch.namespaces.insert(it, std::move(name));
+      }
+    }
+  }
+  pending_changed_.notify_all();
+}
+
+void CompileDaemon::CompileLoop() {
+  const auto quiet = std::chrono::milliseconds(options_.quiet_ms);
+  const auto max_delay = std::chrono::milliseconds(options_.max_delay_ms);
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    if (pending_.requests == 0) {
+      if (stopping_) break;
+      pending_changed_.wait(lock);
+      continue;
+    }
+    // Wait out the burst, but not forever. On shutdown, go at once.
+    const Clock::time_point due =
+        std::min(pending_.last + quiet, pending_.first + max_delay);
+    if (!stopping_ && Clock::now() < due) {
+      pending_changed_.wait_until(lock, due);
+      continue;
+    }
+    auto batch = std::make_unique<Batch>(std::move(pending_));
+    pending_ = Batch();
+    lock.unlock();
+
+    // Compiling against the last written snapshot while the previous
+    // batch is still being written is safe: the base is only a cache.
+    batch->queued = Seconds(Clock::now() - batch->first);
+    batch->compiler = std::make_unique<Compiler>(options_.compile);
+    Status status = batch->compiler->Compile();
+    if (!status.ok()) {
+      Finish(batch.get(), status, 0);
+      lock.lock();
+      continue;
+    }
+    lock.lock();
+    compiled_changed_.wait(lock, [&] { return compiled_ == nullptr; });
+    compiled_ = std::move(batch);
+    compiled_changed_.notify_all();
+  }
+  compiling_done_ = true;
+  compiled_changed_.notify_all();
+}
+
+void CompileDaemon::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    compiled_changed_.wait(
+        lock, [&] { return compiled_ != nullptr || compiling_done_; });
+    if (compiled_ == nullptr) break;
+    std::unique_ptr<Batch> batch = std::move(compiled_);
+    compiled_changed_.notify_all();
+    lock.unlock();
+
+    Status status = batch->compiler->Emit();
+    const uint64_t generation = status.ok() ? ++generation_ : 0;
+    Finish(batch.get(), status, generation);
+    lock.lock();
+  }
+}
+
+void CompileDaemon::Finish(Batch* batch, const Status& status,
+                           uint64_t generation) {
+  const std::string reply = status.ok()
+                                ? "ok " + std::to_string(generation)
+                                : ErrorReply(status);
+  for (int fd : batch->clients) Reply(fd, reply);
+  if (!batch_callback_) return;
+  BatchStats stats;
+  stats.generation = generation;
+  stats.requests = batch->requests;
+  stats.namespaces = std::move(batch->namespaces);
+  stats.queued = batch->queued;
+  stats.status = status;
+  stats.compile = batch->compiler->stats();
+  std::lock_guard<std::mutex> lock(callback_mu_);
+  batch_callback_(stats);
+}
+
+Status SendDaemonRequest(const std::string& socket_path,
+                         const std::string& request, std::string* reply) {
+  sockaddr_un addr;
+  CCC_RETURN_IF_ERROR(SocketAddress(socket_path, &addr));
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return Status::IoError("socket: " + std::string(std::strerror(errno)));
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) !=
+          0 ||
+      !SendAll(fd, request + "\n")) {
+    int err = errno;
+    close(fd);
+    return Status::IoError("connect " + socket_path + ": " +
+                           std::strerror(err));
+  }
+  reply->clear();
+  char buf[4096];
+  for (;;) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    reply->append(buf, static_cast<size_t>(n));
+    if (reply->find('\n') != std::string::npos) break;
+  }
+  close(fd);
+  size_t eol = reply->find('\n');
+  if (eol == std::string::npos) {
+    return Status::IoError(socket_path + ": no reply from the daemon");
+  }
+  reply->resize(eol);
+  return Status::Ok();
+}
+
+}  // namespace ccc
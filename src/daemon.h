@@ -0,0 +1,137 @@
+// Long-running compile service. Clients ask for a publish over a local
+// (unix domain) socket after editing sources; the daemon coalesces every
+// request that arrives during a burst into one incremental compile and
+// answers each of them once a snapshot containing their edits is written.
+//
+// Requests are one line each, one per connection, and get a one-line
+// reply before the daemon closes the connection:
+//
+//   publish [NAMESPACE...]   ok GENERATION | error MESSAGE
+//   shutdown                 ok GENERATION, once pending publishes are done
+//
+// The namespaces of a publish name the sources that were edited. They are
+// reported per batch; what is recompiled is still decided by content
+// hash, so a request that names nothing (or the wrong namespaces) is
+// handled correctly too. GENERATION counts the snapshots this daemon has
+// written.
+//
+// Batches are pipelined: one thread compiles a batch while another writes
+// the previous one, and the listening thread keeps accepting requests for
+// the next. Each compile uses the last written snapshot as its base, so
+// sources are only re-parsed if they changed since then.
+
+#ifndef CCC_DAEMON_H_
+#define CCC_DAEMON_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compiler.h"
+#include "status.h"
+
+namespace ccc {
+
+struct DaemonOptions {
+  std::string socket_path;
+  // How every batch is compiled. `compile.base` is ignored: the base is
+  // always the previous output.
+  CompileOptions compile;
+  // A batch is compiled once no request has arrived for `quiet_ms`, or
+  // once its first request has waited `max_delay_ms`.
+  unsigned quiet_ms = 100;
+  unsigned max_delay_ms = 1000;
+};
+
+struct BatchStats {
+  uint64_t generation = 0;  // Of the snapshot written; 0 if none was.
+  uint32_t requests = 0;
+  std::vector<std::string> namespaces;  // Named by the requests, sorted.
+  double queued = 0;  // Seconds from the first request to the compile.
+  Status status;
+  CompileStats compile;
+};
+
+class CompileDaemon {
+ public:
+  explicit CompileDaemon(DaemonOptions options);
+  ~CompileDaemon();
+  CompileDaemon(const CompileDaemon&) = delete;
+  CompileDaemon& operator=(const CompileDaemon&) = delete;
+
+  // Called after every batch, from the daemon's threads but never
+  // concurrently. Set it before Serve().
+  void set_batch_callback(std::function<void(const BatchStats&)> callback) {
+    batch_callback_ = std::move(callback);
+  }
+
+  // Listens on the socket and serves until a `shutdown` request or Stop(),
+  // then finishes the pending batches and removes the socket. Fails if
+  // the socket cannot be bound, or another daemon is serving on it.
+  Status Serve();
+
+  // Makes Serve() wind down as for a `shutdown` request. Safe to call
+  // from a signal handler.
+  void Stop();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Requests coalesced into one compile, and the connections waiting for
+  // it.
+  struct Batch {
+    std::vector<int> clients;
+    std::vector<std::string> namespaces;
+    uint32_t requests = 0;
+    Clock::time_point first;
+    Clock::time_point last;
+    double queued = 0;  // Seconds from the first request to the compile.
+    std::unique_ptr<Compiler> compiler;
+  };
+
+  Status Listen();
+  // Handles one complete request line from `fd`, which it takes over.
+  void Dispatch(int fd, const std::string& line);
+  void CompileLoop();
+  void WriteLoop();
+  // Replies to every client of `batch` and reports it.
+  void Finish(Batch* batch, const Status& status, uint64_t generation);
+
+  DaemonOptions options_;
+  std::function<void(const BatchStats&)> batch_callback_;
+  int listen_fd_ = -1;
+  int wake_fds_[2] = {-1, -1};  // Stop() writes to [1] to wake poll().
+  int pipe_errno_ = 0;          // Why the constructor could not create them.
+  std::atomic<bool> stop_requested_{false};
+
+  std::mutex mu_;
+  std::condition_variable pending_changed_;  // Wakes CompileLoop().
+  std::condition_variable compiled_changed_;  // Wakes both loops.
+  Batch pending_;                    // Guarded by mu_.
+  std::unique_ptr<Batch> compiled_;  // Ready to write; guarded by mu_.
+  bool stopping_ = false;            // Guarded by mu_.
+  bool compiling_done_ = false;      // Guarded by mu_.
+  std::vector<int> shutdown_clients_;  // Guarded by mu_.
+  std::atomic<uint64_t> generation_{0};
+  std::mutex callback_mu_;
+
+  std::thread compile_thread_;
+  std::thread write_thread_;
+};
+
+// Sends `request` (without its newline) to the daemon listening on
+// `socket_path` and waits for the reply line, returned without the
+// newline.
+Status SendDaemonRequest(const std::string& socket_path,
+                         const std::string& request, std::string* reply);
+
+}  // namespace ccc
+
+#endif  // CCC_DAEMON_H_
@@ -0,0 +1,413 @@
+#include "delta.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "compiler.h"
+#include "emitter.h"
+#include "file_writer.h"
+#include "hash.h"
+#include "ir.h"
+#include "mapped_file.h"
+#include "page_codec.h"
+#include "schema.h"
+
+namespace ccc {
+
+namespace {
+
+enum NamespaceKind : uint8_t {
+  kCopy = 0,
+  kPatch = 1,
+  kPatchCompressed = 2,
+};
+enum OpCode : uint8_t { kKeep = 0, kSkip = 1, kAdd = 2, kEnd = 3 };
+
+bool SameValue(const Snapshot& a, const NamespaceRecord& ans,
+               const EntryRecord& ar, const Snapshot& b,
+               const NamespaceRecord& bns, const EntryRecord& br) {
+  if (ar.type != br.type || ar.value_length != br.value_length) return false;
+  if (static_cast<ValueType>(ar.type) != ValueType::kString) {
+    return ar.value == br.value;
+  }
+  ValueRef av = a.value(ans, ar);
+  ValueRef bv = b.value(bns, br);
+  return av && bv && av.string_value() == bv.string_value();
+}
+
+// The value of `rec` in snapshot encoding, viewed in place.
+std::string_view EncodedValue(const Snapshot& snap, const NamespaceRecord& ns,
+                              const EntryRecord& rec) {
+  if (static_cast<ValueType>(rec.type) == ValueType::kString) {
+    // An undecompressable page yields an empty value; the target checksum
+    // catches the damage when the delta is applied.
+    ValueRef value = snap.value(ns, rec);
+    return value ? value.string_value() : std::string_view();
+  }
+  return std::string_view(reinterpret_cast<const char*>(&rec.value),
+                          rec.value_length);
+}
+
+// Run-length encodes keep/skip ops; adds are written as they come.
+class OpWriter {
+ public:
+  explicit OpWriter(FileWriter* out) : out_(out) {}
+
+  void Keep() { Run(kKeep); }
+  void Skip() { Run(kSkip); }
+  void Add(const Snapshot& snap, const NamespaceRecord& ns,
+           const EntryRecord& rec) {
+    Flush();
+    std::string_view key = snap.key(ns, rec);
+    std::string_view value = EncodedValue(snap, ns, rec);
+    out_->PutU8(kAdd);
+    out_->PutU8(rec.type);
+    out_->PutVarint(key.size());
+    out_->Append(key);
+    out_->PutVarint(value.size());
+    out_->Append(value);
+  }
+  void End() {
+    Flush();
+    out_->PutU8(kEnd);
+  }
+
+ private:
+  void Run(OpCode op) {
+    if (run_ != op) Flush();
+    run_ = op;
+    ++count_;
+  }
+  void Flush() {
+    if (count_ > 0) {
+      out_->PutU8(run_);
+      out_->PutVarint(count_);
+    }
+    count_ = 0;
+  }
+
+  FileWriter* out_;
+  OpCode run_ = kKeep;
+  uint64_t count_ = 0;
+};
+
+// Bounds-checked cursor over the delta body.
+class DeltaReader {
+ public:
+  explicit DeltaReader(std::string_view data) : data_(data) {}
+
+  bool done() const { return pos_ == data_.size(); }
+
+  bool U8(uint8_t* v) {
+    if (pos_ >= data_.size()) return false;
+    *v = static_cast<uint8_t>(data_[pos_++]);
+    return true;
+  }
+  bool U64(uint64_t* v) {
+    if (data_.size() - pos_ < 8) return false;
+    std::memcpy(v, data_.data() + pos_, 8);
+    pos_ += 8;
+    return true;
+  }
+  bool Varint(uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte;
+      if (!U8(&byte)) return false;
+      *v |= uint64_t{byte & 0x7Fu} << shift;
+      if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+  }
+  bool Bytes(std::string_view* out) {
+    uint64_t n;
+    if (!Varint(&n) || n > data_.size() - pos_) return false;
+    *out = data_.substr(pos_, n);
+    pos_ += n;
+    return true;
+  }
+
+ private:
+  std::string_view data_;
+  size_t pos_ = 0;
+};
+
+// A namespace's smallest encoding: a one-byte name with its length, the
+// kind and the content hash.
+constexpr size_t kMinNamespaceSize = 1 + 1 + 1 + 8;
+
+Status Malformed(const std::string& path) {
+  return Status::Corrupt(path + ": malformed delta");
+}
+
+// Replays one patch script against `old` (null if the base lacks the
+// namespace) and appends the resulting entries to `ns`.
+Status ReplayPatch(const Snapshot& base, const NamespaceRecord* old,
+                   const std::string& path, DeltaReader* in, NamespaceIr* ns,
+                   DeltaStats* stats) {
+  const uint32_t old_count = old ? old->entry_count : 0;
+  ns->entries.reserve(old_count);
+  uint32_t cursor = 0;
+  for (;;) {
+    uint8_t op;
+    if (!in->U8(&op)) return Malformed(path);
+    if (op == kEnd) break;
+    if (op == kKeep || op == kSkip) {
+      uint64_t count;
+      if (!in->Varint(&count) || count > old_count - cursor) {
+        return Malformed(path);
+      }
+      if (op == kSkip) {
+        cursor += static_cast<uint32_t>(count);
+        stats->entries_removed += count;
+        continue;
+      }
+      for (uint64_t k = 0; k < count; ++k, ++cursor) {
+        const EntryRecord& rec = base.entry_at(old->first_entry + cursor);
+        Entry entry;
+        entry.key = base.key(*old, rec);
+        entry.value = EncodedValue(base, *old, rec);
+        entry.type = static_cast<ValueType>(rec.type);
+        entry.flags = kEntryDecoded;
+        ns->entries.push_back(entry);
+      }
+      stats->entries_kept += count;
+    } else if (op == kAdd) {
+      uint8_t type;
+      Entry entry;
+      if (!in->U8(&type) || type > static_cast<uint8_t>(ValueType::kBool) ||
+          !in->Bytes(&entry.key) || !in->Bytes(&entry.value)) {
+        return Malformed(path);
+      }
+      entry.type = static_cast<ValueType>(type);
+      entry.flags = kEntryDecoded;
+      size_t expected = entry.type == ValueType::kBool ? 1 : 8;
+      if (entry.type != ValueType::kString &&
+          entry.value.size() != expected) {
+        return Malformed(path);
+      }
+      ns->entries.push_back(entry);
+      ++stats->entries_added;
+    } else {
+      return Malformed(path);
+    }
+    size_t n = ns->entries.size();
+    if (n > 1 && ns->entries[n - 2].key >= ns->entries[n - 1].key) {
+      return Malformed(path);
+    }
+  }
+  stats->entries_removed += old_count - cursor;
+  return Status::Ok();
+}
+
+}  // namespace
+
+Status MakeDelta(const Snapshot& base, const Snapshot& target,
+                 const std::string& path, DeltaStats* stats) {
+  DeltaStats local;
+  if (stats == nullptr) stats = &local;
+  *stats = DeltaStats();
+
+  DeltaHeader header = {};
+  header.magic = kDeltaMagic;
+  header.version = kDeltaVersion;
+  header.snapshot_version = kSnapshotVersion;
+  header.namespace_count = target.namespace_count();
+  header.base_checksum = base.header().checksum;
+  header.target_checksum = target.header().checksum;
+  header.target_size = target.header().file_size;
+
+  FileWriter out;
+  CCC_RETURN_IF_ERROR(out.Open(path));
+  out.Append(&header, sizeof(header));  // Patched below.
+  out.BeginChecksum();
+
+  Schema schema;
+  ReadSchema(target, &schema);
+  out.PutVarint(schema.fields.size());
+  for (const SchemaField& field : schema.fields) {
+    out.PutVarint(field.ns.size());
+    out.Append(field.ns);
+    out.PutVarint(field.key.size());
+    out.Append(field.key);
+    out.PutU8(static_cast<uint8_t>(field.type));
+  }
+
+  OpWriter ops(&out);
+  for (uint32_t n = 0; n < target.namespace_count(); ++n) {
+    const NamespaceRecord& tns = target.namespace_at(n);
+    std::string_view name = target.namespace_name(tns);
+    out.PutVarint(name.size());
+    out.Append(name);
+
+    int64_t b = base.FindNamespace(name);
+    const NamespaceRecord* bns = b >= 0 ? &base.namespace_at(b) : nullptr;
+    // The values of a namespace with references to others can change
+    // while its source does not.
+    if (bns != nullptr && bns->content_hash == tns.content_hash &&
+        bns->flags == tns.flags && tns.refs_size == 0) {
+      out.PutU8(kCopy);
+      out.PutU64(tns.content_hash);
+      ++stats->namespaces_copied;
+      continue;
+    }
+    out.PutU8(tns.flags & kNamespaceCompressed ? kPatchCompressed : kPatch);
+    out.PutU64(tns.content_hash);
+    std::string_view refs = target.References(tns);
+    out.PutVarint(refs.size());
+    out.Append(refs);
+    ++stats->namespaces_patched;
+
+    // Both sides are sorted by key: merge them.
+    const uint32_t bcount = bns ? bns->entry_count : 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    while (i < bcount || j < tns.entry_count) {
+      const EntryRecord* br = i < bcount
+                                  ? &base.entry_at(bns->first_entry + i)
+                                  : nullptr;
+      const EntryRecord* tr = j < tns.entry_count
+                                  ? &target.entry_at(tns.first_entry + j)
+                                  : nullptr;
+      int cmp;
+      if (br == nullptr) {
+        cmp = 1;
+      } else if (tr == nullptr) {
+        cmp = -1;
+      } else {
+        cmp = base.key(*bns, *br).compare(target.key(tns, *tr));
+      }
+      if (cmp == 0 && SameValue(base, *bns, *br, target, tns, *tr)) {
+        ops.Keep();
+        ++stats->entries_kept;
+        ++i;
+        ++j;
+        continue;
+      }
+      if (cmp <= 0) {
+        ops.Skip();
+        ++stats->entries_removed;
+        ++i;
+      }
+      if (cmp >= 0) {
+        ops.Add(target, tns, *tr);
+        ++stats->entries_added;
+        ++j;
+      }
+    }
+    ops.End();
+  }
+
+  header.body_checksum = out.FinishChecksum();
+  stats->delta_size = out.written();
+  out.Patch(0, &header, sizeof(header));
+  return out.Commit();
+}
+
+Status ApplyDelta(const Snapshot& base, const std::string& delta_path,
+                  const std::string& output, DeltaStats* stats) {
+  DeltaStats local;
+  if (stats == nullptr) stats = &local;
+  *stats = DeltaStats();
+
+  MappedFile file;
+  CCC_RETURN_IF_ERROR(MappedFile::Open(delta_path, &file));
+  std::string_view data = file.data();
+  stats->delta_size = data.size();
+  if (data.size() < sizeof(DeltaHeader)) return Malformed(delta_path);
+  DeltaHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  std::string_view body = data.substr(sizeof(header));
+  if (header.magic != kDeltaMagic || header.version != kDeltaVersion) {
+    return Status::Corrupt(delta_path + ": not a delta");
+  }
+  if (Hash64(body) != header.body_checksum) {
+    return Status::Corrupt(delta_path + ": checksum mismatch");
+  }
+  if (header.snapshot_version != kSnapshotVersion ||
+      header.base_checksum != base.header().checksum) {
+    return Status::InvalidArgument(delta_path +
+                                   ": delta was made against another base");
+  }
+  // The records of the base are spliced and indexed as they are, so its
+  // body has to match the checksum the delta was made against.
+  Status base_status = base.VerifyChecksum();
+  if (!base_status.ok()) {
+    return Status::Corrupt("base snapshot: " + base_status.message());
+  }
+  // The header is not covered by the body checksum. Each namespace takes
+  // at least kMinNamespaceSize body bytes, which bounds what a corrupt
+  // count can make us allocate.
+  if (header.namespace_count > body.size() / kMinNamespaceSize) {
+    return Malformed(delta_path);
+  }
+
+  DeltaReader in(body);
+  Schema schema;
+  uint64_t field_count;
+  if (!in.Varint(&field_count)) return Malformed(delta_path);
+  for (uint64_t i = 0; i < field_count; ++i) {
+    std::string_view ns;
+    std::string_view key;
+    uint8_t type;
+    if (!in.Bytes(&ns) || !in.Bytes(&key) || !in.U8(&type) ||
+        type > static_cast<uint8_t>(ValueType::kBool)) {
+      return Malformed(delta_path);
+    }
+    SchemaField& field = schema.fields.emplace_back();
+    field.ns.assign(ns);
+    field.key.assign(key);
+    field.type = static_cast<ValueType>(type);
+  }
+  if (!NormalizeSchema(&schema).ok()) return Malformed(delta_path);
+
+  Arena arena;
+  std::pmr::vector<NamespaceIr> namespaces(&arena);
+  namespaces.reserve(header.namespace_count);
+  for (uint32_t n = 0; n < header.namespace_count; ++n) {
+    NamespaceIr& ns = namespaces.emplace_back(&arena);
+    std::string_view name;
+    uint8_t kind;
+    if (!in.Bytes(&name) || !in.U8(&kind) || !in.U64(&ns.content_hash)) {
+      return Malformed(delta_path);
+    }
+    ns.name.assign(name);
+    if (!IsValidNamespaceName(ns.name) ||
+        (n > 0 && namespaces[n - 1].name >= ns.name)) {
+      return Malformed(delta_path);
+    }
+
+    int64_t b = base.FindNamespace(ns.name);
+    const NamespaceRecord* old = b >= 0 ? &base.namespace_at(b) : nullptr;
+    if (kind == kCopy) {
+      if (old == nullptr || old->content_hash != ns.content_hash) {
+        return Malformed(delta_path);
+      }
+      ns.base = &base;
+      ns.base_index = static_cast<uint32_t>(b);
+      ++stats->namespaces_copied;
+      continue;
+    }
+    if (kind != kPatch && kind != kPatchCompressed) {
+      return Malformed(delta_path);
+    }
+    if (kind == kPatchCompressed && !PageCodecAvailable()) {
+      return Status::InvalidArgument(delta_path + ": compressed values need "
+                                     "a build with zstd support");
+    }
+    std::string_view refs;
+    if (!in.Bytes(&refs)) return Malformed(delta_path);
+    ns.refs.assign(refs);
+    CCC_RETURN_IF_ERROR(ReplayPatch(base, old, delta_path, &in, &ns, stats));
+    CCC_RETURN_IF_ERROR(FinishNamespace(&ns));
+    if (kind == kPatchCompressed) PageValues(&ns);
+    ++stats->namespaces_patched;
+  }
+  if (!in.done()) return Malformed(delta_path);
+
+  return EmitSnapshot(namespaces, schema, output, &header.target_checksum);
+}
+
+}  // namespace ccc
@@ -0,0 +1,80 @@
+// Binary deltas between two compiled snapshots.
+//
+// A delta lists the target's namespaces in name order. A namespace whose
+// content hash matches the base, and that references no other namespace,
+// is a single copy op; the applier splices its blocks from the base exactly
+// as an incremental compile does. Any
+// other namespace carries an edit script against the base namespace of the
+// same name (or against nothing, if the base lacks it): runs of entries to
+// keep or skip, and added entries with their decoded values. The applier
+// replays the scripts, rebuilds the affected key indexes and emits the
+// target, which must reproduce the target checksum recorded in the delta
+// or nothing is written. The target's schema travels with the delta so
+// its slots can be rebuilt. A namespace the target compiled with value
+// compression is compressed again after replay, which reproduces the
+// target only with the zstd version that compressed it.
+//
+// Delta layout (integers little-endian, varints LEB128):
+//
+//   DeltaHeader
+//   varint field_count
+//   per schema field:  varint ns_len  ns  varint key_len  key  u8 type
+//   per namespace:  varint name_len  name  u8 kind  u64 content_hash
+//     kind 0 (copy):   nothing further
+//     kind 1 (patch), 2 (patch, then compress):  varint refs_len  refs
+//                                                 op... 3
+//       op 0 (keep):   varint count
+//       op 1 (skip):   varint count
+//       op 2 (add):    u8 type  varint key_len  key  varint value_len  value
+//
+// Added values are in snapshot encoding: decoded string bytes, or the
+// little-endian inline payload of a scalar.
+
+#ifndef CCC_DELTA_H_
+#define CCC_DELTA_H_
+
+#include <cstdint>
+#include <string>
+
+#include "snapshot.h"
+#include "status.h"
+
+namespace ccc {
+
+inline constexpr uint32_t kDeltaMagic = 0x44434343;  // "CCCD"
+inline constexpr uint32_t kDeltaVersion = 4;
+
+struct DeltaHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t snapshot_version;  // Format version of base and target.
+  uint32_t namespace_count;   // In the target.
+  uint64_t base_checksum;
+  uint64_t target_checksum;
+  uint64_t target_size;
+  uint64_t body_checksum;  // XXH64 of everything after the header.
+};
+static_assert(sizeof(DeltaHeader) == 48, "DeltaHeader layout");
+
+struct DeltaStats {
+  uint32_t namespaces_copied = 0;
+  uint32_t namespaces_patched = 0;
+  uint64_t entries_kept = 0;
+  uint64_t entries_added = 0;
+  uint64_t entries_removed = 0;
+  uint64_t delta_size = 0;
+};
+
+// Writes the delta that turns `base` into `target` to `path`.
+Status MakeDelta(const Snapshot& base, const Snapshot& target,
+                 const std::string& path, DeltaStats* stats = nullptr);
+
+// Applies the delta at `delta_path` to `base` and atomically writes the
+// result to `output`, which may be the base's own path: readers that still
+// map the old snapshot keep a valid mapping.
+Status ApplyDelta(const Snapshot& base, const std::string& delta_path,
+                  const std::string& output, DeltaStats* stats = nullptr);
+
+}  // namespace ccc
+
+#endif  // CCC_DELTA_H_
@@ -0,0 +1,353 @@
+#include "emitter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#include "escape.h"
+#include "file_writer.h"
+#include "perfect_hash.h"
+#include "snapshot.h"
+#include "snapshot_format.h"
+
+namespace ccc {
+
+namespace {
+
+void AppendIndexTable(const IndexTable& table, FileWriter* out) {
+  out->Append(table.displacements.data(), table.displacements.size() * 4);
+  out->Append(table.slots.data(), table.slots.size() * 4);
+}
+
+Status MissingField(const SchemaField& field) {
+  return Status::InvalidArgument("schema field " + field.ns + "/" +
+                                 field.key + " is not defined");
+}
+
+Status CheckFieldType(const SchemaField& field, ValueType type) {
+  if (type == field.type) return Status::Ok();
+  return Status::InvalidArgument(
+      "schema field " + field.ns + "/" + field.key + " is declared " +
+      ValueTypeName(field.type) + " but defined as " + ValueTypeName(type));
+}
+
+// Finds every schema field's entry and fills in its slot. Fields,
+// namespaces and the entries of each namespace are all sorted, so a single
+// merge pass resolves them; for namespaces spliced from a base the key
+// index is probed instead. Paged string fields get an uncompressed copy in
+// `copies`, which is written at `copies_offset`.
+Status ResolveSchema(const Schema& schema,
+                     const std::pmr::vector<NamespaceIr>& namespaces,
+                     const std::pmr::vector<NamespaceRecord>& records,
+                     uint64_t value_heap_offset, uint64_t copies_offset,
+                     std::pmr::vector<SchemaSlot>* slots,
+                     std::pmr::string* copies) {
+  const std::vector<SchemaField>& fields = schema.fields;
+  slots->assign(fields.size(), SchemaSlot());
+  size_t n = 0;
+  size_t f = 0;
+  while (f < fields.size()) {
+    while (n < namespaces.size() && namespaces[n].name < fields[f].ns) ++n;
+    if (n == namespaces.size() || namespaces[n].name != fields[f].ns) {
+      return MissingField(fields[f]);
+    }
+    const NamespaceIr& ns = namespaces[n];
+    const NamespaceRecord& rec = records[n];
+    const uint64_t values = value_heap_offset + rec.value_offset;
+    size_t i = 0;
+    uint64_t value_offset = 0;  // Of entries[i] within the value block.
+    for (; f < fields.size() && fields[f].ns == ns.name; ++f) {
+      const SchemaField& field = fields[f];
+      SchemaSlot& slot = (*slots)[f];
+      if (ns.base != nullptr) {
+        const NamespaceRecord& old = ns.base->namespace_at(ns.base_index);
+        ValueRef value = ns.base->Find(ns.base_index, field.key);
+        if (!value) return MissingField(field);
+        CCC_RETURN_IF_ERROR(CheckFieldType(field, value.type()));
+        const EntryRecord& entry = *value.record();
+        slot.entry = rec.first_entry +
+                     static_cast<uint32_t>(
+                         &entry - &ns.base->entry_at(old.first_entry));
+        slot.value_length = entry.value_length;
+        slot.value = entry.value;
+        if (entry.flags & kRecordPaged) {
+          slot.value = copies_offset + copies->size();
+          copies->append(value.string_value());
+        } else if (value.type() == ValueType::kString) {
+          slot.value += values;
+        }
+        continue;
+      }
+      for (; i < ns.entries.size() && ns.entries[i].key < field.key; ++i) {
+        if (ns.entries[i].type == ValueType::kString) {
+          size_t length = EncodedValueLength(ns.entries[i]);
+          if (ns.page_count == 0 || !IsPagedLength(length)) {
+            value_offset += length;
+          }
+        }
+      }
+      if (i == ns.entries.size() || ns.entries[i].key != field.key) {
+        return MissingField(field);
+      }
+      const Entry& entry = ns.entries[i];
+      CCC_RETURN_IF_ERROR(CheckFieldType(field, entry.type));
+      slot.entry = rec.first_entry + static_cast<uint32_t>(i);
+      slot.value_length = static_cast<uint32_t>(EncodedValueLength(entry));
+      if (entry.type != ValueType::kString) {
+        slot.value = EncodeInlineValue(entry);
+      } else if (ns.page_count > 0 && IsPagedLength(slot.value_length)) {
+        slot.value = copies_offset + copies->size();
+        size_t at = copies->size();
+        copies->resize(at + entry.value.size());
+        copies->resize(at + EncodeStringValue(entry, copies->data() + at));
+      } else {
+        slot.value = values + value_offset;
+      }
+    }
+  }
+  return Status::Ok();
+}
+
+}  // namespace
+
+size_t EncodedValueLength(const Entry& entry) {
+  switch (entry.type) {
+    case ValueType::kInt:
+    case ValueType::kDouble:
+      return 8;
+    case ValueType::kBool:
+      return 1;
+    case ValueType::kString:
+      break;
+  }
+  if (entry.flags & kEntryEscaped) return UnescapedLength(entry.value);
+  return entry.value.size();
+}
+
+uint64_t EncodeInlineValue(const Entry& entry) {
+  if (entry.flags & kEntryDecoded) {
+    uint64_t payload = 0;
+    std::memcpy(&payload, entry.value.data(),
+                std::min(entry.value.size(), sizeof(payload)));
+    return payload;
+  }
+  const char* first = entry.value.data();
+  const char* last = first + entry.value.size();
+  switch (entry.type) {
+    case ValueType::kInt: {
+      // The parser only classifies values that convert cleanly.
+      int64_t v = 0;
+      std::from_chars(first, last, v);
+      return static_cast<uint64_t>(v);
+    }
+    case ValueType::kDouble: {
+      double v = 0;
+      std::from_chars(first, last, v);
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof(bits));
+      return bits;
+    }
+    case ValueType::kBool:
+      return entry.value == "true" ? 1 : 0;
+    case ValueType::kString:
+      break;
+  }
+  return 0;
+}
+
+size_t EncodeStringValue(const Entry& entry, char* out) {
+  if (entry.flags & kEntryEscaped) return Unescape(entry.value, out);
+  std::memcpy(out, entry.value.data(), entry.value.size());
+  return entry.value.size();
+}
+
+Status EmitSnapshot(const std::pmr::vector<NamespaceIr>& namespaces,
+                    const Schema& schema, const std::string& path,
+                    const uint64_t* expected_checksum) {
+  constexpr uint64_t kU32Max = std::numeric_limits<uint32_t>::max();
+  const size_t ns_count = namespaces.size();
+  std::pmr::memory_resource* arena = namespaces.get_allocator().resource();
+  if (ns_count >= kDirectSlot) {
+    return Status::InvalidArgument("too many namespaces");
+  }
+
+  // Sizing pass: fill in every namespace record except its offsets.
+  std::pmr::vector<NamespaceRecord> records(ns_count, arena);
+  uint64_t entry_count = 0;
+  uint64_t names_size = 0;
+  for (size_t n = 0; n < ns_count; ++n) {
+    const NamespaceIr& ns = namespaces[n];
+    NamespaceRecord& rec = records[n];
+    rec.name_offset = static_cast<uint32_t>(names_size);
+    rec.name_length = static_cast<uint32_t>(ns.name.size());
+    rec.content_hash = ns.content_hash;
+    names_size += ns.name.size();
+    if (ns.base != nullptr) {
+      const NamespaceRecord& old = ns.base->namespace_at(ns.base_index);
+      rec.entry_count = old.entry_count;
+      rec.key_size = old.key_size;
+      rec.value_size = old.value_size;
+      rec.seed = old.seed;
+      rec.page_count = old.page_count;
+      rec.page_table_offset = old.page_table_offset;
+      rec.dictionary_size = old.dictionary_size;
+      rec.flags = old.flags;
+      rec.refs_size = old.refs_size;
+    } else {
+      if (ns.entries.size() >= kDirectSlot) {
+        return Status::InvalidArgument("namespace " + ns.name +
+                                       " exceeds 2^31 keys");
+      }
+      rec.entry_count = static_cast<uint32_t>(ns.entries.size());
+      rec.key_size = ns.key_size;
+      rec.refs_size = static_cast<uint32_t>(ns.refs.size());
+      rec.value_size = ns.value_size;
+      rec.seed = ns.index.seed;
+      rec.page_count = ns.page_count;
+      if (ns.compressed) rec.flags |= kNamespaceCompressed;
+      if (ns.page_count > 0) {
+        rec.page_table_offset = ns.value_size - ns.pages.size();
+        rec.dictionary_size = ns.dictionary_size;
+      }
+    }
+    rec.first_entry = static_cast<uint32_t>(entry_count);
+    entry_count += rec.entry_count;
+    if (entry_count > kU32Max || names_size > kU32Max ||
+        rec.key_size > kU32Max) {
+      return Status::InvalidArgument("snapshot exceeds 2^32 entries or key "
+                                     "bytes");
+    }
+  }
+
+  std::pmr::vector<uint64_t> hashes(arena);
+  IndexTable namespace_index(arena);
+  if (!BuildIndexTable(
+          static_cast<uint32_t>(ns_count),
+          [&](uint32_t i) -> std::string_view { return namespaces[i].name; },
+          &hashes, &namespace_index)) {
+    return Status::InvalidArgument("could not build the namespace index");
+  }
+
+  SnapshotHeader header = {};
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.namespace_count = static_cast<uint32_t>(ns_count);
+  header.entry_count = static_cast<uint32_t>(entry_count);
+  header.schema_field_count = static_cast<uint32_t>(schema.fields.size());
+  header.schema_hash = SchemaHash(schema);
+  header.schema_offset = sizeof(SnapshotHeader);
+  header.namespace_offset = SchemaSlotOffset(header.schema_field_count);
+  header.entry_offset =
+      header.namespace_offset + ns_count * sizeof(NamespaceRecord);
+  header.index_offset = header.entry_offset +
+                        entry_count * sizeof(EntryRecord);
+  header.namespace_seed = namespace_index.seed;
+
+  uint64_t index_offset = header.index_offset + IndexTableSize(ns_count);
+  uint64_t key_offset = names_size;
+  uint64_t value_offset = 0;
+  for (NamespaceRecord& rec : records) {
+    rec.index_offset = index_offset;
+    rec.key_offset = key_offset;
+    rec.value_offset = value_offset;
+    index_offset += IndexTableSize(rec.entry_count);
+    key_offset += rec.key_size;
+    value_offset += rec.value_size;
+  }
+  header.key_heap_offset = index_offset;
+  header.value_heap_offset = (header.key_heap_offset + key_offset + 7) &
+                             ~uint64_t{7};
+
+  std::pmr::vector<SchemaSlot> slots(arena);
+  std::pmr::string copies(arena);
+  CCC_RETURN_IF_ERROR(ResolveSchema(schema, namespaces, records,
+                                    header.value_heap_offset,
+                                    header.value_heap_offset + value_offset,
+                                    &slots, &copies));
+
+  FileWriter out;
+  CCC_RETURN_IF_ERROR(out.Open(path));
+  out.Append(&header, sizeof(header));  // Patched below.
+  out.BeginChecksum();
+  out.Append(slots.data(), slots.size() * sizeof(SchemaSlot));
+  out.Append(records.data(), records.size() * sizeof(NamespaceRecord));
+
+  for (const NamespaceIr& ns : namespaces) {
+    if (ns.base != nullptr) {
+      out.Append(ns.base->EntryBlock(ns.base->namespace_at(ns.base_index)));
+      continue;
+    }
+    uint32_t entry_key = 0;
+    uint64_t entry_value = 0;
+    PagePacker packer;
+    for (const Entry& entry : ns.entries) {
+      EntryRecord rec = {};
+      rec.key_offset = entry_key;
+      rec.key_length = static_cast<uint32_t>(entry.key.size());
+      rec.type = static_cast<uint8_t>(entry.type);
+      size_t length = EncodedValueLength(entry);
+      rec.value_length = static_cast<uint32_t>(length);
+      if (entry.type != ValueType::kString) {
+        rec.value = EncodeInlineValue(entry);
+      } else if (ns.page_count > 0 && IsPagedLength(length)) {
+        rec.value = packer.Place(length);
+        rec.flags = kRecordPaged;
+      } else {
+        rec.value = entry_value;
+        entry_value += length;
+      }
+      out.Append(&rec, sizeof(rec));
+      entry_key += rec.key_length;
+    }
+  }
+
+  AppendIndexTable(namespace_index, &out);
+  for (const NamespaceIr& ns : namespaces) {
+    if (ns.base != nullptr) {
+      out.Append(ns.base->IndexBlock(ns.base->namespace_at(ns.base_index)));
+    } else {
+      AppendIndexTable(ns.index, &out);
+    }
+  }
+
+  for (const NamespaceIr& ns : namespaces) out.Append(ns.name);
+  for (const NamespaceIr& ns : namespaces) {
+    if (ns.base != nullptr) {
+      out.Append(ns.base->KeyBlock(ns.base->namespace_at(ns.base_index)));
+      continue;
+    }
+    for (const Entry& entry : ns.entries) out.Append(entry.key);
+    out.Append(ns.refs);
+  }
+  out.PadTo(8);
+
+  for (const NamespaceIr& ns : namespaces) {
+    if (ns.base != nullptr) {
+      out.Append(ns.base->ValueBlock(ns.base->namespace_at(ns.base_index)));
+      continue;
+    }
+    for (const Entry& entry : ns.entries) {
+      if (entry.type != ValueType::kString) continue;
+      if (ns.page_count > 0 && IsPagedLength(EncodedValueLength(entry))) {
+        continue;
+      }
+      // The escaped text bounds the decoded length.
+      out.Advance(EncodeStringValue(entry, out.Reserve(entry.value.size())));
+    }
+    out.Append(ns.pages);
+  }
+  out.Append(copies);
+
+  header.file_size = out.written();
+  header.checksum = out.FinishChecksum();
+  if (expected_checksum != nullptr && header.checksum != *expected_checksum) {
+    // FileWriter's destructor removes the temporary file.
+    return Status::Corrupt(path + ": result does not match expected "
+                           "checksum");
+  }
+  out.Patch(0, &header, sizeof(header));
+  return out.Commit();
+}
+
+}  // namespace ccc
@@ -0,0 +1,71 @@
+// Serializes the namespace IR into a snapshot (see snapshot_format.h).
+//
+// Per-namespace work (parsing, sizing, index tables) is done by the compiler
+// beforehand; the emitter lays the namespaces out in name order and writes
+// the file front to back. Only the header is patched at the end, once the
+// checksum is known. Values are decoded straight into the output buffer.
+
+#ifndef CCC_EMITTER_H_
+#define CCC_EMITTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+#include "schema.h"
+#include "snapshot_format.h"
+#include "status.h"
+
+namespace ccc {
+
+// Exact decoded length of `entry`'s value as stored in the snapshot.
+size_t EncodedValueLength(const Entry& entry);
+
+// Inline payload for int, double and bool entries.
+uint64_t EncodeInlineValue(const Entry& entry);
+
+// Decodes a string entry's value into `out`, which must hold
+// entry.value.size() bytes; the decoder may use all of them as scratch.
+// Returns the number of bytes written, EncodedValueLength(entry).
+size_t EncodeStringValue(const Entry& entry, char* out);
+
+// Whether a string value of `length` bytes is stored in a compressed page
+// when its namespace has pages.
+inline bool IsPagedLength(size_t length) { return length >= kPagedValueMin; }
+
+// Places paged values, in entry order, the way every writer and reader of
+// value pages must agree on: a value starts a new page unless it fits in
+// the current one.
+class PagePacker {
+ public:
+  // Returns page << 32 | offset for the next value of `length` bytes.
+  uint64_t Place(size_t length) {
+    if (used_ > 0 && used_ + length > kValuePageSize) {
+      ++page_;
+      used_ = 0;
+    }
+    uint64_t location = uint64_t{page_} << 32 | used_;
+    used_ += length;
+    return location;
+  }
+
+ private:
+  uint32_t page_ = 0;
+  uint64_t used_ = 0;
+};
+
+// Writes `namespaces` (sorted by name, each either spliced from a base or
+// with its index, key_size, value_size and any pages filled in) to `path`,
+// with a slot for every field of the normalized `schema`; a field that is
+// missing or defined with another type is an error. If `expected_checksum` is
+// given, a snapshot with any other checksum is discarded instead of
+// committed. Scratch space comes from the memory resource of `namespaces`.
+Status EmitSnapshot(const std::pmr::vector<NamespaceIr>& namespaces,
+                    const Schema& schema, const std::string& path,
+                    const uint64_t* expected_checksum = nullptr);
+
+}  // namespace ccc
+
+#endif  // CCC_EMITTER_H_
@@ -0,0 +1,107 @@
+#include "epoch.h"
+
+#include <cassert>
+#include <limits>
+
+namespace ccc {
+
+// One per thread that has ever pinned, linked into a list that only grows.
+// `epoch` is 0 while the owner is not pinned; `depth` is touched only by
+// the owner. Padded to a cache line so pins on different threads do not
+// contend.
+struct alignas(64) EpochDomain::Guard::Record {
+  std::atomic<uint64_t> epoch{0};
+  std::atomic<bool> in_use{true};
+  uint32_t depth = 0;
+  Record* next = nullptr;
+};
+
+namespace {
+
+// Hands the thread's record back for reuse when the thread exits.
+struct RecordOwner {
+  EpochDomain::Guard::Record* record = nullptr;
+  ~RecordOwner();
+};
+
+thread_local RecordOwner tls_record;
+
+}  // namespace
+
+RecordOwner::~RecordOwner() {
+  if (record != nullptr) record->in_use.store(false, std::memory_order_release);
+}
+
+EpochDomain& EpochDomain::Global() {
+  static EpochDomain* domain = new EpochDomain;
+  return *domain;
+}
+
+EpochDomain::Guard::Guard(EpochDomain* domain) {
+  if (tls_record.record == nullptr) {
+    tls_record.record = domain->AcquireRecord();
+  }
+  record_ = tls_record.record;
+  if (record_->depth++ == 0) {
+    // Sequentially consistent so the pin is ordered before the caller's
+    // loads of shared pointers: a writer that scans after unlinking either
+    // sees this epoch or the caller sees the new pointer.
+    record_->epoch.store(domain->epoch_.load(std::memory_order_seq_cst),
+                         std::memory_order_seq_cst);
+  }
+}
+
+EpochDomain::Guard& EpochDomain::Guard::operator=(Guard&& other) noexcept {
+  if (this != &other) {
+    Release();
+    record_ = other.record_;
+    other.record_ = nullptr;
+  }
+  return *this;
+}
+
+void EpochDomain::Guard::Release() {
+  if (record_ == nullptr) return;
+  // `depth` belongs to the pinning thread; releasing elsewhere would
+  // unpin the wrong thread, or leave this one pinned forever.
+  assert(record_ == tls_record.record && "Guard released on another thread");
+  if (--record_->depth == 0) {
+    record_->epoch.store(0, std::memory_order_release);
+  }
+  record_ = nullptr;
+}
+
+EpochDomain::Guard::Record* EpochDomain::AcquireRecord() {
+  for (Guard::Record* r = records_.load(std::memory_order_acquire);
+       r != nullptr; r = r->next) {
+    bool free = false;
+    if (!r->in_use.load(std::memory_order_relaxed) &&
+        r->in_use.compare_exchange_strong(free, true,
+                                          std::memory_order_acquire)) {
+      return r;
+    }
+  }
+  auto* r = new Guard::Record;
+  r->next = records_.load(std::memory_order_relaxed);
+  while (!records_.compare_exchange_weak(r->next, r,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+  }
+  return r;
+}
+
+uint64_t EpochDomain::Advance() {
+  return epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+}
+
+uint64_t EpochDomain::MinPinned() const {
+  uint64_t min = std::numeric_limits<uint64_t>::max();
+  for (const Guard::Record* r = records_.load(std::memory_order_acquire);
+       r != nullptr; r = r->next) {
+    uint64_t e = r->epoch.load(std::memory_order_seq_cst);
+    if (e != 0 && e < min) min = e;
+  }
+  return min;
+}
+
+}  // namespace ccc
@@ -0,0 +1,69 @@
+// Epoch-based reclamation. A reader pins the current thread for as long
+// as it dereferences shared objects; a writer that unlinks an object tags
+// it with the epoch it advanced to and frees it once no pinned thread is
+// older than that tag. Pinning and unpinning are a few atomic stores on a
+// record the thread owns, so readers never wait for writers or for each
+// other.
+
+#ifndef CCC_EPOCH_H_
+#define CCC_EPOCH_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace ccc {
+
+class EpochDomain {
+ public:
+  // The process-wide domain. It is never destroyed, so threads may unpin
+  // during static destruction.
+  static EpochDomain& Global();
+
+  // Pins the calling thread while alive. Guards nest; only the outermost
+  // one records an epoch. A guard may be moved, but must be destroyed (or
+  // assigned over) on the thread that created it; debug builds assert
+  // this.
+  class Guard {
+   public:
+    // Per-thread pin state, defined in epoch.cc.
+    struct Record;
+
+    Guard() = default;
+    explicit Guard(EpochDomain* domain);
+    ~Guard() { Release(); }
+    Guard(Guard&& other) noexcept : record_(other.record_) {
+      other.record_ = nullptr;
+    }
+    Guard& operator=(Guard&& other) noexcept;
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+   private:
+    void Release();
+
+    Record* record_ = nullptr;
+  };
+
+  Guard Pin() { return Guard(this); }
+
+  // Starts a new epoch and returns it. Objects unlinked before the call
+  // may be freed once MinPinned() reaches the returned value.
+  uint64_t Advance();
+
+  // The oldest epoch any thread is pinned at, or UINT64_MAX if none is.
+  uint64_t MinPinned() const;
+
+ private:
+  EpochDomain() = default;
+
+  // Claims a record for the calling thread, reusing one released by an
+  // exited thread when possible.
+  Guard::Record* AcquireRecord();
+
+  std::atomic<uint64_t> epoch_{1};
+  std::atomic<Guard::Record*> records_{nullptr};
+};
+
+}  // namespace ccc
+
+#endif  // CCC_EPOCH_H_
@@ -0,0 +1,126 @@
+#include "escape.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "simd.h"
+
+namespace ccc {
+
+namespace {
+
+uint32_t HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return c - 'A' + 10;
+}
+
+uint32_t Hex4(const char* p) {
+  return (HexValue(p[0]) << 12) | (HexValue(p[1]) << 8) |
+         (HexValue(p[2]) << 4) | HexValue(p[3]);
+}
+
+size_t EncodeUtf8(uint32_t cp, char* out) {
+  if (cp < 0x80) {
+    out[0] = static_cast<char>(cp);
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (cp >> 6));
+    out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (cp >> 12));
+    out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (cp >> 18));
+  out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+}  // namespace
+
+size_t Unescape(std::string_view in, char* out) {
+  const SimdKernels& kernels = ActiveSimdKernels();
+  const char* p = in.data();
+  const char* end = p + in.size();
+  char* o = out;
+  while (p < end) {
+    // Output never runs ahead of input, so the kernel's whole-vector stores
+    // stay inside the in.size() bytes `out` is guaranteed to hold.
+    p = kernels.copy_until_backslash(p, end, &o);
+    if (p == end) break;
+
+    char c = p[1];
+    p += 2;
+    switch (c) {
+      case 'b': *o++ = '\b'; break;
+      case 'f': *o++ = '\f'; break;
+      case 'n': *o++ = '\n'; break;
+      case 'r': *o++ = '\r'; break;
+      case 't': *o++ = '\t'; break;
+      case 'u': {
+        uint32_t cp = Hex4(p);
+        p += 4;
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          if (end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            uint32_t lo = Hex4(p + 2);
+            if (lo >= 0xDC00 && lo <= 0xDFFF) {
+              cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+              p += 6;
+            } else {
+              cp = 0xFFFD;
+            }
+          } else {
+            cp = 0xFFFD;
+          }
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+          cp = 0xFFFD;
+        }
+        o += EncodeUtf8(cp, o);
+        break;
+      }
+      default:  // '"', '\\' and '/' stand for themselves.
+        *o++ = c;
+        break;
+    }
+  }
+  return o - out;
+}
+
+size_t UnescapedLength(std::string_view in) {
+  const char* p = in.data();
+  const char* end = p + in.size();
+  size_t len = 0;
+  while (p < end) {
+    const char* bs = static_cast<const char*>(std::memchr(p, '\\', end - p));
+    if (bs == nullptr) return len + (end - p);
+    len += bs - p;
+    p = bs + 2;
+    if (bs[1] != 'u') {
+      ++len;
+      continue;
+    }
+    uint32_t cp = Hex4(p);
+    p += 4;
+    if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' &&
+        p[1] == 'u') {
+      uint32_t lo = Hex4(p + 2);
+      if (lo >= 0xDC00 && lo <= 0xDFFF) {
+        len += 4;
+        p += 6;
+        continue;
+      }
+    }
+    // Unpaired surrogates become U+FFFD, which is three bytes as well.
+    len += cp < 0x80 ? 1 : cp < 0x800 ? 2 : 3;
+  }
+  return len;
+}
+
+}  // namespace ccc
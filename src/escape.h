@@ -0,0 +1,22 @@
+// Decoding of JSON-style string escapes. The lexer has already checked that
+// every escape is well formed, so decoding cannot fail.
+
+#ifndef CCC_ESCAPE_H_
+#define CCC_ESCAPE_H_
+
+#include <cstddef>
+#include <string_view>
+
+namespace ccc {
+
+// Decodes `in` into `out` and returns the number of bytes written. The
+// decoded form is never longer than the escaped form, so `out` needs at most
+// in.size() bytes. Unpaired surrogates decode to U+FFFD.
+size_t Unescape(std::string_view in, char* out);
+
+// Returns the length Unescape() would produce for `in` without writing it.
+size_t UnescapedLength(std::string_view in);
+
+}  // namespace ccc
+
+#endif  // CCC_ESCAPE_H_
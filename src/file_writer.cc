@@ -0,0 +1,157 @@
+#include "file_writer.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+
+namespace ccc {
+
+FileWriter::~FileWriter() {
+  if (fd_ >= 0) {
+    close(fd_);
+    unlink(tmp_path_.c_str());
+  }
+}
+
+Status FileWriter::Open(const std::string& path) {
+  path_ = path;
+  // A unique name, so concurrent writers of the same path do not share a
+  // temporary file; the last Commit() wins.
+  tmp_path_ = path + ".tmp.XXXXXX";
+  fd_ = mkostemp(tmp_path_.data(), O_CLOEXEC);
+  if (fd_ < 0) {
+    return Status::IoError("open " + tmp_path_ + ": " + std::strerror(errno));
+  }
+  // mkostemp() creates the file private to its owner; the artifact is
+  // meant to be read by every service on the host.
+  if (fchmod(fd_, 0644) != 0) {
+    Status status = Status::IoError("chmod " + tmp_path_ + ": " +
+                                    std::strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    unlink(tmp_path_.c_str());
+    return status;
+  }
+  buf_.reset(new char[kBufferSize]);
+  cap_ = kBufferSize;
+  len_ = 0;
+  written_ = 0;
+  checksumming_ = false;
+  error_ = Status::Ok();
+  return Status::Ok();
+}
+
+void FileWriter::PutU32(uint32_t v) {
+  char* p = Reserve(4);
+  for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+  Advance(4);
+}
+
+void FileWriter::PutU64(uint64_t v) {
+  char* p = Reserve(8);
+  for (int i = 0; i < 8; ++i) p[i] = static_cast<char>(v >> (8 * i));
+  Advance(8);
+}
+
+void FileWriter::PutVarint(uint64_t v) {
+  char* p = Reserve(10);
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = static_cast<char>(v);
+  Advance(n);
+}
+
+void FileWriter::PadTo(size_t alignment) {
+  size_t pad = (alignment - written_ % alignment) % alignment;
+  std::memset(Reserve(pad), 0, pad);
+  Advance(pad);
+}
+
+void FileWriter::BeginChecksum() {
+  Flush();
+  hasher_.Reset();
+  checksumming_ = true;
+}
+
+uint64_t FileWriter::FinishChecksum() {
+  Flush();
+  checksumming_ = false;
+  return hasher_.Digest();
+}
+
+void FileWriter::Patch(uint64_t offset, const void* data, size_t n) {
+  Flush();
+  const char* p = static_cast<const char*>(data);
+  while (n > 0 && error_.ok()) {
+    ssize_t w = pwrite(fd_, p, n, static_cast<off_t>(offset));
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      error_ = Status::IoError("write " + tmp_path_ + ": " +
+                               std::strerror(errno));
+      return;
+    }
+    p += w;
+    offset += static_cast<uint64_t>(w);
+    n -= static_cast<size_t>(w);
+  }
+}
+
+void FileWriter::Grow(size_t n) {
+  Flush();
+  if (n > cap_) {
+    // A single oversized reservation; keep the larger buffer afterwards.
+    buf_.reset(new char[n]);
+    cap_ = n;
+  }
+}
+
+void FileWriter::Flush() {
+  WriteAll(buf_.get(), len_);
+  len_ = 0;
+}
+
+void FileWriter::AppendLarge(const void* data, size_t n) {
+  Flush();
+  WriteAll(static_cast<const char*>(data), n);
+  written_ += n;
+}
+
+void FileWriter::WriteAll(const char* data, size_t n) {
+  if (checksumming_) hasher_.Update(data, n);
+  while (n > 0 && error_.ok()) {
+    ssize_t w = write(fd_, data, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      error_ = Status::IoError("write " + tmp_path_ + ": " +
+                               std::strerror(errno));
+      return;
+    }
+    data += w;
+    n -= static_cast<size_t>(w);
+  }
+}
+
+Status FileWriter::Commit() {
+  Flush();
+  if (error_.ok() && fsync(fd_) != 0) {
+    error_ = Status::IoError("fsync " + tmp_path_ + ": " +
+                             std::strerror(errno));
+  }
+  close(fd_);
+  fd_ = -1;
+  if (error_.ok() && std::rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+    error_ = Status::IoError("rename " + tmp_path_ + ": " +
+                             std::strerror(errno));
+  }
+  if (!error_.ok()) unlink(tmp_path_.c_str());
+  return error_;
+}
+
+}  // namespace ccc
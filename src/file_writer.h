@@ -0,0 +1,97 @@
+// Buffered, atomically committed output file. Data goes to a uniquely named
+// `<path>.tmp.XXXXXX` and is renamed over `path` by Commit(), so readers
+// that mmap the artifact never observe a partially written file, and
+// concurrent writers of the same path never write to the same file.
+
+#ifndef CCC_FILE_WRITER_H_
+#define CCC_FILE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "hash.h"
+#include "status.h"
+
+namespace ccc {
+
+class FileWriter {
+ public:
+  static constexpr size_t kBufferSize = 1 << 16;
+
+  FileWriter() = default;
+  ~FileWriter();
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  Status Open(const std::string& path);
+
+  // Returns a pointer to at least `n` writable bytes; call Advance() with
+  // the number actually used. Lets callers encode directly into the buffer.
+  char* Reserve(size_t n) {
+    if (cap_ - len_ < n) Grow(n);
+    return buf_.get() + len_;
+  }
+  void Advance(size_t n) {
+    len_ += n;
+    written_ += n;
+  }
+
+  void Append(const void* data, size_t n) {
+    if (n >= kBufferSize) {
+      AppendLarge(data, n);
+      return;
+    }
+    std::memcpy(Reserve(n), data, n);
+    Advance(n);
+  }
+  void Append(std::string_view s) { Append(s.data(), s.size()); }
+  void PutU8(uint8_t v) { Append(&v, 1); }
+  void PutU32(uint32_t v);
+  void PutU64(uint64_t v);
+  // LEB128: seven bits per byte, least significant group first.
+  void PutVarint(uint64_t v);
+
+  // Appends zero bytes until written() is a multiple of `alignment`.
+  void PadTo(size_t alignment);
+
+  // Total bytes appended so far.
+  uint64_t written() const { return written_; }
+
+  // Starts an XXH64 over every byte appended from now on.
+  void BeginChecksum();
+  // Returns the checksum of the bytes appended since BeginChecksum().
+  uint64_t FinishChecksum();
+
+  // Overwrites `n` bytes at `offset`, which must already have been
+  // appended and must lie before the checksummed range (e.g. a header).
+  void Patch(uint64_t offset, const void* data, size_t n);
+
+  // Flushes, fsyncs and renames into place. The first I/O error seen since
+  // Open() is reported here.
+  Status Commit();
+
+ private:
+  void Grow(size_t n);
+  void Flush();
+  void AppendLarge(const void* data, size_t n);
+  void WriteAll(const char* data, size_t n);
+
+  int fd_ = -1;
+  std::string path_;
+  std::string tmp_path_;
+  std::unique_ptr<char[]> buf_;
+  size_t cap_ = 0;
+  size_t len_ = 0;
+  uint64_t written_ = 0;
+  bool checksumming_ = false;
+  Hasher64 hasher_;
+  Status error_;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_FILE_WRITER_H_
@@ -0,0 +1,138 @@
+#include "hash.h"
+
+#include <cstring>
+
+namespace ccc {
+
+namespace {
+
+constexpr uint64_t kP1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kP2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kP3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kP4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kP5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint32_t Read32(const unsigned char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kP2;
+  acc = Rotl(acc, 31);
+  return acc * kP1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * kP1 + kP4;
+}
+
+uint64_t Finalize(uint64_t h, const unsigned char* p, size_t len) {
+  while (len >= 8) {
+    h ^= Round(0, Read64(p));
+    h = Rotl(h, 27) * kP1 + kP4;
+    p += 8;
+    len -= 8;
+  }
+  if (len >= 4) {
+    h ^= static_cast<uint64_t>(Read32(p)) * kP1;
+    h = Rotl(h, 23) * kP2 + kP3;
+    p += 4;
+    len -= 4;
+  }
+  while (len > 0) {
+    h ^= static_cast<uint64_t>(*p) * kP5;
+    h = Rotl(h, 11) * kP1;
+    ++p;
+    --len;
+  }
+  h ^= h >> 33;
+  h *= kP2;
+  h ^= h >> 29;
+  h *= kP3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t Converge(const uint64_t v[4]) {
+  uint64_t h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+  for (int i = 0; i < 4; ++i) h = MergeRound(h, v[i]);
+  return h;
+}
+
+}  // namespace
+
+uint64_t Hash64(const void* data, size_t len, uint64_t seed) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + len;
+  uint64_t h;
+  if (len >= 32) {
+    uint64_t v[4] = {seed + kP1 + kP2, seed + kP2, seed, seed - kP1};
+    const unsigned char* limit = end - 32;
+    do {
+      v[0] = Round(v[0], Read64(p));
+      v[1] = Round(v[1], Read64(p + 8));
+      v[2] = Round(v[2], Read64(p + 16));
+      v[3] = Round(v[3], Read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = Converge(v);
+  } else {
+    h = seed + kP5;
+  }
+  h += static_cast<uint64_t>(len);
+  return Finalize(h, p, end - p);
+}
+
+void Hasher64::Reset(uint64_t seed) {
+  seed_ = seed;
+  v_[0] = seed + kP1 + kP2;
+  v_[1] = seed + kP2;
+  v_[2] = seed;
+  v_[3] = seed - kP1;
+  total_len_ = 0;
+  buf_len_ = 0;
+}
+
+void Hasher64::Update(const void* data, size_t len) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + len;
+  total_len_ += len;
+
+  if (buf_len_ + len < 32) {
+    std::memcpy(buf_ + buf_len_, p, len);
+    buf_len_ += len;
+    return;
+  }
+  if (buf_len_ > 0) {
+    size_t fill = 32 - buf_len_;
+    std::memcpy(buf_ + buf_len_, p, fill);
+    for (int i = 0; i < 4; ++i) v_[i] = Round(v_[i], Read64(buf_ + 8 * i));
+    p += fill;
+    buf_len_ = 0;
+  }
+  while (end - p >= 32) {
+    for (int i = 0; i < 4; ++i) v_[i] = Round(v_[i], Read64(p + 8 * i));
+    p += 32;
+  }
+  buf_len_ = end - p;
+  std::memcpy(buf_, p, buf_len_);
+}
+
+uint64_t Hasher64::Digest() const {
+  uint64_t h = total_len_ >= 32 ? Converge(v_) : seed_ + kP5;
+  h += total_len_;
+  return Finalize(h, buf_, buf_len_);
+}
+
+}  // namespace ccc
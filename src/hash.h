@@ -0,0 +1,39 @@
+// XXH64, one-shot and streaming. Used for snapshot checksums, namespace
+// content hashes and the key index, so its output is part of the artifact
+// format and must never change.
+
+#ifndef CCC_HASH_H_
+#define CCC_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ccc {
+
+uint64_t Hash64(const void* data, size_t len, uint64_t seed = 0);
+
+inline uint64_t Hash64(std::string_view s, uint64_t seed = 0) {
+  return Hash64(s.data(), s.size(), seed);
+}
+
+class Hasher64 {
+ public:
+  explicit Hasher64(uint64_t seed = 0) { Reset(seed); }
+
+  void Reset(uint64_t seed = 0);
+  void Update(const void* data, size_t len);
+  void Update(std::string_view s) { Update(s.data(), s.size()); }
+  uint64_t Digest() const;
+
+ private:
+  uint64_t v_[4];
+  uint64_t seed_;
+  uint64_t total_len_;
+  unsigned char buf_[32];
+  size_t buf_len_;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_HASH_H_
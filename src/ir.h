@@ -0,0 +1,86 @@
+// Intermediate representation produced by the parser. Entries do not own
+// their text: `key` and `value` are views into the namespace's source,
+// which the compiler reads into its Arena (see arena.h). Containers draw
+// from the same arena and are never freed individually.
+
+#ifndef CCC_IR_H_
+#define CCC_IR_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "perfect_hash.h"
+
+namespace ccc {
+
+enum class ValueType : uint8_t {
+  kString = 0,
+  kInt = 1,     // int64, stored little-endian in 8 bytes.
+  kDouble = 2,  // IEEE-754 binary64, stored little-endian in 8 bytes.
+  kBool = 3,    // One byte, 0 or 1.
+};
+
+const char* ValueTypeName(ValueType type);
+
+// Entry flags.
+inline constexpr uint8_t kEntryEscaped = 1 << 0;  // Value has '\' escapes.
+// Value is already in snapshot encoding: decoded string bytes, or the
+// little-endian inline payload of a scalar. Used for entries taken from an
+// existing snapshot or delta rather than from source text.
+inline constexpr uint8_t kEntryDecoded = 1 << 1;
+// Value is unquoted source text whose type is not inferred yet. Set inside
+// ParseSource() between lexing and typing, and on templates until their
+// references are resolved.
+inline constexpr uint8_t kEntryRaw = 1 << 2;
+// Value contains `${` and goes through ReferenceResolver (references.h).
+inline constexpr uint8_t kEntryTemplate = 1 << 3;
+
+struct Entry {
+  std::string_view key;
+  std::string_view value;  // Source text (quotes stripped) unless decoded.
+  uint32_t line = 0;
+  ValueType type = ValueType::kString;
+  uint8_t flags = 0;
+};
+
+class Snapshot;
+
+struct NamespaceIr {
+  explicit NamespaceIr(std::pmr::memory_resource* arena)
+      : entries(arena), refs(arena), index(arena), pages(arena) {}
+
+  std::string name;
+  std::string path;
+  std::string_view source;          // Owned by the arena.
+  uint64_t content_hash = 0;        // Hash64 of the source bytes.
+  std::pmr::vector<Entry> entries;  // Sorted by key, unique.
+
+  // Keys of other namespaces the values reference, as sorted `ns/key`
+  // lines. Set by ReferenceResolver::Apply().
+  std::pmr::string refs;
+
+  // Filled in by the compiler once `entries` is final.
+  IndexTable index;
+  uint64_t key_size = 0;    // Total key bytes, plus `refs`.
+  uint64_t value_size = 0;  // Total decoded string value bytes.
+
+  // Set by PageValues() when long string values are stored in compressed
+  // pages: the page table, dictionary and pages, as they follow the plain
+  // values in the value block. value_size then covers the whole block.
+  std::pmr::string pages;
+  uint32_t page_count = 0;
+  uint32_t dictionary_size = 0;
+  bool compressed = false;  // PageValues() ran, with or without result.
+
+  // Set when the namespace is unchanged since `base` was compiled; the
+  // emitter then copies it from `base` and `entries` stays empty.
+  const Snapshot* base = nullptr;
+  uint32_t base_index = 0;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_IR_H_
@@ -0,0 +1,149 @@
+#include "lexer.h"
+
+#include <cstring>
+
+#include "simd.h"
+
+namespace ccc {
+
+namespace {
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+inline bool IsHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+}  // namespace
+
+Token Lexer::Make(TokenKind kind, size_t begin, size_t end) {
+  Token tok;
+  tok.kind = kind;
+  tok.line = line_;
+  tok.text = src_.substr(begin, end - begin);
+  return tok;
+}
+
+Token Lexer::Error(const char* message) {
+  Token tok;
+  tok.kind = TokenKind::kError;
+  tok.line = line_;
+  tok.error = message;
+  return tok;
+}
+
+Token Lexer::Next() {
+  for (;;) {
+    while (pos_ < src_.size() && IsBlank(src_[pos_])) ++pos_;
+
+    // An assignment with nothing after '=' is an empty raw value.
+    if (state_ == State::kValue) {
+      state_ = State::kAfterValue;
+      if (pos_ < src_.size() && src_[pos_] == '"') return LexQuoted();
+      return LexRaw();
+    }
+
+    // A key must be followed by '=' on its own line; the line break or the
+    // end of the source would otherwise read as an empty value.
+    if (state_ == State::kAfterKey &&
+        (pos_ >= src_.size() || src_[pos_] == '\n' || src_[pos_] == '\r')) {
+      return Error("expected '=' after key");
+    }
+
+    if (pos_ >= src_.size()) return Make(TokenKind::kEnd, pos_, pos_);
+
+    char c = src_[pos_];
+    if (c == '\r' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '\n') {
+      ++pos_;
+      c = '\n';
+    }
+    if (c == '\n') {
+      Token tok = Make(TokenKind::kNewline, pos_, pos_ + 1);
+      ++pos_;
+      ++line_;
+      state_ = State::kLineStart;
+      return tok;
+    }
+
+    switch (state_) {
+      case State::kLineStart: {
+        if (c == '#') {
+          const void* nl = std::memchr(src_.data() + pos_, '\n',
+                                       src_.size() - pos_);
+          pos_ = nl ? static_cast<const char*>(nl) - src_.data() : src_.size();
+          continue;
+        }
+        if (!IsKeyChar(c)) return Error("expected key");
+        size_t begin = pos_;
+        const char* end = src_.data() + src_.size();
+        pos_ = kernels_.skip_key_chars(src_.data() + pos_, end) - src_.data();
+        state_ = State::kAfterKey;
+        return Make(TokenKind::kKey, begin, pos_);
+      }
+      case State::kAfterKey:
+        if (c != '=') return Error("expected '=' after key");
+        ++pos_;
+        state_ = State::kValue;
+        return Make(TokenKind::kAssign, pos_ - 1, pos_);
+      case State::kValue:
+        break;  // Handled above.
+      case State::kAfterValue:
+        return Error("unexpected characters after value");
+    }
+  }
+}
+
+Token Lexer::LexQuoted() {
+  size_t begin = ++pos_;  // Skip the opening quote.
+  bool escapes = false;
+  const char* end = src_.data() + src_.size();
+  while (pos_ < src_.size()) {
+    // Jump to the next byte that matters: plain text needs no checks.
+    pos_ = kernels_.find_quote_or_escape(src_.data() + pos_, end) -
+           src_.data();
+    if (pos_ == src_.size()) break;
+    char c = src_[pos_];
+    if (c == '"') {
+      Token tok = Make(TokenKind::kString, begin, pos_);
+      tok.has_escapes = escapes;
+      ++pos_;
+      return tok;
+    }
+    if (c == '\n') return Error("unterminated string");
+    if (c == '\\') {
+      escapes = true;
+      if (pos_ + 1 >= src_.size()) return Error("unterminated string");
+      switch (src_[pos_ + 1]) {
+        case '"': case '\\': case '/': case 'b':
+        case 'f': case 'n': case 'r': case 't':
+          pos_ += 2;
+          continue;
+        case 'u':
+          if (pos_ + 6 > src_.size() || !IsHex(src_[pos_ + 2]) ||
+              !IsHex(src_[pos_ + 3]) || !IsHex(src_[pos_ + 4]) ||
+              !IsHex(src_[pos_ + 5])) {
+            return Error("malformed \\u escape");
+          }
+          pos_ += 6;
+          continue;
+        default:
+          return Error("unknown escape sequence");
+      }
+    }
+  }
+  return Error("unterminated string");
+}
+
+Token Lexer::LexRaw() {
+  size_t begin = pos_;
+  const void* nl = std::memchr(src_.data() + pos_, '\n', src_.size() - pos_);
+  size_t end = nl ? static_cast<const char*>(nl) - src_.data() : src_.size();
+  pos_ = end;
+  while (end > begin && (IsBlank(src_[end - 1]) || src_[end - 1] == '\r')) {
+    --end;
+  }
+  return Make(TokenKind::kRaw, begin, end);
+}
+
+}  // namespace ccc
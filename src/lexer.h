@@ -0,0 +1,71 @@
+// Pull lexer for config sources. Tokens are views into the source buffer;
+// the lexer never allocates.
+//
+// Grammar (one assignment per line):
+//
+//   file    := { line }
+//   line    := [ key '=' value ] [ comment ] '\n'
+//   comment := '#' { any }                  (only at the start of a line)
+//   key     := [A-Za-z0-9_.-]+
+//   value   := '"' { char | escape } '"'    (JSON string escapes)
+//            | { any except '\n' }          (raw, surrounding blanks trimmed)
+
+#ifndef CCC_LEXER_H_
+#define CCC_LEXER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "simd.h"
+
+namespace ccc {
+
+enum class TokenKind : uint8_t {
+  kKey,
+  kAssign,
+  kString,   // Quoted value; text excludes the quotes.
+  kRaw,      // Unquoted value.
+  kNewline,
+  kEnd,
+  kError,
+};
+
+struct Token {
+  TokenKind kind = TokenKind::kEnd;
+  bool has_escapes = false;  // kString only.
+  uint32_t line = 0;
+  std::string_view text;
+  const char* error = nullptr;  // kError only; static string.
+};
+
+inline bool IsKeyChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-';
+}
+
+class Lexer {
+ public:
+  explicit Lexer(std::string_view source)
+      : src_(source), kernels_(ActiveSimdKernels()) {}
+
+  Token Next();
+
+ private:
+  enum class State : uint8_t { kLineStart, kAfterKey, kValue, kAfterValue };
+
+  Token Make(TokenKind kind, size_t begin, size_t end);
+  Token Error(const char* message);
+  Token LexQuoted();
+  Token LexRaw();
+
+  std::string_view src_;
+  const SimdKernels& kernels_;
+  size_t pos_ = 0;
+  uint32_t line_ = 1;
+  State state_ = State::kLineStart;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_LEXER_H_
@@ -0,0 +1,420 @@
+// Command-line driver for configcentercompiler.
+
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "codegen.h"
+#include "compiler.h"
+#include "daemon.h"
+#include "delta.h"
+#include "report.h"
+#include "schema.h"
+#include "snapshot.h"
+#include "status.h"
+
+namespace {
+
+void Usage() {
+  std::fputs(
+      "usage: configcentercompiler compile -o OUTPUT [--base SNAPSHOT |\n"
+      "                                    --incremental] [-j THREADS]\n"
+      "                                    [--schema SCHEMA]...\n"
+      "                                    [--report FILE] [--no-compress]\n"
+      "                                    [-v] INPUT...\n"
+      "       configcentercompiler serve --socket SOCKET -o OUTPUT\n"
+      "                                  [-j THREADS] [--schema SCHEMA]...\n"
+      "                                  [--quiet MS] [--max-delay MS]\n"
+      "                                  [--no-compress] [-v] INPUT...\n"
+      "       configcentercompiler publish SOCKET [NAMESPACE]...\n"
+      "       configcentercompiler shutdown SOCKET\n"
+      "       configcentercompiler codegen -o HEADER [--namespace NS]\n"
+      "                                    [--class NAME] SCHEMA...\n"
+      "       configcentercompiler delta BASE TARGET -o DELTA [-v]\n"
+      "       configcentercompiler apply BASE DELTA [-o OUTPUT] [-v]\n"
+      "       configcentercompiler get SNAPSHOT NAMESPACE KEY\n"
+      "       configcentercompiler dump SNAPSHOT\n"
+      "       configcentercompiler verify SNAPSHOT\n"
+      "\n"
+      "  INPUT is a .conf file or a directory of .conf files; each\n"
+      "  file's stem names its namespace.\n"
+      "  --base reuses unchanged namespaces from SNAPSHOT;\n"
+      "  --incremental uses the existing OUTPUT as the base.\n"
+      "  -j sets the compile threads (default: all hardware threads).\n"
+      "  --report writes per-stage timings and allocations as JSON.\n"
+      "  --no-compress stores long values uncompressed.\n"
+      "  serve compiles OUTPUT incrementally for each batch of publish\n"
+      "  requests on SOCKET: a batch closes after --quiet MS without a\n"
+      "  request (default 100) or --max-delay MS after it opened\n"
+      "  (default 1000). publish returns once the snapshot is written.\n"
+      "  SCHEMA is a .schema file or a directory of them; compile\n"
+      "  checks the declared fields and codegen emits typed accessors\n"
+      "  for them.\n"
+      "  apply rewrites BASE in place unless -o is given.\n",
+      stderr);
+}
+
+int Fail(const ccc::Status& status) {
+  std::fprintf(stderr, "configcentercompiler: %s\n", status.message().c_str());
+  return 1;
+}
+
+int RunCompile(int argc, char** argv) {
+  ccc::CompileOptions options;
+  bool incremental = false;
+  bool verbose = false;
+  std::string report;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      options.output = argv[++i];
+    } else if (std::strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+      report = argv[++i];
+    } else if (std::strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+      options.base = argv[++i];
+    } else if (std::strcmp(argv[i], "--incremental") == 0) {
+      incremental = true;
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--schema") == 0 && i + 1 < argc) {
+      options.schemas.push_back(argv[++i]);
+    } else if (std::strcmp(argv[i], "--no-compress") == 0) {
+      options.compress = false;
+    } else if (std::strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (argv[i][0] == '-') {
+      Usage();
+      return 2;
+    } else {
+      options.inputs.push_back(argv[i]);
+    }
+  }
+  if (options.output.empty() || options.inputs.empty() ||
+      (incremental && !options.base.empty())) {
+    Usage();
+    return 2;
+  }
+  if (incremental) options.base = options.output;
+  const std::string output = options.output;
+  ccc::Compiler compiler(std::move(options));
+  ccc::Status status = compiler.Run();
+  if (!status.ok()) return Fail(status);
+  const ccc::CompileStats& stats = compiler.stats();
+  if (verbose) {
+    const ccc::StageTimes& t = stats.times;
+    std::fprintf(stderr, "compiled %u namespaces, reused %u%s\n",
+                 stats.namespaces_compiled, stats.namespaces_reused,
+                 stats.base_loaded ? "" : " (no usable base)");
+    if (stats.namespaces_stale > 0) {
+      std::fprintf(stderr, "%u unchanged namespaces recompiled for changed "
+                   "references\n", stats.namespaces_stale);
+    }
+    if (stats.templates > 0) {
+      std::fprintf(stderr, "evaluated %llu templates in %u levels\n",
+                   static_cast<unsigned long long>(stats.templates),
+                   stats.template_levels);
+    }
+    std::fprintf(stderr,
+                 "%.3fs: read %.3f lex %.3f parse %.3f validate %.3f "
+                 "resolve %.3f index %.3f compress %.3f emit %.3f; "
+                 "%llu allocations, %llu bytes\n",
+                 stats.elapsed, t.read, t.lex, t.parse, t.validate,
+                 t.resolve, t.index, t.compress, t.emit,
+                 static_cast<unsigned long long>(stats.allocations),
+                 static_cast<unsigned long long>(stats.bytes_allocated));
+    if (stats.paged_bytes > 0) {
+      std::fprintf(stderr, "paged %llu value bytes into %llu\n",
+                   static_cast<unsigned long long>(stats.paged_bytes),
+                   static_cast<unsigned long long>(stats.page_bytes));
+    }
+  }
+  if (!report.empty()) {
+    status = ccc::WriteCompileReport(report, output, stats);
+    if (!status.ok()) return Fail(status);
+  }
+  return 0;
+}
+
+ccc::CompileDaemon* g_daemon = nullptr;
+
+void StopDaemon(int) {
+  if (g_daemon != nullptr) g_daemon->Stop();
+}
+
+void PrintBatchStats(const ccc::BatchStats& batch) {
+  if (!batch.status.ok()) {
+    std::fprintf(stderr, "batch of %u requests failed: %s\n", batch.requests,
+                 batch.status.message().c_str());
+    return;
+  }
+  const ccc::CompileStats& stats = batch.compile;
+  std::fprintf(stderr,
+               "generation %llu: %u requests for %zu namespaces, queued "
+               "%.3fs; compiled %u namespaces, reused %u, %.3fs\n",
+               static_cast<unsigned long long>(batch.generation),
+               batch.requests, batch.namespaces.size(), batch.queued,
+               stats.namespaces_compiled, stats.namespaces_reused,
+               stats.elapsed);
+}
+
+int RunServe(int argc, char** argv) {
+  ccc::DaemonOptions options;
+  bool verbose = false;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      options.compile.output = argv[++i];
+    } else if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      options.socket_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--quiet") == 0 && i + 1 < argc) {
+      options.quiet_ms = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--max-delay") == 0 && i + 1 < argc) {
+      options.max_delay_ms = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.compile.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--schema") == 0 && i + 1 < argc) {
+      options.compile.schemas.push_back(argv[++i]);
+    } else if (std::strcmp(argv[i], "--no-compress") == 0) {
+      options.compile.compress = false;
+    } else if (std::strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (argv[i][0] == '-') {
+      Usage();
+      return 2;
+    } else {
+      options.compile.inputs.push_back(argv[i]);
+    }
+  }
+  if (options.socket_path.empty() || options.compile.output.empty() ||
+      options.compile.inputs.empty()) {
+    Usage();
+    return 2;
+  }
+  ccc::CompileDaemon daemon(std::move(options));
+  if (verbose) daemon.set_batch_callback(PrintBatchStats);
+  g_daemon = &daemon;
+  std::signal(SIGINT, StopDaemon);
+  std::signal(SIGTERM, StopDaemon);
+  ccc::Status status = daemon.Serve();
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  g_daemon = nullptr;
+  if (!status.ok()) return Fail(status);
+  return 0;
+}
+
+// Sends `request` to the daemon at `socket_path`; an error reply fails.
+int RunRequest(const char* socket_path, const std::string& request) {
+  std::string reply;
+  ccc::Status status = ccc::SendDaemonRequest(socket_path, request, &reply);
+  if (!status.ok()) return Fail(status);
+  if (reply.compare(0, 3, "ok ") != 0) {
+    std::fprintf(stderr, "configcentercompiler: %s\n", reply.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+int RunPublish(int argc, char** argv) {
+  if (argc < 1 || argv[0][0] == '-') {
+    Usage();
+    return 2;
+  }
+  std::string request = "publish";
+  for (int i = 1; i < argc; ++i) {
+    request += ' ';
+    request += argv[i];
+  }
+  return RunRequest(argv[0], request);
+}
+
+int RunShutdown(int argc, char** argv) {
+  if (argc != 1) {
+    Usage();
+    return 2;
+  }
+  return RunRequest(argv[0], "shutdown");
+}
+
+int RunCodegen(int argc, char** argv) {
+  ccc::CodegenOptions options;
+  std::vector<std::string> inputs;
+  for (int i = 0; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      options.output = argv[++i];
+    } else if (std::strcmp(argv[i], "--namespace") == 0 && i + 1 < argc) {
+      options.cpp_namespace = argv[++i];
+    } else if (std::strcmp(argv[i], "--class") == 0 && i + 1 < argc) {
+      options.class_name = argv[++i];
+    } else if (argv[i][0] == '-') {
+      Usage();
+      return 2;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (options.output.empty() || inputs.empty()) {
+    Usage();
+    return 2;
+  }
+  ccc::Schema schema;
+  ccc::Status status = ccc::LoadSchema(inputs, &schema);
+  if (status.ok()) status = ccc::GenerateAccessors(schema, options);
+  if (!status.ok()) return Fail(status);
+  return 0;
+}
+
+void PrintDeltaStats(const char* verb, const ccc::DeltaStats& stats) {
+  std::fprintf(stderr,
+               "%s delta of %llu bytes: %u namespaces copied, %u patched; "
+               "%llu entries kept, %llu added, %llu removed\n",
+               verb, static_cast<unsigned long long>(stats.delta_size),
+               stats.namespaces_copied, stats.namespaces_patched,
+               static_cast<unsigned long long>(stats.entries_kept),
+               static_cast<unsigned long long>(stats.entries_added),
+               static_cast<unsigned long long>(stats.entries_removed));
+}
+
+// Splits argv into positional arguments and the -o / -v flags.
+bool ParseDeltaArgs(int argc, char** argv, std::vector<std::string>* args,
+                    std::string* output, bool* verbose) {
+  for (int i = 0; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      *output = argv[++i];
+    } else if (std::strcmp(argv[i], "-v") == 0) {
+      *verbose = true;
+    } else if (argv[i][0] == '-') {
+      return false;
+    } else {
+      args->push_back(argv[i]);
+    }
+  }
+  return args->size() == 2;
+}
+
+int RunDelta(int argc, char** argv) {
+  std::vector<std::string> args;
+  std::string output;
+  bool verbose = false;
+  if (!ParseDeltaArgs(argc, argv, &args, &output, &verbose) ||
+      output.empty()) {
+    Usage();
+    return 2;
+  }
+  ccc::Snapshot base;
+  ccc::Snapshot target;
+  ccc::Status status = ccc::Snapshot::Open(args[0], &base);
+  if (status.ok()) status = ccc::Snapshot::Open(args[1], &target);
+  ccc::DeltaStats stats;
+  if (status.ok()) status = ccc::MakeDelta(base, target, output, &stats);
+  if (!status.ok()) return Fail(status);
+  if (verbose) PrintDeltaStats("wrote", stats);
+  return 0;
+}
+
+int RunApply(int argc, char** argv) {
+  std::vector<std::string> args;
+  std::string output;
+  bool verbose = false;
+  if (!ParseDeltaArgs(argc, argv, &args, &output, &verbose)) {
+    Usage();
+    return 2;
+  }
+  if (output.empty()) output = args[0];
+  ccc::Snapshot base;
+  ccc::Status status = ccc::Snapshot::Open(args[0], &base);
+  ccc::DeltaStats stats;
+  if (status.ok()) status = ccc::ApplyDelta(base, args[1], output, &stats);
+  if (!status.ok()) return Fail(status);
+  if (verbose) PrintDeltaStats("applied", stats);
+  return 0;
+}
+
+int RunGet(int argc, char** argv) {
+  if (argc != 3) {
+    Usage();
+    return 2;
+  }
+  ccc::Snapshot snap;
+  ccc::Status status = ccc::Snapshot::Open(argv[0], &snap);
+  if (!status.ok()) return Fail(status);
+  ccc::ValueRef value = snap.Find(argv[1], argv[2]);
+  if (!value) {
+    std::fprintf(stderr, "configcentercompiler: %s/%s not found\n", argv[1],
+                 argv[2]);
+    return 1;
+  }
+  std::string text = value.ToString();
+  std::fwrite(text.data(), 1, text.size(), stdout);
+  std::fputc('\n', stdout);
+  return 0;
+}
+
+int RunDump(int argc, char** argv) {
+  if (argc != 1) {
+    Usage();
+    return 2;
+  }
+  ccc::Snapshot snap;
+  ccc::Status status = ccc::Snapshot::Open(argv[0], &snap);
+  if (!status.ok()) return Fail(status);
+  for (uint32_t n = 0; n < snap.namespace_count(); ++n) {
+    const ccc::NamespaceRecord& ns = snap.namespace_at(n);
+    std::string_view name = snap.namespace_name(ns);
+    for (uint32_t i = 0; i < ns.entry_count; ++i) {
+      const ccc::EntryRecord& rec = snap.entry_at(ns.first_entry + i);
+      std::string_view key = snap.key(ns, rec);
+      ccc::ValueRef value = snap.value(ns, rec);
+      if (!value) {
+        return Fail(ccc::Status::Corrupt(
+            std::string(argv[0]) + ": cannot decompress value of " +
+            std::string(name) + "/" + std::string(key)));
+      }
+      std::string text = value.ToString();
+      std::printf("%.*s/%.*s (%s) = %.*s\n", static_cast<int>(name.size()),
+                  name.data(), static_cast<int>(key.size()), key.data(),
+                  ccc::ValueTypeName(value.type()),
+                  static_cast<int>(text.size()), text.data());
+    }
+  }
+  return 0;
+}
+
+int RunVerify(int argc, char** argv) {
+  if (argc != 1) {
+    Usage();
+    return 2;
+  }
+  ccc::Snapshot snap;
+  ccc::Status status = ccc::Snapshot::Open(argv[0], &snap);
+  if (status.ok()) status = snap.Verify();
+  if (!status.ok()) return Fail(status);
+  std::printf("%s: ok, %u namespaces, %u entries, %u schema fields\n",
+              argv[0], snap.namespace_count(), snap.entry_count(),
+              snap.schema_field_count());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    Usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  if (command == "compile") return RunCompile(argc - 2, argv + 2);
+  if (command == "serve") return RunServe(argc - 2, argv + 2);
+  if (command == "publish") return RunPublish(argc - 2, argv + 2);
+  if (command == "shutdown") return RunShutdown(argc - 2, argv + 2);
+  if (command == "codegen") return RunCodegen(argc - 2, argv + 2);
+  if (command == "delta") return RunDelta(argc - 2, argv + 2);
+  if (command == "apply") return RunApply(argc - 2, argv + 2);
+  if (command == "get") return RunGet(argc - 2, argv + 2);
+  if (command == "dump") return RunDump(argc - 2, argv + 2);
+  if (command == "verify") return RunVerify(argc - 2, argv + 2);
+  Usage();
+  return 2;
+}
@@ -0,0 +1,66 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace ccc {
+
+MappedFile::~MappedFile() { Reset(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : addr_(std::exchange(other.addr_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    addr_ = std::exchange(other.addr_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+void MappedFile::Reset() {
+  if (addr_ != nullptr) munmap(addr_, size_);
+  addr_ = nullptr;
+  size_ = 0;
+}
+
+Status MappedFile::Open(const std::string& path, MappedFile* out,
+                        Access access) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::IoError("open " + path + ": " + std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return Status::IoError("stat " + path + ": " + std::strerror(err));
+  }
+  out->Reset();
+  if (st.st_size == 0) {
+    close(fd);
+    return Status::Ok();
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return Status::IoError("mmap " + path + ": " + std::strerror(err));
+  }
+  madvise(addr, size,
+          access == Access::kSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  out->addr_ = addr;
+  out->size_ = size;
+  return Status::Ok();
+}
+
+}  // namespace ccc
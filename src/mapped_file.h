@@ -0,0 +1,47 @@
+// Read-only memory mapping of an input file: snapshots, deltas and schemas.
+// Views into the data are valid while the MappedFile lives, and only as
+// long as nobody rewrites the file in place.
+
+#ifndef CCC_MAPPED_FILE_H_
+#define CCC_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "status.h"
+
+namespace ccc {
+
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Expected access pattern, passed to the kernel as a readahead hint.
+  enum class Access { kSequential, kRandom };
+
+  // Maps `path` read-only. An empty file yields an empty, valid mapping.
+  static Status Open(const std::string& path, MappedFile* out,
+                     Access access = Access::kSequential);
+
+  std::string_view data() const {
+    return std::string_view(static_cast<const char*>(addr_), size_);
+  }
+  size_t size() const { return size_; }
+
+ private:
+  void Reset();
+
+  void* addr_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_MAPPED_FILE_H_
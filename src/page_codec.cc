@@ -0,0 +1,144 @@
+#include "page_codec.h"
+
+#if CCC_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace ccc {
+
+#if CCC_HAVE_ZSTD
+
+namespace {
+
+// Decompression is paid once per page per process, while pages are
+// compressed once per compile; a high level is worth it.
+constexpr int kCompressionLevel = 12;
+
+// One decompression context per thread, reused for every page.
+class ThreadDecompressor {
+ public:
+  ThreadDecompressor() : dctx_(ZSTD_createDCtx()) {}
+  ~ThreadDecompressor() { ZSTD_freeDCtx(dctx_); }
+
+  ZSTD_DCtx* get() const { return dctx_; }
+
+ private:
+  ZSTD_DCtx* dctx_;
+};
+
+}  // namespace
+
+struct PageCompressor::State {
+  ZSTD_CCtx* cctx = nullptr;
+  ZSTD_CDict* cdict = nullptr;
+};
+
+bool PageCodecAvailable() { return true; }
+
+void TrainPageDictionary(std::string_view data,
+                         const std::pmr::vector<size_t>& samples,
+                         size_t capacity, std::pmr::string* dictionary) {
+  dictionary->resize(capacity);
+  size_t n = ZDICT_trainFromBuffer(dictionary->data(), dictionary->size(),
+                                   data.data(), samples.data(),
+                                   static_cast<unsigned>(samples.size()));
+  dictionary->resize(ZDICT_isError(n) ? 0 : n);
+}
+
+PageCompressor::PageCompressor(std::string_view dictionary)
+    : state_(new State) {
+  state_->cctx = ZSTD_createCCtx();
+  if (!dictionary.empty()) {
+    state_->cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(),
+                                     kCompressionLevel);
+  }
+  // Page sizes are in the page table; frames need not repeat them.
+  ZSTD_CCtx_setParameter(state_->cctx, ZSTD_c_compressionLevel,
+                         kCompressionLevel);
+  ZSTD_CCtx_setParameter(state_->cctx, ZSTD_c_contentSizeFlag, 0);
+  ZSTD_CCtx_setParameter(state_->cctx, ZSTD_c_dictIDFlag, 0);
+  if (state_->cdict != nullptr) {
+    ZSTD_CCtx_refCDict(state_->cctx, state_->cdict);
+  }
+}
+
+PageCompressor::~PageCompressor() {
+  ZSTD_freeCDict(state_->cdict);
+  ZSTD_freeCCtx(state_->cctx);
+  delete state_;
+}
+
+bool PageCompressor::Compress(std::string_view page, std::pmr::string* out) {
+  if (state_->cctx == nullptr) return false;
+  out->resize(ZSTD_compressBound(page.size()));
+  size_t n = ZSTD_compress2(state_->cctx, out->data(), out->size(),
+                            page.data(), page.size());
+  if (ZSTD_isError(n)) return false;
+  out->resize(n);
+  return true;
+}
+
+struct PageDictionary::State {
+  ZSTD_DDict* ddict = nullptr;  // Null for an empty dictionary.
+};
+
+PageDictionary::PageDictionary(std::string_view dictionary)
+    : state_(new State) {
+  if (!dictionary.empty()) {
+    state_->ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+  }
+}
+
+PageDictionary::~PageDictionary() {
+  ZSTD_freeDDict(state_->ddict);
+  delete state_;
+}
+
+bool DecompressPage(std::string_view compressed,
+                    const PageDictionary& dictionary, char* out,
+                    size_t raw_size) {
+  thread_local ThreadDecompressor dctx;
+  if (dctx.get() == nullptr) return false;
+  const ZSTD_DDict* ddict = dictionary.state_->ddict;
+  size_t n = ddict != nullptr
+                 ? ZSTD_decompress_usingDDict(dctx.get(), out, raw_size,
+                                              compressed.data(),
+                                              compressed.size(), ddict)
+                 : ZSTD_decompressDCtx(dctx.get(), out, raw_size,
+                                       compressed.data(), compressed.size());
+  return !ZSTD_isError(n) && n == raw_size;
+}
+
+#else  // !CCC_HAVE_ZSTD
+
+struct PageCompressor::State {};
+
+bool PageCodecAvailable() { return false; }
+
+void TrainPageDictionary(std::string_view, const std::pmr::vector<size_t>&,
+                         size_t, std::pmr::string* dictionary) {
+  dictionary->clear();
+}
+
+PageCompressor::PageCompressor(std::string_view) : state_(nullptr) {}
+
+PageCompressor::~PageCompressor() = default;
+
+bool PageCompressor::Compress(std::string_view, std::pmr::string*) {
+  return false;
+}
+
+struct PageDictionary::State {};
+
+PageDictionary::PageDictionary(std::string_view) : state_(nullptr) {}
+
+PageDictionary::~PageDictionary() = default;
+
+bool DecompressPage(std::string_view, const PageDictionary&, char*, size_t) {
+  return false;
+}
+
+#endif  // CCC_HAVE_ZSTD
+
+}  // namespace ccc
@@ -0,0 +1,75 @@
+// Dictionary compression for value pages (see snapshot_format.h), backed
+// by zstd when the build found it (CCC_HAVE_ZSTD). Without it compilation
+// stores every value uncompressed and snapshots with compressed pages
+// cannot be opened.
+
+#ifndef CCC_PAGE_CODEC_H_
+#define CCC_PAGE_CODEC_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ccc {
+
+// Whether this build can compress and decompress value pages.
+bool PageCodecAvailable();
+
+// Trains a dictionary of at most `capacity` bytes on samples of the given
+// sizes, which are stored back to back in `data`, into `*dictionary`.
+// Leaves it empty if there is too little material to train on.
+void TrainPageDictionary(std::string_view data,
+                         const std::pmr::vector<size_t>& samples,
+                         size_t capacity, std::pmr::string* dictionary);
+
+// Compresses pages against one dictionary. The output depends only on the
+// input, the dictionary and the zstd version.
+class PageCompressor {
+ public:
+  explicit PageCompressor(std::string_view dictionary);
+  ~PageCompressor();
+
+  PageCompressor(const PageCompressor&) = delete;
+  PageCompressor& operator=(const PageCompressor&) = delete;
+
+  // Replaces `*out` with the compressed `page`. Returns false on failure.
+  bool Compress(std::string_view page, std::pmr::string* out);
+
+ private:
+  struct State;
+  State* state_;
+};
+
+// A dictionary digested for decompression. Digesting costs more than
+// decompressing a page with the result, so readers prepare each
+// namespace's dictionary once and share it between threads.
+class PageDictionary {
+ public:
+  // Copies `dictionary`, which may be empty.
+  explicit PageDictionary(std::string_view dictionary);
+  ~PageDictionary();
+
+  PageDictionary(const PageDictionary&) = delete;
+  PageDictionary& operator=(const PageDictionary&) = delete;
+
+ private:
+  friend bool DecompressPage(std::string_view compressed,
+                             const PageDictionary& dictionary, char* out,
+                             size_t raw_size);
+
+  struct State;
+  State* state_;
+};
+
+// Decompresses `compressed` with `dictionary` into `out`, which must hold
+// exactly `raw_size` bytes. Returns false unless the page decompresses to
+// exactly that size. Thread-safe.
+bool DecompressPage(std::string_view compressed,
+                    const PageDictionary& dictionary, char* out,
+                    size_t raw_size);
+
+}  // namespace ccc
+
+#endif  // CCC_PAGE_CODEC_H_
@@ -0,0 +1,183 @@
+#include "parser.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "lexer.h"
+#include "simd.h"
+
+namespace ccc {
+
+const char* ValueTypeName(ValueType type) {
+  switch (type) {
+    case ValueType::kString: return "string";
+    case ValueType::kInt: return "int";
+    case ValueType::kDouble: return "double";
+    case ValueType::kBool: return "bool";
+  }
+  return "unknown";
+}
+
+namespace {
+
+size_t CountLines(std::string_view text) {
+  return ActiveSimdKernels().count_newlines(text.data(), text.size()) + 1;
+}
+
+Status SyntaxError(std::string_view origin, uint32_t line,
+                   std::string_view message) {
+  std::string msg(origin);
+  msg += ':';
+  msg += std::to_string(line);
+  msg += ": ";
+  msg += message;
+  return Status::ParseError(std::move(msg));
+}
+
+// Adds the time since the previous lap to `*phase`, if timing.
+class LapTimer {
+ public:
+  explicit LapTimer(bool enabled)
+      : enabled_(enabled),
+        last_(enabled ? std::chrono::steady_clock::now()
+                      : std::chrono::steady_clock::time_point()) {}
+
+  void Lap(double* phase) {
+    if (!enabled_) return;
+    auto now = std::chrono::steady_clock::now();
+    *phase += std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+  }
+
+ private:
+  bool enabled_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+}  // namespace
+
+ValueType ClassifyRaw(std::string_view text) {
+  if (text == "true" || text == "false") return ValueType::kBool;
+  if (text.empty()) return ValueType::kString;
+
+  // from_chars accepts "inf"/"nan" and friends; only plain decimal literals
+  // are numbers here.
+  size_t digits_at = text[0] == '-' ? 1 : 0;
+  if (digits_at >= text.size() || text[digits_at] < '0' ||
+      text[digits_at] > '9') {
+    return ValueType::kString;
+  }
+  const char* first = text.data();
+  const char* last = first + text.size();
+
+  int64_t i;
+  auto ir = std::from_chars(first, last, i);
+  if (ir.ec == std::errc() && ir.ptr == last) return ValueType::kInt;
+  // An integer literal that overflows stays a string rather than silently
+  // losing precision as a double.
+  if (text.find_first_of(".eE") == std::string_view::npos) {
+    return ValueType::kString;
+  }
+  double d;
+  auto dr = std::from_chars(first, last, d);
+  if (dr.ec == std::errc() && dr.ptr == last) return ValueType::kDouble;
+  return ValueType::kString;
+}
+
+Status ParseSource(std::string_view source, std::string_view origin,
+                   std::pmr::vector<Entry>* entries, ParseTimes* times) {
+  ParseTimes ignored;
+  if (times == nullptr) times = &ignored;
+  LapTimer timer(times != &ignored);
+  entries->clear();
+  // Validating the whole file once up front lets the lexer treat bytes
+  // >= 0x80 as opaque, and keeps every decoded string valid UTF-8.
+  if (!IsValidUtf8(source)) {
+    size_t offset = Utf8ErrorOffset(source);
+    return SyntaxError(
+        origin, static_cast<uint32_t>(CountLines(source.substr(0, offset))),
+        "invalid UTF-8");
+  }
+  timer.Lap(&times->validate);
+  entries->reserve(CountLines(source));
+
+  Lexer lexer(source);
+  for (;;) {
+    Token tok = lexer.Next();
+    if (tok.kind == TokenKind::kNewline) continue;
+    if (tok.kind == TokenKind::kEnd) break;
+    if (tok.kind == TokenKind::kError) {
+      return SyntaxError(origin, tok.line, tok.error);
+    }
+    if (tok.kind != TokenKind::kKey) {
+      return SyntaxError(origin, tok.line, "expected key");
+    }
+
+    Entry entry;
+    entry.key = tok.text;
+    entry.line = tok.line;
+
+    tok = lexer.Next();
+    if (tok.kind == TokenKind::kError) {
+      return SyntaxError(origin, tok.line, tok.error);
+    }
+    if (tok.kind != TokenKind::kAssign) {
+      return SyntaxError(origin, tok.line, "expected '=' after key");
+    }
+    tok = lexer.Next();
+    if (tok.kind == TokenKind::kError) {
+      return SyntaxError(origin, tok.line, tok.error);
+    }
+    if (tok.kind != TokenKind::kString && tok.kind != TokenKind::kRaw) {
+      return SyntaxError(origin, tok.line, "expected value");
+    }
+    entry.value = tok.text;
+    if (entry.value.find("${") != std::string_view::npos) {
+      entry.flags |= kEntryTemplate;
+    }
+    if (tok.kind == TokenKind::kString) {
+      if (tok.has_escapes) entry.flags |= kEntryEscaped;
+    } else {
+      entry.flags |= kEntryRaw;
+    }
+
+    tok = lexer.Next();
+    if (tok.kind == TokenKind::kError) {
+      return SyntaxError(origin, tok.line, tok.error);
+    }
+    entries->push_back(entry);
+  }
+  timer.Lap(&times->lex);
+
+  for (Entry& entry : *entries) {
+    // Templates are typed once their references are resolved.
+    if ((entry.flags & (kEntryRaw | kEntryTemplate)) == kEntryRaw) {
+      entry.type = ClassifyRaw(entry.value);
+      entry.flags &= ~kEntryRaw;
+    }
+  }
+  std::sort(entries->begin(), entries->end(),
+            [](const Entry& a, const Entry& b) {
+              return a.key < b.key || (a.key == b.key && a.line < b.line);
+            });
+  timer.Lap(&times->parse);
+  auto dup = std::adjacent_find(entries->begin(), entries->end(),
+                                [](const Entry& a, const Entry& b) {
+                                  return a.key == b.key;
+                                });
+  if (dup != entries->end()) {
+    std::string msg = "duplicate key '";
+    msg.append(dup->key);
+    msg += "' (first defined on line ";
+    msg += std::to_string(dup->line);
+    msg += ')';
+    return SyntaxError(origin, (dup + 1)->line, msg);
+  }
+  timer.Lap(&times->validate);
+  return Status::Ok();
+}
+
+}  // namespace ccc
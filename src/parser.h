@@ -0,0 +1,42 @@
+// Turns a token stream into the namespace IR. The parser performs no per-key
+// heap allocation: entries are views into the source and the entry vector
+// is sized up front from a line count.
+
+#ifndef CCC_PARSER_H_
+#define CCC_PARSER_H_
+
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "ir.h"
+#include "status.h"
+
+namespace ccc {
+
+// Infers the type of an unquoted value: `true`/`false` are bools, decimal
+// integers that fit in int64 are ints, decimal numbers with a fraction or
+// exponent are doubles, and anything else is a string.
+ValueType ClassifyRaw(std::string_view text);
+
+// Seconds ParseSource() spends in each of its phases: checking UTF-8 and
+// duplicate keys (validate), tokenizing into raw key/value entries (lex),
+// and typing raw values and ordering the entries by key (parse).
+struct ParseTimes {
+  double validate = 0;
+  double lex = 0;
+  double parse = 0;
+};
+
+// Parses `source` into `entries`, sorted by key. `origin` prefixes error
+// messages (usually the file path). Duplicate keys are an error. Values
+// containing `${` are flagged kEntryTemplate and left untyped for
+// ReferenceResolver. If `times` is given, the phase timings are added to
+// it.
+Status ParseSource(std::string_view source, std::string_view origin,
+                   std::pmr::vector<Entry>* entries,
+                   ParseTimes* times = nullptr);
+
+}  // namespace ccc
+
+#endif  // CCC_PARSER_H_
@@ -0,0 +1,100 @@
+#include "perfect_hash.h"
+
+#include <algorithm>
+
+namespace ccc {
+
+namespace {
+
+// Upper bound on displacements tried for one bucket before giving up.
+constexpr uint32_t kMaxDisplacement = 1u << 20;
+
+}  // namespace
+
+bool BuildPerfectHash(const std::pmr::vector<uint64_t>& hashes,
+                      std::pmr::vector<uint32_t>* displacements,
+                      std::pmr::vector<uint32_t>* slots) {
+  const uint32_t n = static_cast<uint32_t>(hashes.size());
+  const uint32_t buckets = PerfectHashBuckets(n);
+  displacements->assign(buckets, 0);
+  slots->assign(n, 0);
+  if (n == 0) return true;
+  std::pmr::memory_resource* scratch =
+      displacements->get_allocator().resource();
+
+  // Counting sort of key indices by bucket.
+  std::pmr::vector<uint32_t> start(buckets + 1, 0, scratch);
+  for (uint64_t h : hashes) ++start[PerfectHashBucket(h, buckets) + 1];
+  for (uint32_t b = 0; b < buckets; ++b) start[b + 1] += start[b];
+  std::pmr::vector<uint32_t> members(n, scratch);
+  {
+    std::pmr::vector<uint32_t> fill(start.begin(), start.end() - 1, scratch);
+    for (uint32_t i = 0; i < n; ++i) {
+      members[fill[PerfectHashBucket(hashes[i], buckets)]++] = i;
+    }
+  }
+
+  // Largest buckets first, while the table is emptiest.
+  std::pmr::vector<uint32_t> order(scratch);
+  order.reserve(buckets);
+  for (uint32_t b = 0; b < buckets; ++b) {
+    if (start[b + 1] - start[b] >= 2) order.push_back(b);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return start[a + 1] - start[a] > start[b + 1] - start[b];
+  });
+
+  std::pmr::vector<bool> taken(n, false, scratch);
+  // `stamp[s] == attempt` marks slots claimed by the current attempt, so
+  // collisions inside a bucket need no clearing between attempts.
+  std::pmr::vector<uint32_t> stamp(n, 0, scratch);
+  uint32_t attempt = 0;
+  std::pmr::vector<uint32_t> placed(scratch);
+
+  for (uint32_t b : order) {
+    const uint32_t* first = members.data() + start[b];
+    const uint32_t size = start[b + 1] - start[b];
+    // Keys with equal hashes can never be separated by a displacement.
+    for (uint32_t i = 0; i < size; ++i) {
+      for (uint32_t j = i + 1; j < size; ++j) {
+        if (hashes[first[i]] == hashes[first[j]]) return false;
+      }
+    }
+    bool done = false;
+    for (uint32_t d = 0; d < kMaxDisplacement && !done; ++d) {
+      ++attempt;
+      placed.clear();
+      done = true;
+      for (uint32_t k = 0; k < size; ++k) {
+        uint32_t s = PerfectHashDisplace(hashes[first[k]], d, n);
+        if (taken[s] || stamp[s] == attempt) {
+          done = false;
+          break;
+        }
+        stamp[s] = attempt;
+        placed.push_back(s);
+      }
+      if (done) {
+        (*displacements)[b] = d;
+        for (uint32_t k = 0; k < size; ++k) {
+          taken[placed[k]] = true;
+          (*slots)[placed[k]] = first[k];
+        }
+      }
+    }
+    if (!done) return false;
+  }
+
+  // Singleton buckets take the remaining slots in order.
+  uint32_t free_slot = 0;
+  for (uint32_t b = 0; b < buckets; ++b) {
+    if (start[b + 1] - start[b] != 1) continue;
+    while (taken[free_slot]) ++free_slot;
+    taken[free_slot] = true;
+    (*displacements)[b] = kDirectSlot | free_slot;
+    (*slots)[free_slot] = members[start[b]];
+  }
+  return true;
+}
+
+}  // namespace ccc
@@ -0,0 +1,95 @@
+// Minimal perfect hashing by hash-and-displace.
+//
+// Keys are pre-hashed to 64 bits. The high half picks one of `buckets`
+// buckets; each bucket stores a 32-bit displacement that, mixed with the
+// key hash, gives the key's slot in [0, n). Buckets holding a single key
+// store the slot directly (tagged with the high bit) instead, which lets
+// the builder finish the last, most crowded part of the table without
+// searching. A lookup is therefore one displacement load and one slot
+// computation, and always lands on a slot; callers confirm the hit with a
+// single key comparison.
+
+#ifndef CCC_PERFECT_HASH_H_
+#define CCC_PERFECT_HASH_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "hash.h"
+
+namespace ccc {
+
+inline constexpr uint32_t kDirectSlot = 0x80000000u;
+
+// Number of buckets used for `n` keys (about three keys per bucket).
+inline uint32_t PerfectHashBuckets(uint32_t n) {
+  return n == 0 ? 0 : (n + 2) / 3;
+}
+
+inline uint32_t PerfectHashBucket(uint64_t hash, uint32_t buckets) {
+  return static_cast<uint32_t>(((hash >> 32) * buckets) >> 32);
+}
+
+inline uint32_t PerfectHashDisplace(uint64_t hash, uint32_t displacement,
+                                    uint32_t n) {
+  uint64_t x = hash ^ (uint64_t{displacement} * 0x9E3779B97F4A7C15ULL);
+  x ^= x >> 31;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 29;
+  return static_cast<uint32_t>(((x & 0xFFFFFFFFu) * n) >> 32);
+}
+
+// Maps `hash` to its slot in [0, n). `n` must be non-zero.
+inline uint32_t PerfectHashSlot(uint64_t hash, const uint32_t* displacements,
+                                uint32_t buckets, uint32_t n) {
+  uint32_t d = displacements[PerfectHashBucket(hash, buckets)];
+  if (d & kDirectSlot) return d & ~kDirectSlot;
+  return PerfectHashDisplace(hash, d, n);
+}
+
+// Builds a perfect hash over `hashes`. On success, `displacements` holds
+// PerfectHashBuckets(n) words and `slots[s]` is the index into `hashes` of
+// the key that maps to slot s. Fails only if two hashes are equal or the
+// displacement search gives up, in which case the caller rehashes the keys
+// with another seed. The result depends only on the input. Scratch space
+// comes from the memory resource of `displacements`.
+bool BuildPerfectHash(const std::pmr::vector<uint64_t>& hashes,
+                      std::pmr::vector<uint32_t>* displacements,
+                      std::pmr::vector<uint32_t>* slots);
+
+// A perfect hash table over string keys hashed with Hash64(key, seed).
+struct IndexTable {
+  IndexTable() = default;
+  explicit IndexTable(std::pmr::memory_resource* memory)
+      : displacements(memory), slots(memory) {}
+
+  uint32_t seed = 0;
+  std::pmr::vector<uint32_t> displacements;
+  std::pmr::vector<uint32_t> slots;
+};
+
+// Seeds tried before giving up on a table. A failure at one seed is
+// already vanishingly rare.
+inline constexpr uint32_t kMaxIndexSeeds = 64;
+
+// Builds an IndexTable over n keys, where key_at(i) returns key i, trying
+// seeds in order. `hashes` is scratch space. Returns false if every seed
+// failed.
+template <typename KeyAt>
+bool BuildIndexTable(uint32_t n, KeyAt key_at,
+                     std::pmr::vector<uint64_t>* hashes, IndexTable* out) {
+  hashes->resize(n);
+  for (uint32_t seed = 0; seed < kMaxIndexSeeds; ++seed) {
+    for (uint32_t i = 0; i < n; ++i) (*hashes)[i] = Hash64(key_at(i), seed);
+    if (BuildPerfectHash(*hashes, &out->displacements, &out->slots)) {
+      out->seed = seed;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace ccc
+
+#endif  // CCC_PERFECT_HASH_H_
@@ -0,0 +1,425 @@
+#include "references.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string>
+
+#include "emitter.h"
+#include "escape.h"
+#include "lexer.h"
+#include "parser.h"
+#include "snapshot.h"
+
+namespace ccc {
+
+namespace {
+
+// Templates per pool task; evaluating one is usually a few copies.
+constexpr size_t kNodesPerTask = 256;
+
+bool IsKey(std::string_view text) {
+  return !text.empty() && std::all_of(text.begin(), text.end(), IsKeyChar);
+}
+
+// `key` or `namespace/key`.
+bool IsValidReference(std::string_view ref) {
+  size_t slash = ref.find('/');
+  if (slash == std::string_view::npos) return IsKey(ref);
+  return IsKey(ref.substr(0, slash)) && IsKey(ref.substr(slash + 1));
+}
+
+}  // namespace
+
+ReferenceResolver::ReferenceResolver(
+    std::pmr::vector<NamespaceIr>* namespaces, ThreadPool* pool)
+    : namespaces_(*namespaces),
+      pool_(pool),
+      arena_(namespaces->get_allocator().resource()) {}
+
+Status ReferenceResolver::Evaluate() {
+  nodes_.clear();
+  pieces_.clear();
+  levels_ = 0;
+  first_node_.assign(namespaces_.size() + 1, 0);
+  external_.assign(namespaces_.size(), {});
+  for (uint32_t n = 0; n < namespaces_.size(); ++n) {
+    first_node_[n] = static_cast<uint32_t>(nodes_.size());
+    const NamespaceIr& ns = namespaces_[n];
+    if (ns.base != nullptr) continue;
+    for (uint32_t i = 0; i < ns.entries.size(); ++i) {
+      if (!(ns.entries[i].flags & kEntryTemplate)) continue;
+      Node& node = nodes_.emplace_back();
+      node.ns = n;
+      node.entry = i;
+    }
+  }
+  first_node_[namespaces_.size()] = static_cast<uint32_t>(nodes_.size());
+  if (nodes_.empty()) return Status::Ok();
+  for (uint32_t u = 0; u < nodes_.size(); ++u) {
+    CCC_RETURN_IF_ERROR(AddPieces(&nodes_[u]));
+  }
+
+  // Order the whole graph before evaluating any of it, so a cycle is
+  // reported up front. Kahn's algorithm also yields the levels: every
+  // template's dependencies are in earlier levels.
+  const uint32_t count = static_cast<uint32_t>(nodes_.size());
+  std::vector<uint32_t> indegree(count, 0);
+  std::vector<uint32_t> first_dependent(count + 1, 0);
+  for (uint32_t u = 0; u < count; ++u) {
+    for (uint32_t p = 0; p < nodes_[u].piece_count; ++p) {
+      uint32_t dep = pieces_[nodes_[u].first_piece + p].node;
+      if (dep == kNoNode) continue;
+      ++indegree[u];
+      ++first_dependent[dep + 1];
+    }
+  }
+  for (uint32_t u = 0; u < count; ++u) {
+    first_dependent[u + 1] += first_dependent[u];
+  }
+  std::vector<uint32_t> dependents(first_dependent[count]);
+  std::vector<uint32_t> fill(first_dependent.begin(),
+                             first_dependent.end() - 1);
+  for (uint32_t u = 0; u < count; ++u) {
+    for (uint32_t p = 0; p < nodes_[u].piece_count; ++p) {
+      uint32_t dep = pieces_[nodes_[u].first_piece + p].node;
+      if (dep != kNoNode) dependents[fill[dep]++] = u;
+    }
+  }
+
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> level_end;
+  order.reserve(count);
+  for (uint32_t u = 0; u < count; ++u) {
+    if (indegree[u] == 0) order.push_back(u);
+  }
+  for (size_t begin = 0; begin < order.size();) {
+    const size_t end = order.size();
+    for (size_t i = begin; i < end; ++i) {
+      const uint32_t u = order[i];
+      for (uint32_t d = first_dependent[u]; d < first_dependent[u + 1];
+           ++d) {
+        if (--indegree[dependents[d]] == 0) order.push_back(dependents[d]);
+      }
+    }
+    level_end.push_back(static_cast<uint32_t>(end));
+    begin = end;
+  }
+  if (order.size() < count) {
+    std::vector<uint32_t> pending;
+    for (uint32_t u = 0; u < count; ++u) {
+      if (indegree[u] > 0) pending.push_back(u);
+    }
+    return ReportCycle(pending);
+  }
+
+  levels_ = static_cast<uint32_t>(level_end.size());
+  size_t begin = 0;
+  for (uint32_t end : level_end) {
+    const size_t n = end - begin;
+    auto run = [&](size_t task) {
+      const size_t first = begin + task * kNodesPerTask;
+      const size_t last = std::min<size_t>(first + kNodesPerTask, end);
+      for (size_t i = first; i < last; ++i) EvaluateNode(&nodes_[order[i]]);
+    };
+    const size_t tasks = (n + kNodesPerTask - 1) / kNodesPerTask;
+    if (pool_ != nullptr && tasks > 1) {
+      pool_->ParallelFor(tasks, run);
+    } else {
+      for (size_t t = 0; t < tasks; ++t) run(t);
+    }
+    for (size_t i = begin; i < end; ++i) {
+      const Node& node = nodes_[order[i]];
+      if (node.too_long) {
+        return NodeError(node, "value exceeds " +
+                                   std::to_string(kMaxInterpolatedSize) +
+                                   " bytes after interpolation");
+      }
+    }
+    begin = end;
+  }
+  return Status::Ok();
+}
+
+std::vector<uint32_t> ReferenceResolver::StaleNamespaces() {
+  std::vector<uint32_t> stale;
+  for (uint32_t n = 0; n < namespaces_.size(); ++n) {
+    const NamespaceIr& ns = namespaces_[n];
+    if (ns.base == nullptr) continue;
+    std::string_view refs =
+        ns.base->References(ns.base->namespace_at(ns.base_index));
+    while (!refs.empty()) {
+      size_t eol = std::min(refs.find('\n'), refs.size());
+      std::string_view ref = refs.substr(0, eol);
+      refs.remove_prefix(std::min(eol + 1, refs.size()));
+
+      size_t slash = ref.find('/');
+      int64_t m = FindNamespace(ref.substr(0, slash));
+      if (slash == std::string_view::npos || m < 0) {
+        stale.push_back(n);
+        break;
+      }
+      const NamespaceIr& target = namespaces_[m];
+      if (target.base == ns.base) continue;  // Unchanged too.
+      std::string_view key = ref.substr(slash + 1);
+      int64_t e = FindEntry(static_cast<uint32_t>(m), key);
+      ValueRef old = ns.base->Find(target.name, key);
+      if (e < 0 || !old) {
+        stale.push_back(n);
+        break;
+      }
+      uint32_t node = FindNode(static_cast<uint32_t>(m),
+                               static_cast<uint32_t>(e));
+      std::string_view now = node != kNoNode ? nodes_[node].result
+                                             : Render(target.entries[e]);
+      if (now != old.ToString()) {
+        stale.push_back(n);
+        break;
+      }
+    }
+  }
+  return stale;
+}
+
+void ReferenceResolver::Apply() {
+  for (const Node& node : nodes_) {
+    Entry& entry = namespaces_[node.ns].entries[node.entry];
+    entry.value = node.result;
+    entry.type = node.type;
+    // Scalars keep their (canonical) source text.
+    entry.flags = node.type == ValueType::kString ? kEntryDecoded : 0;
+  }
+  for (uint32_t n = 0; n < namespaces_.size(); ++n) {
+    NamespaceIr& ns = namespaces_[n];
+    if (ns.base != nullptr) continue;
+    std::vector<std::string_view>& refs = external_[n];
+    std::sort(refs.begin(), refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+    ns.refs.clear();
+    for (size_t i = 0; i < refs.size(); ++i) {
+      if (i > 0) ns.refs += '\n';
+      ns.refs.append(refs[i]);
+    }
+  }
+}
+
+Status ReferenceResolver::AddPieces(Node* node) {
+  const Entry& entry = namespaces_[node->ns].entries[node->entry];
+  // Interpolation applies to the decoded string.
+  std::string_view text = entry.value;
+  if ((entry.flags & kEntryEscaped) && !(entry.flags & kEntryDecoded)) {
+    char* out = static_cast<char*>(arena_->allocate(text.size(), 1));
+    text = std::string_view(out, Unescape(text, out));
+  }
+  node->first_piece = static_cast<uint32_t>(pieces_.size());
+  size_t literal = 0;
+  size_t i = 0;
+  while ((i = text.find('$', i)) != std::string_view::npos) {
+    if (text.compare(i, 3, "$${") == 0) {
+      // Keep one '$'; the '{' starts the next literal.
+      pieces_.push_back({text.substr(literal, i + 1 - literal)});
+      literal = i += 2;
+      continue;
+    }
+    if (text.compare(i, 2, "${") != 0) {
+      ++i;
+      continue;
+    }
+    size_t close = text.find('}', i + 2);
+    std::string_view ref = close == std::string_view::npos
+                               ? std::string_view()
+                               : text.substr(i + 2, close - i - 2);
+    if (!IsValidReference(ref)) {
+      return NodeError(*node, "malformed reference (write $${ for a "
+                              "literal ${)");
+    }
+    if (i > literal) pieces_.push_back({text.substr(literal, i - literal)});
+    CCC_RETURN_IF_ERROR(AddReference(*node, ref));
+    literal = i = close + 1;
+  }
+  if (literal < text.size()) pieces_.push_back({text.substr(literal)});
+  node->piece_count =
+      static_cast<uint32_t>(pieces_.size()) - node->first_piece;
+  return Status::Ok();
+}
+
+Status ReferenceResolver::AddReference(const Node& node,
+                                       std::string_view ref) {
+  size_t slash = ref.find('/');
+  uint32_t target_ns = node.ns;
+  std::string_view key = ref;
+  if (slash != std::string_view::npos) {
+    int64_t m = FindNamespace(ref.substr(0, slash));
+    if (m < 0) {
+      return NodeError(node, "undefined reference ${" + std::string(ref) +
+                                 "}");
+    }
+    target_ns = static_cast<uint32_t>(m);
+    key = ref.substr(slash + 1);
+    if (target_ns != node.ns) external_[node.ns].push_back(ref);
+  }
+
+  const NamespaceIr& target = namespaces_[target_ns];
+  if (target.base != nullptr) {
+    ValueRef value = target.base->Find(target.base_index, key);
+    if (!value) {
+      return NodeError(node, "undefined reference ${" + std::string(ref) +
+                                 "}");
+    }
+    pieces_.push_back({Copy(value.ToString())});
+    return Status::Ok();
+  }
+  int64_t e = FindEntry(target_ns, key);
+  if (e < 0) {
+    return NodeError(node, "undefined reference ${" + std::string(ref) +
+                               "}");
+  }
+  uint32_t dep = FindNode(target_ns, static_cast<uint32_t>(e));
+  if (dep != kNoNode) {
+    pieces_.push_back({std::string_view(), dep});
+  } else {
+    pieces_.push_back({Render(target.entries[e])});
+  }
+  return Status::Ok();
+}
+
+uint32_t ReferenceResolver::FindNode(uint32_t ns, uint32_t entry) const {
+  auto begin = nodes_.begin() + first_node_[ns];
+  auto end = nodes_.begin() + first_node_[ns + 1];
+  auto it = std::lower_bound(
+      begin, end, entry,
+      [](const Node& node, uint32_t e) { return node.entry < e; });
+  if (it == end || it->entry != entry) return kNoNode;
+  return static_cast<uint32_t>(it - nodes_.begin());
+}
+
+int64_t ReferenceResolver::FindNamespace(std::string_view name) const {
+  auto it = std::lower_bound(
+      namespaces_.begin(), namespaces_.end(), name,
+      [](const NamespaceIr& ns, std::string_view n) { return ns.name < n; });
+  if (it == namespaces_.end() || it->name != name) return -1;
+  return it - namespaces_.begin();
+}
+
+int64_t ReferenceResolver::FindEntry(uint32_t ns, std::string_view key) const {
+  const std::pmr::vector<Entry>& entries = namespaces_[ns].entries;
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), key,
+      [](const Entry& entry, std::string_view k) { return entry.key < k; });
+  if (it == entries.end() || it->key != key) return -1;
+  return it - entries.begin();
+}
+
+std::string_view ReferenceResolver::Render(const Entry& entry) {
+  char buf[32];
+  switch (entry.type) {
+    case ValueType::kString:
+      if ((entry.flags & kEntryEscaped) && !(entry.flags & kEntryDecoded)) {
+        char* out =
+            static_cast<char*>(arena_->allocate(entry.value.size(), 1));
+        return std::string_view(out, Unescape(entry.value, out));
+      }
+      return entry.value;
+    case ValueType::kInt: {
+      auto r = std::to_chars(buf, buf + sizeof(buf),
+                             static_cast<int64_t>(EncodeInlineValue(entry)));
+      return Copy(std::string_view(buf, r.ptr - buf));
+    }
+    case ValueType::kDouble: {
+      uint64_t bits = EncodeInlineValue(entry);
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      auto r = std::to_chars(buf, buf + sizeof(buf), d);
+      return Copy(std::string_view(buf, r.ptr - buf));
+    }
+    case ValueType::kBool:
+      return EncodeInlineValue(entry) ? "true" : "false";
+  }
+  return std::string_view();
+}
+
+std::string_view ReferenceResolver::Copy(std::string_view text) {
+  char* out = static_cast<char*>(arena_->allocate(text.size(), 1));
+  std::memcpy(out, text.data(), text.size());
+  return std::string_view(out, text.size());
+}
+
+void ReferenceResolver::EvaluateNode(Node* node) {
+  size_t size = 0;
+  for (uint32_t p = 0; p < node->piece_count; ++p) {
+    const Piece& piece = pieces_[node->first_piece + p];
+    size += piece.node != kNoNode ? nodes_[piece.node].result.size()
+                                  : piece.text.size();
+  }
+  if (size > kMaxInterpolatedSize) {
+    node->too_long = true;
+    return;
+  }
+  char* out = static_cast<char*>(arena_->allocate(size, 1));
+  size_t at = 0;
+  for (uint32_t p = 0; p < node->piece_count; ++p) {
+    const Piece& piece = pieces_[node->first_piece + p];
+    std::string_view text =
+        piece.node != kNoNode ? nodes_[piece.node].result : piece.text;
+    std::memcpy(out + at, text.data(), text.size());
+    at += text.size();
+  }
+  std::string_view result(out, size);
+
+  node->type = ValueType::kString;
+  const Entry& entry = namespaces_[node->ns].entries[node->entry];
+  if (entry.flags & kEntryRaw) {
+    node->type = ClassifyRaw(result);
+    // Store scalars in canonical form, the way references render them.
+    if (node->type == ValueType::kInt || node->type == ValueType::kDouble) {
+      Entry typed;
+      typed.value = result;
+      typed.type = node->type;
+      result = Render(typed);
+    }
+  }
+  node->result = result;
+}
+
+Status ReferenceResolver::ReportCycle(
+    const std::vector<uint32_t>& pending) const {
+  std::vector<bool> is_pending(nodes_.size(), false);
+  for (uint32_t u : pending) is_pending[u] = true;
+  // Every pending node waits on another pending node; following those
+  // edges from anywhere must come back around.
+  std::vector<int64_t> position(nodes_.size(), -1);
+  std::vector<uint32_t> path;
+  uint32_t u = pending.front();
+  while (position[u] < 0) {
+    position[u] = static_cast<int64_t>(path.size());
+    path.push_back(u);
+    const Node& node = nodes_[u];
+    for (uint32_t p = 0; p < node.piece_count; ++p) {
+      uint32_t dep = pieces_[node.first_piece + p].node;
+      if (dep != kNoNode && is_pending[dep]) {
+        u = dep;
+        break;
+      }
+    }
+  }
+  std::string message = "reference cycle: ";
+  for (size_t i = static_cast<size_t>(position[u]); i <= path.size(); ++i) {
+    const Node& node = nodes_[i < path.size() ? path[i] : u];
+    const NamespaceIr& ns = namespaces_[node.ns];
+    if (i > static_cast<size_t>(position[u])) message += " -> ";
+    message += ns.name;
+    message += '/';
+    message.append(ns.entries[node.entry].key);
+  }
+  return NodeError(nodes_[u], message);
+}
+
+Status ReferenceResolver::NodeError(const Node& node,
+                                    const std::string& message) const {
+  const NamespaceIr& ns = namespaces_[node.ns];
+  return Status::ParseError(ns.path + ":" +
+                            std::to_string(ns.entries[node.entry].line) +
+                            ": " + message);
+}
+
+}  // namespace ccc
@@ -0,0 +1,112 @@
+// Values may interpolate other keys: `${key}` refers to a key of the same
+// namespace and `${ns/key}` to one of namespace `ns`, and `$${` stands for
+// a literal `${`. A referenced value is rendered as source text (strings
+// decoded, numbers in shortest round-trip form). Quoted values stay
+// strings; raw values are typed after interpolation, so `port = ${p}` is
+// an int if `p` is. The snapshot stores the evaluated values only.
+//
+// The resolver builds a DAG over the values that contain references (the
+// templates), rejects undefined references and cycles before evaluating
+// anything, and then evaluates the templates level by level in
+// topological order, each level in parallel. Only namespaces that are
+// compiled are evaluated; namespaces spliced from a base keep their base
+// values, and each namespace records the keys of other namespaces it
+// references so a later compile can tell whether those values changed.
+
+#ifndef CCC_REFERENCES_H_
+#define CCC_REFERENCES_H_
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "ir.h"
+#include "status.h"
+#include "thread_pool.h"
+
+namespace ccc {
+
+// Evaluated values longer than this are an error, which keeps repeated
+// references from blowing up exponentially.
+inline constexpr size_t kMaxInterpolatedSize = 16 << 20;
+
+class ReferenceResolver {
+ public:
+  // `namespaces` must be sorted by name, with the entries of every
+  // namespace that is not spliced from a base parsed. `pool` may be null.
+  ReferenceResolver(std::pmr::vector<NamespaceIr>* namespaces,
+                    ThreadPool* pool);
+
+  // Evaluates every template of the namespaces that are not spliced from a
+  // base. Fails on a malformed or undefined reference, a cycle or an
+  // oversized value, naming the source line. The entries are not modified,
+  // so this can run again after more namespaces are parsed.
+  Status Evaluate();
+
+  // Namespaces spliced from a base that reference a value that is now
+  // different (or gone), so they must be parsed and evaluated again. Only
+  // valid after a successful Evaluate().
+  std::vector<uint32_t> StaleNamespaces();
+
+  // Stores the evaluated values in their entries, and in each compiled
+  // namespace's `refs` the sorted keys of other namespaces it references.
+  void Apply();
+
+  uint64_t templates() const { return nodes_.size(); }
+  uint32_t levels() const { return levels_; }
+
+ private:
+  static constexpr uint32_t kNoNode = ~uint32_t{0};
+
+  // A run of template text: a literal, the rendered value of a reference
+  // to a plain value, or the result of another template.
+  struct Piece {
+    std::string_view text;
+    uint32_t node = kNoNode;
+  };
+  struct Node {
+    uint32_t ns = 0;
+    uint32_t entry = 0;
+    uint32_t first_piece = 0;
+    uint32_t piece_count = 0;
+    ValueType type = ValueType::kString;
+    bool too_long = false;
+    std::string_view result;
+  };
+
+  // Splits the node's template into pieces.
+  Status AddPieces(Node* node);
+  // Resolves reference `ref` of `node` and appends a piece for it, or
+  // fails if it is undefined.
+  Status AddReference(const Node& node, std::string_view ref);
+  // The template node of entry `entry` of namespace `ns`, or kNoNode.
+  uint32_t FindNode(uint32_t ns, uint32_t entry) const;
+  // Index of namespace `name`, or -1.
+  int64_t FindNamespace(std::string_view name) const;
+  // Index of `key` among the entries of compiled namespace `ns`, or -1.
+  int64_t FindEntry(uint32_t ns, std::string_view key) const;
+  // Source text of a plain entry's value, allocated in the arena if it has
+  // to be decoded or formatted.
+  std::string_view Render(const Entry& entry);
+  std::string_view Copy(std::string_view text);
+  void EvaluateNode(Node* node);
+  Status ReportCycle(const std::vector<uint32_t>& pending) const;
+  Status NodeError(const Node& node, const std::string& message) const;
+
+  std::pmr::vector<NamespaceIr>& namespaces_;
+  ThreadPool* pool_;
+  std::pmr::memory_resource* arena_;
+  std::vector<Node> nodes_;
+  std::vector<Piece> pieces_;
+  // Nodes of namespace n are nodes_[first_node_[n] .. first_node_[n + 1]),
+  // in entry order.
+  std::vector<uint32_t> first_node_;
+  // Keys of other namespaces referenced by each compiled namespace.
+  std::vector<std::vector<std::string_view>> external_;
+  uint32_t levels_ = 0;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_REFERENCES_H_
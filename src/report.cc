@@ -0,0 +1,122 @@
+#include "report.h"
+
+#include <cstdio>
+#include <string_view>
+#include <utility>
+
+#include "file_writer.h"
+#include "simd.h"
+
+namespace ccc {
+
+namespace {
+
+// JSON strings must be UTF-8, and paths need not be: every byte that is
+// not part of a well-formed sequence becomes U+FFFD.
+void AppendString(std::string_view s, std::string* out) {
+  *out += '"';
+  while (!s.empty()) {
+    const size_t valid = Utf8ErrorOffset(s);
+    for (char c : s.substr(0, valid)) {
+      unsigned char u = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        *out += '\\';
+        *out += c;
+      } else if (u < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", u);
+        *out += buf;
+      } else {
+        *out += c;
+      }
+    }
+    if (valid == s.size()) break;
+    *out += "\\ufffd";
+    s.remove_prefix(valid + 1);
+  }
+  *out += '"';
+}
+
+void AppendSeconds(double seconds, std::string* out) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.9g", seconds);
+  *out += buf;
+}
+
+// Namespaces have no resolve or emit stage, so `with_emit` leaves both out
+// for them.
+void AppendStages(const StageTimes& t, bool with_emit, std::string* out) {
+  const std::pair<const char*, double> stages[] = {
+      {"read", t.read},         {"lex", t.lex},
+      {"parse", t.parse},       {"validate", t.validate},
+      {"index", t.index},       {"compress", t.compress},
+      {"resolve", t.resolve},   {"emit", t.emit},
+  };
+  const size_t count = with_emit ? 8 : 6;
+  *out += '{';
+  for (size_t i = 0; i < count; ++i) {
+    if (i > 0) *out += ", ";
+    *out += '"';
+    *out += stages[i].first;
+    *out += "\": ";
+    AppendSeconds(stages[i].second, out);
+  }
+  *out += '}';
+}
+
+}  // namespace
+
+std::string CompileReportJson(const std::string& output,
+                              const CompileStats& stats) {
+  std::string j = "{\n  \"output\": ";
+  AppendString(output, &j);
+  j += ",\n  \"elapsed_seconds\": ";
+  AppendSeconds(stats.elapsed, &j);
+  j += ",\n  \"threads\": " + std::to_string(stats.threads);
+  j += ",\n  \"base_loaded\": ";
+  j += stats.base_loaded ? "true" : "false";
+  j += ",\n  \"namespaces_compiled\": " +
+       std::to_string(stats.namespaces_compiled);
+  j += ",\n  \"namespaces_reused\": " + std::to_string(stats.namespaces_reused);
+  j += ",\n  \"namespaces_stale\": " + std::to_string(stats.namespaces_stale);
+  j += ",\n  \"templates\": " + std::to_string(stats.templates);
+  j += ",\n  \"template_levels\": " + std::to_string(stats.template_levels);
+  j += ",\n  \"entries\": " + std::to_string(stats.entries);
+  j += ",\n  \"source_bytes\": " + std::to_string(stats.source_bytes);
+  j += ",\n  \"output_bytes\": " + std::to_string(stats.output_bytes);
+  j += ",\n  \"paged_bytes\": " + std::to_string(stats.paged_bytes);
+  j += ",\n  \"page_bytes\": " + std::to_string(stats.page_bytes);
+  j += ",\n  \"stage_seconds\": ";
+  AppendStages(stats.times, true, &j);
+  j += ",\n  \"allocations\": {\"count\": " +
+       std::to_string(stats.allocations) +
+       ", \"bytes\": " + std::to_string(stats.bytes_allocated) +
+       ", \"reserved_bytes\": " + std::to_string(stats.bytes_reserved) + "}";
+  j += ",\n  \"namespace_stats\": [";
+  for (size_t i = 0; i < stats.namespaces.size(); ++i) {
+    const NamespaceStats& ns = stats.namespaces[i];
+    j += i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ";
+    AppendString(ns.name, &j);
+    j += ", \"source_bytes\": " + std::to_string(ns.source_bytes);
+    j += ", \"entries\": " + std::to_string(ns.entries);
+    j += ", \"reused\": ";
+    j += ns.reused ? "true" : "false";
+    j += ", \"paged_bytes\": " + std::to_string(ns.paged_bytes);
+    j += ", \"page_bytes\": " + std::to_string(ns.page_bytes);
+    j += ",\n     \"stage_seconds\": ";
+    AppendStages(ns.times, false, &j);
+    j += '}';
+  }
+  j += stats.namespaces.empty() ? "]\n}\n" : "\n  ]\n}\n";
+  return j;
+}
+
+Status WriteCompileReport(const std::string& path, const std::string& output,
+                          const CompileStats& stats) {
+  FileWriter out;
+  CCC_RETURN_IF_ERROR(out.Open(path));
+  out.Append(CompileReportJson(output, stats));
+  return out.Commit();
+}
+
+}  // namespace ccc
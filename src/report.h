@@ -0,0 +1,26 @@
+// Machine-readable compile reports: per-stage timings, allocation totals
+// and a per-namespace breakdown (CompileStats) as one JSON object, for
+// finding which stage or namespace makes a publish slow.
+
+#ifndef CCC_REPORT_H_
+#define CCC_REPORT_H_
+
+#include <string>
+
+#include "compiler.h"
+#include "status.h"
+
+namespace ccc {
+
+// Renders `stats` of a compilation that wrote `output`. Times are in
+// seconds.
+std::string CompileReportJson(const std::string& output,
+                              const CompileStats& stats);
+
+// Writes CompileReportJson() to `path`, atomically like every artifact.
+Status WriteCompileReport(const std::string& path, const std::string& output,
+                          const CompileStats& stats);
+
+}  // namespace ccc
+
+#endif  // CCC_REPORT_H_
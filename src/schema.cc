@@ -0,0 +1,109 @@
+#include "schema.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory_resource>
+#include <string_view>
+#include <tuple>
+
+#include "compiler.h"
+#include "hash.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "parser.h"
+#include "snapshot.h"
+
+namespace ccc {
+
+namespace {
+
+bool ParseValueType(std::string_view name, ValueType* type) {
+  for (ValueType t : {ValueType::kString, ValueType::kInt, ValueType::kDouble,
+                      ValueType::kBool}) {
+    if (name == ValueTypeName(t)) {
+      *type = t;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+Status LoadSchema(const std::vector<std::string>& inputs, Schema* out) {
+  out->fields.clear();
+  std::vector<std::string> paths;
+  CCC_RETURN_IF_ERROR(ExpandInputs(inputs, kSchemaExtension, &paths));
+  for (const std::string& path : paths) {
+    MappedFile file;
+    CCC_RETURN_IF_ERROR(MappedFile::Open(path, &file));
+    std::pmr::vector<Entry> entries;
+    CCC_RETURN_IF_ERROR(ParseSource(file.data(), path, &entries));
+    std::string ns = std::filesystem::path(path).stem().string();
+    for (const Entry& entry : entries) {
+      SchemaField field;
+      field.ns = ns;
+      field.key.assign(entry.key);
+      if (!ParseValueType(entry.value, &field.type)) {
+        return Status::ParseError(path + ":" + std::to_string(entry.line) +
+                                  ": unknown type '" +
+                                  std::string(entry.value) + "'");
+      }
+      out->fields.push_back(std::move(field));
+    }
+  }
+  return NormalizeSchema(out);
+}
+
+Status NormalizeSchema(Schema* schema) {
+  std::vector<SchemaField>& fields = schema->fields;
+  std::sort(fields.begin(), fields.end(),
+            [](const SchemaField& a, const SchemaField& b) {
+              return std::tie(a.ns, a.key) < std::tie(b.ns, b.key);
+            });
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const SchemaField& f = fields[i];
+    if (!IsValidNamespaceName(f.ns) || f.key.empty() ||
+        !std::all_of(f.key.begin(), f.key.end(), IsKeyChar)) {
+      return Status::InvalidArgument("invalid schema field '" + f.ns + "/" +
+                                     f.key + "'");
+    }
+    if (i > 0 && fields[i - 1].ns == f.ns && fields[i - 1].key == f.key) {
+      return Status::InvalidArgument("schema declares " + f.ns + "/" + f.key +
+                                     " twice");
+    }
+  }
+  return Status::Ok();
+}
+
+uint64_t SchemaHash(const Schema& schema) {
+  if (schema.empty()) return 0;
+  Hasher64 hasher;
+  for (const SchemaField& f : schema.fields) {
+    // Names cannot contain NUL, so the encoding is unambiguous.
+    const char type = static_cast<char>(f.type);
+    hasher.Update(f.ns);
+    hasher.Update("", 1);
+    hasher.Update(f.key);
+    hasher.Update("", 1);
+    hasher.Update(&type, 1);
+  }
+  return hasher.Digest();
+}
+
+void ReadSchema(const Snapshot& snap, Schema* out) {
+  out->fields.clear();
+  for (uint32_t i = 0; i < snap.schema_field_count(); ++i) {
+    const SchemaSlot& slot = snap.schema_slot(i);
+    const NamespaceRecord& ns =
+        snap.namespace_at(snap.EntryNamespace(slot.entry));
+    const EntryRecord& rec = snap.entry_at(slot.entry);
+    SchemaField field;
+    field.ns.assign(snap.namespace_name(ns));
+    field.key.assign(snap.key(ns, rec));
+    field.type = static_cast<ValueType>(rec.type);
+    out->fields.push_back(std::move(field));
+  }
+}
+
+}  // namespace ccc
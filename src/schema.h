@@ -0,0 +1,60 @@
+// Schemas declare the fields a client reads through generated accessors
+// (codegen.h). A snapshot compiled against a schema carries one SchemaSlot
+// per field at a fixed offset (snapshot_format.h), and the compiler
+// guarantees that every field exists with its declared type, so the
+// accessors need neither a lookup nor a type check.
+//
+// A schema file is named after its namespace with the `.schema` extension
+// and uses the source syntax, one `key = type` per line, where type is
+// string, int, double or bool:
+//
+//   # payments.schema
+//   db.port = int
+//   retry.backoff = double
+
+#ifndef CCC_SCHEMA_H_
+#define CCC_SCHEMA_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+#include "status.h"
+
+namespace ccc {
+
+inline constexpr char kSchemaExtension[] = ".schema";
+
+struct SchemaField {
+  std::string ns;
+  std::string key;
+  ValueType type = ValueType::kString;
+};
+
+struct Schema {
+  // Sorted by (namespace, key); field i lives in slot i.
+  std::vector<SchemaField> fields;
+
+  bool empty() const { return fields.empty(); }
+};
+
+// Loads schema files, or directories of them, into `out`.
+Status LoadSchema(const std::vector<std::string>& inputs, Schema* out);
+
+// Sorts `schema` into slot order and rejects duplicate fields and invalid
+// names.
+Status NormalizeSchema(Schema* schema);
+
+// Identifies a slot layout: XXH64 over every field's namespace, key and
+// type in slot order, or 0 for an empty schema.
+uint64_t SchemaHash(const Schema& schema);
+
+class Snapshot;
+
+// Recovers the schema `snap` was compiled against.
+void ReadSchema(const Snapshot& snap, Schema* out);
+
+}  // namespace ccc
+
+#endif  // CCC_SCHEMA_H_
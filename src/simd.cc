@@ -0,0 +1,521 @@
+#include "simd.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "lexer.h"
+
+#if defined(__x86_64__)
+#define CCC_SIMD_X86 1
+#include <immintrin.h>
+#define CCC_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CCC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CCC_SIMD_X86 0
+#endif
+
+namespace ccc {
+
+const char* SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar: return "scalar";
+    case SimdLevel::kSse42: return "sse4.2";
+    case SimdLevel::kAvx2: return "avx2";
+  }
+  return "unknown";
+}
+
+size_t Utf8ErrorOffset(std::string_view text) {
+  const auto* s = reinterpret_cast<const uint8_t*>(text.data());
+  const size_t n = text.size();
+  size_t i = 0;
+  while (i < n) {
+    const uint8_t c = s[i];
+    if (c < 0x80) {
+      ++i;
+      continue;
+    }
+    // Ranges from Table 3-7 of the Unicode standard: the second byte is
+    // narrowed for leads that could otherwise encode overlongs, surrogates
+    // or code points above U+10FFFF.
+    size_t len;
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+      len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      len = 3;
+      if (c == 0xE0) lo = 0xA0;
+      if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      len = 4;
+      if (c == 0xF0) lo = 0x90;
+      if (c == 0xF4) hi = 0x8F;
+    } else {
+      return i;
+    }
+    if (n - i < len || s[i + 1] < lo || s[i + 1] > hi) return i;
+    for (size_t k = 2; k < len; ++k) {
+      if ((s[i + k] & 0xC0) != 0x80) return i;
+    }
+    i += len;
+  }
+  return n;
+}
+
+namespace {
+
+// Scalar kernels. They double as the tail loops of the vector kernels.
+
+bool ScalarValidUtf8(const char* p, size_t n) {
+  // Skip ASCII a word at a time, then validate the rest precisely.
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, p + i, 8);
+    if (word & 0x8080808080808080ULL) break;
+  }
+  return Utf8ErrorOffset(std::string_view(p + i, n - i)) == n - i;
+}
+
+size_t ScalarCountNewlines(const char* p, size_t n) {
+  size_t count = 0;
+  const char* end = p + n;
+  while (p < end) {
+    const void* nl = std::memchr(p, '\n', end - p);
+    if (nl == nullptr) break;
+    ++count;
+    p = static_cast<const char*>(nl) + 1;
+  }
+  return count;
+}
+
+const char* ScalarFindQuoteOrEscape(const char* p, const char* end) {
+  while (p < end && *p != '"' && *p != '\\' && *p != '\n') ++p;
+  return p;
+}
+
+const char* ScalarSkipKeyChars(const char* p, const char* end) {
+  while (p < end && IsKeyChar(*p)) ++p;
+  return p;
+}
+
+const char* ScalarCopyUntilBackslash(const char* p, const char* end,
+                                     char** out) {
+  const char* bs = static_cast<const char*>(std::memchr(p, '\\', end - p));
+  const char* stop = bs ? bs : end;
+  std::memcpy(*out, p, stop - p);
+  *out += stop - p;
+  return stop;
+}
+
+#if CCC_SIMD_X86
+
+// UTF-8 validation after Keiser and Lemire, "Validating UTF-8 In Less Than
+// One Instruction Per Byte" (2021). Each byte is classified together with
+// its predecessor by three 16-entry nibble lookups whose results are ANDed;
+// a non-zero bit names the rule that pair breaks. Continuations that a
+// lead two or three bytes back demands are checked separately.
+constexpr uint8_t kTooShort = 1 << 0;      // Lead, then no continuation.
+constexpr uint8_t kTooLong = 1 << 1;       // ASCII, then continuation.
+constexpr uint8_t kOverlong3 = 1 << 2;     // E0 80..9F
+constexpr uint8_t kTooLarge = 1 << 3;      // F4 90..BF, F5..FF 90..BF
+constexpr uint8_t kSurrogate = 1 << 4;     // ED A0..BF
+constexpr uint8_t kOverlong2 = 1 << 5;     // C0..C1
+constexpr uint8_t kTooLarge1000 = 1 << 6;  // F5..FF 80..8F
+constexpr uint8_t kOverlong4 = 1 << 6;     // F0 80..8F
+constexpr uint8_t kTwoConts = 1 << 7;      // Continuation, then continuation.
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+alignas(16) constexpr uint8_t kByte1High[16] = {
+    kTooLong, kTooLong, kTooLong, kTooLong,
+    kTooLong, kTooLong, kTooLong, kTooLong,
+    kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+    kTooShort | kOverlong2,
+    kTooShort,
+    kTooShort | kOverlong3 | kSurrogate,
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+alignas(16) constexpr uint8_t kByte1Low[16] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+    kCarry | kOverlong2,
+    kCarry,
+    kCarry,
+    kCarry | kTooLarge,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+};
+
+alignas(16) constexpr uint8_t kByte2High[16] = {
+    kTooShort, kTooShort, kTooShort, kTooShort,
+    kTooShort, kTooShort, kTooShort, kTooShort,
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 |
+        kOverlong4,
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+// Per lane, the largest byte value that does not start a sequence running
+// past the end of a block: anything above it in the last three lanes is an
+// incomplete lead.
+alignas(32) constexpr uint8_t kIncomplete[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+// ---- SSE4.2 ---------------------------------------------------------------
+
+struct Utf8StateSse {
+  __m128i error;
+  __m128i prev_input;
+  __m128i prev_incomplete;
+};
+
+CCC_TARGET_SSE42 inline void Utf8StepSse(__m128i input, Utf8StateSse* st) {
+  if (_mm_movemask_epi8(input) == 0) {
+    // ASCII block: only a sequence left open by the previous one is wrong.
+    st->error = _mm_or_si128(st->error, st->prev_incomplete);
+  } else {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i prev1 = _mm_alignr_epi8(input, st->prev_input, 15);
+    const __m128i prev2 = _mm_alignr_epi8(input, st->prev_input, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, st->prev_input, 13);
+    __m128i b1h = _mm_shuffle_epi8(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(kByte1High)),
+        _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i b1l = _mm_shuffle_epi8(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(kByte1Low)),
+        _mm_and_si128(prev1, nibble));
+    __m128i b2h = _mm_shuffle_epi8(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(kByte2High)),
+        _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+    // Third and fourth bytes of a sequence must be continuations.
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth),
+                                   _mm_set1_epi8(static_cast<char>(0x80)));
+    st->error = _mm_or_si128(st->error, _mm_xor_si128(must23, special));
+    st->prev_incomplete = _mm_subs_epu8(
+        input,
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(kIncomplete + 16)));
+  }
+  st->prev_input = input;
+}
+
+CCC_TARGET_SSE42 bool Sse42ValidUtf8(const char* p, size_t n) {
+  Utf8StateSse st = {_mm_setzero_si128(), _mm_setzero_si128(),
+                     _mm_setzero_si128()};
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    Utf8StepSse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)),
+                &st);
+  }
+  // The zero-padded tail also closes any sequence left open.
+  alignas(16) char tail[16] = {};
+  if (n > i) std::memcpy(tail, p + i, n - i);
+  Utf8StepSse(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)), &st);
+  return _mm_testz_si128(st.error, st.error);
+}
+
+CCC_TARGET_SSE42 size_t Sse42CountNewlines(const char* p, size_t n) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  while (i + 16 <= n) {
+    // Byte counters subtract -1 per match and are flushed before they can
+    // wrap.
+    __m128i acc = _mm_setzero_si128();
+    for (int k = 0; k < 255 && i + 16 <= n; ++k, i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+    }
+    __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+    count += static_cast<size_t>(_mm_cvtsi128_si64(sums)) +
+             static_cast<size_t>(_mm_extract_epi64(sums, 1));
+  }
+  return count + ScalarCountNewlines(p + i, n - i);
+}
+
+CCC_TARGET_SSE42 const char* Sse42FindQuoteOrEscape(const char* p,
+                                                    const char* end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(v, nl));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return ScalarFindQuoteOrEscape(p, end);
+}
+
+// Key characters are [A-Za-z0-9_.-]. Bytes >= 0x80 compare as negative and
+// fall outside every range.
+CCC_TARGET_SSE42 inline __m128i KeyCharsSse(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+  __m128i punct = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('.'))),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+  return _mm_or_si128(_mm_or_si128(alpha, digit), punct);
+}
+
+CCC_TARGET_SSE42 const char* Sse42SkipKeyChars(const char* p,
+                                               const char* end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(KeyCharsSse(v))) &
+                    0xFFFFu;
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return ScalarSkipKeyChars(p, end);
+}
+
+CCC_TARGET_SSE42 const char* Sse42CopyUntilBackslash(const char* p,
+                                                     const char* end,
+                                                     char** out) {
+  const __m128i backslash = _mm_set1_epi8('\\');
+  char* o = *out;
+  for (; end - p >= 16; p += 16, o += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(o), v);
+    unsigned mask =
+        static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)));
+    if (mask != 0) {
+      *out = o + __builtin_ctz(mask);
+      return p + __builtin_ctz(mask);
+    }
+  }
+  *out = o;
+  return ScalarCopyUntilBackslash(p, end, out);
+}
+
+// ---- AVX2 -----------------------------------------------------------------
+
+struct Utf8StateAvx2 {
+  __m256i error;
+  __m256i prev_input;
+  __m256i prev_incomplete;
+};
+
+// The 32 bytes ending N bytes before the end of `input`, i.e. `input`
+// shifted right by N with the tail of `prev` shifted in.
+template <int N>
+CCC_TARGET_AVX2 inline __m256i Prev(__m256i input, __m256i prev) {
+  return _mm256_alignr_epi8(input,
+                            _mm256_permute2x128_si256(prev, input, 0x21),
+                            16 - N);
+}
+
+CCC_TARGET_AVX2 inline __m256i Table(const uint8_t* table) {
+  return _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+CCC_TARGET_AVX2 inline void Utf8StepAvx2(__m256i input, Utf8StateAvx2* st) {
+  if (_mm256_movemask_epi8(input) == 0) {
+    st->error = _mm256_or_si256(st->error, st->prev_incomplete);
+  } else {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i prev1 = Prev<1>(input, st->prev_input);
+    __m256i b1h = _mm256_shuffle_epi8(
+        Table(kByte1High), _mm256_and_si256(_mm256_srli_epi16(prev1, 4),
+                                            nibble));
+    __m256i b1l = _mm256_shuffle_epi8(Table(kByte1Low),
+                                      _mm256_and_si256(prev1, nibble));
+    __m256i b2h = _mm256_shuffle_epi8(
+        Table(kByte2High), _mm256_and_si256(_mm256_srli_epi16(input, 4),
+                                            nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+    __m256i third = _mm256_subs_epu8(Prev<2>(input, st->prev_input),
+                                     _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i fourth = _mm256_subs_epu8(Prev<3>(input, st->prev_input),
+                                      _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must23 =
+        _mm256_and_si256(_mm256_or_si256(third, fourth),
+                         _mm256_set1_epi8(static_cast<char>(0x80)));
+    st->error = _mm256_or_si256(st->error, _mm256_xor_si256(must23, special));
+    st->prev_incomplete = _mm256_subs_epu8(
+        input,
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(kIncomplete)));
+  }
+  st->prev_input = input;
+}
+
+CCC_TARGET_AVX2 bool Avx2ValidUtf8(const char* p, size_t n) {
+  Utf8StateAvx2 st = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                      _mm256_setzero_si256()};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    Utf8StepAvx2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), &st);
+  }
+  alignas(32) char tail[32] = {};
+  if (n > i) std::memcpy(tail, p + i, n - i);
+  Utf8StepAvx2(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)),
+               &st);
+  return _mm256_testz_si256(st.error, st.error);
+}
+
+CCC_TARGET_AVX2 size_t Avx2CountNewlines(const char* p, size_t n) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  while (i + 32 <= n) {
+    __m256i acc = _mm256_setzero_si256();
+    for (int k = 0; k < 255 && i + 32 <= n; ++k, i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
+    }
+    __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    count += static_cast<size_t>(_mm256_extract_epi64(sums, 0)) +
+             static_cast<size_t>(_mm256_extract_epi64(sums, 1)) +
+             static_cast<size_t>(_mm256_extract_epi64(sums, 2)) +
+             static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+  }
+  return count + Sse42CountNewlines(p + i, n - i);
+}
+
+CCC_TARGET_AVX2 const char* Avx2FindQuoteOrEscape(const char* p,
+                                                  const char* end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hit = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpeq_epi8(v, nl));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return Sse42FindQuoteOrEscape(p, end);
+}
+
+CCC_TARGET_AVX2 const char* Avx2SkipKeyChars(const char* p, const char* end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha =
+        _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i punct = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'))),
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+    __m256i key = _mm256_or_si256(_mm256_or_si256(alpha, digit), punct);
+    unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(key));
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return Sse42SkipKeyChars(p, end);
+}
+
+CCC_TARGET_AVX2 const char* Avx2CopyUntilBackslash(const char* p,
+                                                   const char* end,
+                                                   char** out) {
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  char* o = *out;
+  for (; end - p >= 32; p += 32, o += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o), v);
+    unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)));
+    if (mask != 0) {
+      *out = o + __builtin_ctz(mask);
+      return p + __builtin_ctz(mask);
+    }
+  }
+  *out = o;
+  return Sse42CopyUntilBackslash(p, end, out);
+}
+
+#endif  // CCC_SIMD_X86
+
+const SimdKernels kScalarKernels = {
+    SimdLevel::kScalar,      ScalarValidUtf8,    ScalarCountNewlines,
+    ScalarFindQuoteOrEscape, ScalarSkipKeyChars, ScalarCopyUntilBackslash,
+};
+
+#if CCC_SIMD_X86
+const SimdKernels kSse42Kernels = {
+    SimdLevel::kSse42,      Sse42ValidUtf8,    Sse42CountNewlines,
+    Sse42FindQuoteOrEscape, Sse42SkipKeyChars, Sse42CopyUntilBackslash,
+};
+
+const SimdKernels kAvx2Kernels = {
+    SimdLevel::kAvx2,      Avx2ValidUtf8,    Avx2CountNewlines,
+    Avx2FindQuoteOrEscape, Avx2SkipKeyChars, Avx2CopyUntilBackslash,
+};
+#endif
+
+const SimdKernels* SelectKernels() {
+  SimdLevel cap = SimdLevel::kAvx2;
+  if (const char* env = std::getenv("CCC_SIMD")) {
+    for (SimdLevel level : {SimdLevel::kScalar, SimdLevel::kSse42}) {
+      if (std::strcmp(env, SimdLevelName(level)) == 0) cap = level;
+    }
+  }
+  for (int level = static_cast<int>(cap); level > 0; --level) {
+    if (const SimdKernels* kernels =
+            GetSimdKernels(static_cast<SimdLevel>(level))) {
+      return kernels;
+    }
+  }
+  return &kScalarKernels;
+}
+
+}  // namespace
+
+const SimdKernels* GetSimdKernels(SimdLevel level) {
+#if CCC_SIMD_X86
+  __builtin_cpu_init();
+  switch (level) {
+    case SimdLevel::kScalar:
+      return &kScalarKernels;
+    case SimdLevel::kSse42:
+      return __builtin_cpu_supports("sse4.2") ? &kSse42Kernels : nullptr;
+    case SimdLevel::kAvx2:
+      // The AVX2 kernels finish their tails with the SSE4.2 ones.
+      return __builtin_cpu_supports("avx2") &&
+                     __builtin_cpu_supports("sse4.2")
+                 ? &kAvx2Kernels
+                 : nullptr;
+  }
+  return nullptr;
+#else
+  return level == SimdLevel::kScalar ? &kScalarKernels : nullptr;
+#endif
+}
+
+const SimdKernels& ActiveSimdKernels() {
+  static const SimdKernels* const active = SelectKernels();
+  return *active;
+}
+
+}  // namespace ccc
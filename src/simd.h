@@ -0,0 +1,54 @@
+// Vectorized scanning kernels for the lexer, parser and escape decoder.
+//
+// Each kernel has a scalar, an SSE4.2 and an AVX2 implementation with
+// identical results. The best level the CPU supports is picked once at
+// first use; the CCC_SIMD environment variable (`scalar`, `sse4.2` or
+// `avx2`) can lower it, which is how the implementations are compared.
+
+#ifndef CCC_SIMD_H_
+#define CCC_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ccc {
+
+enum class SimdLevel : uint8_t { kScalar = 0, kSse42 = 1, kAvx2 = 2 };
+
+const char* SimdLevelName(SimdLevel level);
+
+struct SimdKernels {
+  SimdLevel level;
+  // True if [p, p + n) is well-formed UTF-8 (no overlongs, surrogates or
+  // code points above U+10FFFF).
+  bool (*valid_utf8)(const char* p, size_t n);
+  size_t (*count_newlines)(const char* p, size_t n);
+  // First '"', '\\' or '\n' in [p, end), or end.
+  const char* (*find_quote_or_escape)(const char* p, const char* end);
+  // First byte in [p, end) that is not a key character, or end.
+  const char* (*skip_key_chars)(const char* p, const char* end);
+  // Copies [p, first '\\' or end) to *out, advances *out past the copy and
+  // returns the stop position. May write up to end - p bytes at *out even
+  // when it copies fewer.
+  const char* (*copy_until_backslash)(const char* p, const char* end,
+                                      char** out);
+};
+
+// Kernels for `level`, or null if the CPU does not support it.
+const SimdKernels* GetSimdKernels(SimdLevel level);
+
+// Kernels in use by this process.
+const SimdKernels& ActiveSimdKernels();
+
+inline bool IsValidUtf8(std::string_view text) {
+  return ActiveSimdKernels().valid_utf8(text.data(), text.size());
+}
+
+// Offset of the first byte of the first malformed sequence in `text`, or
+// text.size() if it is valid. Scalar; meant for error reporting.
+size_t Utf8ErrorOffset(std::string_view text);
+
+}  // namespace ccc
+
+#endif  // CCC_SIMD_H_
@@ -0,0 +1,448 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <charconv>
+#include <utility>
+
+#include "hash.h"
+#include "page_codec.h"
+
+namespace ccc {
+
+namespace {
+
+// Checks that every direct slot and slot entry of a table over `n` items
+// stays in range, so probing it cannot read outside the table.
+bool IndexTableInRange(const uint32_t* table, uint32_t n) {
+  const uint32_t buckets = PerfectHashBuckets(n);
+  for (uint32_t b = 0; b < buckets; ++b) {
+    if ((table[b] & kDirectSlot) && (table[b] & ~kDirectSlot) >= n) {
+      return false;
+    }
+  }
+  for (uint32_t s = 0; s < n; ++s) {
+    if (table[buckets + s] >= n) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string ValueRef::ToString() const {
+  switch (type()) {
+    case ValueType::kString:
+      return std::string(string_value());
+    case ValueType::kInt:
+      return std::to_string(int_value());
+    case ValueType::kDouble: {
+      char buf[32];
+      auto r = std::to_chars(buf, buf + sizeof(buf), double_value());
+      return std::string(buf, r.ptr);
+    }
+    case ValueType::kBool:
+      return bool_value() ? "true" : "false";
+  }
+  return std::string();
+}
+
+PageCache& PageCache::operator=(PageCache&& other) noexcept {
+  if (this != &other) {
+    Clear();
+    first_page_ = std::move(other.first_page_);
+    slots_ = std::move(other.slots_);
+    size_ = std::exchange(other.size_, 0);
+    dictionaries_ = std::move(other.dictionaries_);
+  }
+  return *this;
+}
+
+void PageCache::Reset(std::vector<uint64_t> first_page) {
+  Clear();
+  size_ = first_page.empty() ? 0 : first_page.back();
+  first_page_ = std::move(first_page);
+  slots_.reset(size_ > 0 ? new std::atomic<char*>[size_] : nullptr);
+  for (uint64_t i = 0; i < size_; ++i) {
+    slots_[i].store(nullptr, std::memory_order_relaxed);
+  }
+  const size_t namespaces = first_page_.empty() ? 0 : first_page_.size() - 1;
+  dictionaries_.reset(new std::atomic<PageDictionary*>[namespaces]);
+  for (size_t i = 0; i < namespaces; ++i) {
+    dictionaries_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+const char* PageCache::Install(uint32_t ns, uint32_t page,
+                               std::unique_ptr<char[]> data) const {
+  char* expected = nullptr;
+  if (Slot(ns, page).compare_exchange_strong(expected, data.get(),
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+    return data.release();
+  }
+  return expected;
+}
+
+const PageDictionary* PageCache::InstallDictionary(
+    uint32_t ns, std::unique_ptr<PageDictionary> dictionary) const {
+  PageDictionary* expected = nullptr;
+  if (dictionaries_[ns].compare_exchange_strong(
+          expected, dictionary.get(), std::memory_order_acq_rel,
+          std::memory_order_acquire)) {
+    return dictionary.release();
+  }
+  return expected;
+}
+
+void PageCache::Clear() {
+  for (uint64_t i = 0; i < size_; ++i) {
+    delete[] slots_[i].load(std::memory_order_relaxed);
+  }
+  slots_.reset();
+  if (dictionaries_ != nullptr) {
+    for (size_t i = 0; i + 1 < first_page_.size(); ++i) {
+      delete dictionaries_[i].load(std::memory_order_relaxed);
+    }
+  }
+  dictionaries_.reset();
+  first_page_.clear();
+  size_ = 0;
+}
+
+Status Snapshot::Open(const std::string& path, Snapshot* out) {
+  Snapshot snap;
+  CCC_RETURN_IF_ERROR(
+      MappedFile::Open(path, &snap.file_, MappedFile::Access::kRandom));
+  Status status = snap.Init();
+  if (!status.ok()) return Status::Corrupt(path + ": " + status.message());
+  *out = std::move(snap);
+  return Status::Ok();
+}
+
+Status Snapshot::Init() {
+  const char* base = file_.data().data();
+  uint64_t size = file_.size();
+  if (size < sizeof(SnapshotHeader)) return Status::Corrupt("truncated");
+  header_ = reinterpret_cast<const SnapshotHeader*>(base);
+  const SnapshotHeader& h = *header_;
+  if (h.magic != kSnapshotMagic) return Status::Corrupt("bad magic");
+  if (h.version != kSnapshotVersion) {
+    return Status::Corrupt("unsupported version " +
+                           std::to_string(h.version));
+  }
+  if (h.file_size != size) return Status::Corrupt("size mismatch");
+
+  uint64_t schema_end = h.schema_offset + uint64_t{h.schema_field_count} *
+                                              sizeof(SchemaSlot);
+  uint64_t ns_end = h.namespace_offset +
+                    uint64_t{h.namespace_count} * sizeof(NamespaceRecord);
+  uint64_t entry_end =
+      h.entry_offset + uint64_t{h.entry_count} * sizeof(EntryRecord);
+  if (h.schema_offset != sizeof(SnapshotHeader) ||
+      schema_end > h.namespace_offset || h.namespace_offset % 8 ||
+      ns_end > h.entry_offset || h.entry_offset % 8 ||
+      entry_end > h.index_offset ||
+      h.index_offset + IndexTableSize(h.namespace_count) > h.key_heap_offset ||
+      h.key_heap_offset > h.value_heap_offset ||
+      h.value_heap_offset > size) {
+    return Status::Corrupt("bad section offsets");
+  }
+  slots_ = reinterpret_cast<const SchemaSlot*>(base + h.schema_offset);
+  namespaces_ = reinterpret_cast<const NamespaceRecord*>(
+      base + h.namespace_offset);
+  entries_ = reinterpret_cast<const EntryRecord*>(base + h.entry_offset);
+  key_heap_ = base + h.key_heap_offset;
+  value_heap_ = base + h.value_heap_offset;
+
+  // Every page has a 16-byte table entry in the file, which bounds the
+  // cache a corrupt page count can make us allocate.
+  std::vector<uint64_t> first_page(h.namespace_count + 1, 0);
+  for (uint32_t i = 0; i < h.namespace_count; ++i) {
+    first_page[i + 1] = first_page[i] + namespaces_[i].page_count;
+  }
+  if (first_page.back() > size / sizeof(PageRecord)) {
+    return Status::Corrupt("bad page counts");
+  }
+  if (first_page.back() > 0) {
+    if (!PageCodecAvailable()) {
+      return Status::Corrupt("has compressed values, but this build has no "
+                             "zstd support");
+    }
+    pages_.Reset(std::move(first_page));
+  }
+  return Status::Ok();
+}
+
+Status Snapshot::VerifyChecksum() const {
+  std::string_view body = bytes().substr(sizeof(SnapshotHeader));
+  if (Hash64(body) != header_->checksum) {
+    return Status::Corrupt("checksum mismatch");
+  }
+  return Status::Ok();
+}
+
+Status Snapshot::Verify() const {
+  CCC_RETURN_IF_ERROR(VerifyChecksum());
+  const SnapshotHeader& h = *header_;
+
+  uint64_t key_heap_size = h.value_heap_offset - h.key_heap_offset;
+  uint64_t value_heap_size = h.file_size - h.value_heap_offset;
+  uint64_t next_entry = 0;
+  std::string scratch;
+  for (uint32_t i = 0; i < h.namespace_count; ++i) {
+    const NamespaceRecord& ns = namespaces_[i];
+    if (uint64_t{ns.name_offset} + ns.name_length > key_heap_size ||
+        ns.first_entry != next_entry ||
+        uint64_t{ns.first_entry} + ns.entry_count > h.entry_count ||
+        ns.key_offset > key_heap_size ||
+        ns.key_size > key_heap_size - ns.key_offset ||
+        ns.refs_size > ns.key_size ||
+        ns.value_offset > value_heap_size ||
+        ns.value_size > value_heap_size - ns.value_offset ||
+        (ns.flags & ~kNamespaceCompressed) != 0 ||
+        (ns.page_count > 0 && !(ns.flags & kNamespaceCompressed))) {
+      return Status::Corrupt("bad namespace record " + std::to_string(i));
+    }
+    if (i > 0 && namespace_name(namespaces_[i - 1]) >= namespace_name(ns)) {
+      return Status::Corrupt("namespaces out of order");
+    }
+    next_entry += ns.entry_count;
+
+    // Every page must decompress to its recorded size. This uses scratch
+    // memory rather than the page cache, so verifying a snapshot does not
+    // keep all of its values in memory.
+    std::vector<PageRecord> pages(ns.page_count);
+    for (uint32_t p = 0; p < ns.page_count; ++p) {
+      std::string_view compressed;
+      std::string_view dictionary;
+      if (!PageAt(ns, p, &pages[p], &compressed, &dictionary)) {
+        return Status::Corrupt("bad page table in namespace " +
+                               std::to_string(i));
+      }
+      scratch.resize(pages[p].raw_size);
+      if (!DecompressPage(compressed, DictionaryOf(i, dictionary),
+                          scratch.data(), scratch.size())) {
+        return Status::Corrupt("bad value page " + std::to_string(p) +
+                               " in namespace " + std::to_string(i));
+      }
+    }
+
+    for (uint32_t e = 0; e < ns.entry_count; ++e) {
+      const EntryRecord& rec = entries_[ns.first_entry + e];
+      std::string where = std::string(namespace_name(ns)) + " entry " +
+                          std::to_string(e);
+      if (uint64_t{rec.key_offset} + rec.key_length >
+          ns.key_size - ns.refs_size) {
+        return Status::Corrupt("bad key in " + where);
+      }
+      if ((rec.flags & ~kRecordPaged) != 0 ||
+          ((rec.flags & kRecordPaged) &&
+           static_cast<ValueType>(rec.type) != ValueType::kString)) {
+        return Status::Corrupt("bad flags in " + where);
+      }
+      if (rec.flags & kRecordPaged) {
+        const uint64_t page = rec.value >> 32;
+        const uint64_t offset = rec.value & 0xffffffff;
+        if (page >= ns.page_count ||
+            offset + rec.value_length > pages[page].raw_size) {
+          return Status::Corrupt("bad value in " + where);
+        }
+      }
+      switch (static_cast<ValueType>(rec.type)) {
+        case ValueType::kString:
+          if (rec.flags & kRecordPaged) break;
+          if (rec.value > ns.value_size ||
+              rec.value_length > ns.value_size - rec.value) {
+            return Status::Corrupt("bad value in " + where);
+          }
+          break;
+        case ValueType::kInt:
+        case ValueType::kDouble:
+        case ValueType::kBool:
+          break;
+        default:
+          return Status::Corrupt("bad type in " + where);
+      }
+      if (e > 0 && key(ns, entries_[ns.first_entry + e - 1]) >=
+                       key(ns, rec)) {
+        return Status::Corrupt("keys out of order in " + where);
+      }
+    }
+  }
+  if (next_entry != h.entry_count) return Status::Corrupt("orphan entries");
+
+  // Every namespace and key must be found at its own position, which also
+  // proves every slot table is a permutation.
+  if (!IndexTableInRange(IndexTable(h.index_offset), h.namespace_count)) {
+    return Status::Corrupt("bad namespace index");
+  }
+  for (uint32_t i = 0; i < h.namespace_count; ++i) {
+    const NamespaceRecord& ns = namespaces_[i];
+    if (ns.index_offset % 4 || ns.index_offset < h.index_offset ||
+        ns.index_offset + IndexTableSize(ns.entry_count) > h.key_heap_offset ||
+        !IndexTableInRange(IndexTable(ns.index_offset), ns.entry_count)) {
+      return Status::Corrupt("bad key index in namespace " +
+                             std::to_string(i));
+    }
+    if (FindNamespace(namespace_name(ns)) != i) {
+      return Status::Corrupt("namespace index does not resolve " +
+                             std::string(namespace_name(ns)));
+    }
+    for (uint32_t e = 0; e < ns.entry_count; ++e) {
+      const EntryRecord& rec = entries_[ns.first_entry + e];
+      if (FindEntry(i, key(ns, rec)) != &rec) {
+        return Status::Corrupt("key index does not resolve " +
+                               std::string(namespace_name(ns)) + "/" +
+                               std::string(key(ns, rec)));
+      }
+    }
+  }
+
+  // Slots are copies of their entries' values, in (namespace, key) order.
+  for (uint32_t i = 0; i < h.schema_field_count; ++i) {
+    const SchemaSlot& slot = slots_[i];
+    if (slot.entry >= h.entry_count ||
+        (i > 0 && slots_[i - 1].entry >= slot.entry)) {
+      return Status::Corrupt("bad schema slot " + std::to_string(i));
+    }
+    const NamespaceRecord& ns = namespaces_[EntryNamespace(slot.entry)];
+    const EntryRecord& rec = entries_[slot.entry];
+    if (rec.flags & kRecordPaged) {
+      // Paged fields point at an uncompressed copy of the value.
+      ValueRef value = this->value(ns, rec);
+      if (!value || slot.value_length != rec.value_length ||
+          slot.value < h.value_heap_offset || slot.value > h.file_size ||
+          slot.value_length > h.file_size - slot.value ||
+          bytes().substr(slot.value, slot.value_length) !=
+              value.string_value()) {
+        return Status::Corrupt("schema slot " + std::to_string(i) +
+                               " does not match its entry");
+      }
+      continue;
+    }
+    uint64_t value = rec.value;
+    if (static_cast<ValueType>(rec.type) == ValueType::kString) {
+      value += h.value_heap_offset + ns.value_offset;
+    }
+    if (slot.value != value || slot.value_length != rec.value_length) {
+      return Status::Corrupt("schema slot " + std::to_string(i) +
+                             " does not match its entry");
+    }
+  }
+  return Status::Ok();
+}
+
+uint32_t Snapshot::EntryNamespace(uint32_t i) const {
+  // The last namespace starting at or before `i`; an empty namespace
+  // shares its first entry with its successor, so it is never the last.
+  const NamespaceRecord* begin = namespaces_;
+  const NamespaceRecord* end = namespaces_ + header_->namespace_count;
+  const NamespaceRecord* it = std::upper_bound(
+      begin, end, i, [](uint32_t entry, const NamespaceRecord& ns) {
+        return entry < ns.first_entry;
+      });
+  return static_cast<uint32_t>(it - begin) - 1;
+}
+
+std::string_view Snapshot::EntryBlock(const NamespaceRecord& ns) const {
+  return bytes().substr(
+      header_->entry_offset + uint64_t{ns.first_entry} * sizeof(EntryRecord),
+      uint64_t{ns.entry_count} * sizeof(EntryRecord));
+}
+
+std::string_view Snapshot::IndexBlock(const NamespaceRecord& ns) const {
+  return bytes().substr(ns.index_offset, IndexTableSize(ns.entry_count));
+}
+
+std::string_view Snapshot::KeyBlock(const NamespaceRecord& ns) const {
+  return std::string_view(key_heap_ + ns.key_offset, ns.key_size);
+}
+
+std::string_view Snapshot::ValueBlock(const NamespaceRecord& ns) const {
+  return std::string_view(value_heap_ + ns.value_offset, ns.value_size);
+}
+
+int64_t Snapshot::FindNamespace(std::string_view ns) const {
+  const uint32_t n = header_->namespace_count;
+  if (n == 0) return -1;
+  const uint32_t buckets = PerfectHashBuckets(n);
+  const uint32_t* table = IndexTable(header_->index_offset);
+  uint32_t slot = PerfectHashSlot(Hash64(ns, header_->namespace_seed), table,
+                                  buckets, n);
+  uint32_t i = table[buckets + slot];
+  if (namespace_name(namespaces_[i]) != ns) return -1;
+  return i;
+}
+
+const EntryRecord* Snapshot::FindEntry(uint32_t ns_index,
+                                       std::string_view k) const {
+  const NamespaceRecord& ns = namespaces_[ns_index];
+  const uint32_t n = ns.entry_count;
+  if (n == 0) return nullptr;
+  const uint32_t buckets = PerfectHashBuckets(n);
+  const uint32_t* table = IndexTable(ns.index_offset);
+  uint32_t slot = PerfectHashSlot(Hash64(k, ns.seed), table, buckets, n);
+  const EntryRecord& rec = entries_[ns.first_entry + table[buckets + slot]];
+  return key(ns, rec) == k ? &rec : nullptr;
+}
+
+bool Snapshot::PageAt(const NamespaceRecord& ns, uint32_t page,
+                      PageRecord* rec, std::string_view* compressed,
+                      std::string_view* dictionary) const {
+  const uint64_t table = ns.page_table_offset;
+  const uint64_t table_end =
+      table + uint64_t{ns.page_count} * sizeof(PageRecord);
+  if (page >= ns.page_count || table > ns.value_size ||
+      table_end + ns.dictionary_size > ns.value_size) {
+    return false;
+  }
+  // Value blocks are not aligned, so the table is read by copy.
+  const char* block = value_heap_ + ns.value_offset;
+  std::memcpy(rec, block + table + uint64_t{page} * sizeof(PageRecord),
+              sizeof(PageRecord));
+  if (rec->offset > ns.value_size ||
+      rec->compressed_size > ns.value_size - rec->offset) {
+    return false;
+  }
+  *compressed = std::string_view(block + rec->offset, rec->compressed_size);
+  *dictionary = std::string_view(block + table_end, ns.dictionary_size);
+  return true;
+}
+
+const PageDictionary& Snapshot::DictionaryOf(
+    uint32_t n, std::string_view dictionary) const {
+  const PageDictionary* prepared = pages_.Dictionary(n);
+  if (prepared == nullptr) {
+    // As with pages, a racing lookup may prepare it too; one copy wins.
+    prepared = pages_.InstallDictionary(
+        n, std::make_unique<PageDictionary>(dictionary));
+  }
+  return *prepared;
+}
+
+ValueRef Snapshot::PagedValue(const NamespaceRecord& ns,
+                              const EntryRecord& rec) const {
+  const uint32_t n = static_cast<uint32_t>(&ns - namespaces_);
+  const uint32_t page = static_cast<uint32_t>(rec.value >> 32);
+  const uint32_t offset = static_cast<uint32_t>(rec.value);
+  if (page >= ns.page_count) return ValueRef();
+  const char* data = pages_.Get(n, page);
+  if (data == nullptr) {
+    PageRecord page_rec;
+    std::string_view compressed;
+    std::string_view dictionary;
+    if (!PageAt(ns, page, &page_rec, &compressed, &dictionary) ||
+        uint64_t{offset} + rec.value_length > page_rec.raw_size) {
+      return ValueRef();
+    }
+    // A racing lookup may decompress the same page; one copy wins.
+    std::unique_ptr<char[]> raw(new char[page_rec.raw_size]);
+    if (!DecompressPage(compressed, DictionaryOf(n, dictionary), raw.get(),
+                        page_rec.raw_size)) {
+      return ValueRef();
+    }
+    data = pages_.Install(n, page, std::move(raw));
+  }
+  return ValueRef(&rec, data + offset);
+}
+
+}  // namespace ccc
@@ -0,0 +1,215 @@
+// Read-only view of a compiled snapshot. Opening maps the file and checks
+// the header; lookups then read the mapped tables directly. Many processes
+// mapping the same snapshot share its page-cache pages. Compressed value
+// pages are the exception: each is decompressed into private memory the
+// first time a lookup touches it, and kept until the snapshot is closed.
+
+#ifndef CCC_SNAPSHOT_H_
+#define CCC_SNAPSHOT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ir.h"
+#include "mapped_file.h"
+#include "snapshot_format.h"
+#include "status.h"
+
+namespace ccc {
+
+// A value inside a mapped snapshot. Valid only while the snapshot is open.
+class ValueRef {
+ public:
+  ValueRef() = default;
+  // `data` holds the bytes of a string value; it is unused otherwise.
+  ValueRef(const EntryRecord* rec, const char* data)
+      : rec_(rec), data_(data) {}
+
+  bool found() const { return rec_ != nullptr; }
+  const EntryRecord* record() const { return rec_; }
+  explicit operator bool() const { return found(); }
+
+  ValueType type() const { return static_cast<ValueType>(rec_->type); }
+
+  // Bytes of a string value.
+  std::string_view string_value() const {
+    return std::string_view(data_, rec_->value_length);
+  }
+  int64_t int_value() const { return static_cast<int64_t>(rec_->value); }
+  double double_value() const {
+    double d;
+    std::memcpy(&d, &rec_->value, sizeof(d));
+    return d;
+  }
+  bool bool_value() const { return rec_->value != 0; }
+
+  // Renders the value as source text (strings are not re-quoted).
+  std::string ToString() const;
+
+ private:
+  const EntryRecord* rec_ = nullptr;
+  const char* data_ = nullptr;
+};
+
+class PageDictionary;
+
+// Decompressed value pages of one snapshot, and the digested dictionary of
+// each namespace, filled in concurrently by lookups: each slot is set at
+// most once, by whichever thread installs it first. Owns both.
+class PageCache {
+ public:
+  PageCache() = default;
+  PageCache(PageCache&& other) noexcept { *this = std::move(other); }
+  PageCache& operator=(PageCache&& other) noexcept;
+  ~PageCache() { Clear(); }
+
+  // Makes room for `first_page.back()` pages; namespace n owns the slots
+  // from first_page[n] up to first_page[n + 1].
+  void Reset(std::vector<uint64_t> first_page);
+
+  const char* Get(uint32_t ns, uint32_t page) const {
+    return Slot(ns, page).load(std::memory_order_acquire);
+  }
+  // Installs `data` unless another thread got there first, and returns
+  // the page that is installed.
+  const char* Install(uint32_t ns, uint32_t page,
+                      std::unique_ptr<char[]> data) const;
+
+  const PageDictionary* Dictionary(uint32_t ns) const {
+    return dictionaries_[ns].load(std::memory_order_acquire);
+  }
+  // As Install(), for the dictionary of namespace `ns`.
+  const PageDictionary* InstallDictionary(
+      uint32_t ns, std::unique_ptr<PageDictionary> dictionary) const;
+
+ private:
+  std::atomic<char*>& Slot(uint32_t ns, uint32_t page) const {
+    return slots_[first_page_[ns] + page];
+  }
+  void Clear();
+
+  std::vector<uint64_t> first_page_;
+  std::unique_ptr<std::atomic<char*>[]> slots_;
+  uint64_t size_ = 0;
+  std::unique_ptr<std::atomic<PageDictionary*>[]> dictionaries_;
+};
+
+class Snapshot {
+ public:
+  Snapshot() = default;
+  Snapshot(Snapshot&&) = default;
+  Snapshot& operator=(Snapshot&&) = default;
+
+  // Maps `path` and validates its header and section bounds. Record
+  // contents are trusted; call Verify() to check them too.
+  static Status Open(const std::string& path, Snapshot* out);
+
+  // Checks the body checksum only; enough to trust a snapshot this tool
+  // wrote itself.
+  Status VerifyChecksum() const;
+
+  // VerifyChecksum(), plus every record pointing inside its section,
+  // every index probe resolving and every schema slot matching its entry.
+  Status Verify() const;
+
+  const SnapshotHeader& header() const { return *header_; }
+  uint32_t namespace_count() const { return header_->namespace_count; }
+  uint32_t entry_count() const { return header_->entry_count; }
+  std::string_view bytes() const { return file_.data(); }
+
+  const NamespaceRecord& namespace_at(uint32_t i) const {
+    return namespaces_[i];
+  }
+  const EntryRecord& entry_at(uint32_t i) const { return entries_[i]; }
+  // Index of the namespace owning entry `i` (< entry_count()).
+  uint32_t EntryNamespace(uint32_t i) const;
+  std::string_view namespace_name(const NamespaceRecord& ns) const {
+    return std::string_view(key_heap_ + ns.name_offset, ns.name_length);
+  }
+  // Keys and values are addressed relative to their namespace.
+  std::string_view key(const NamespaceRecord& ns,
+                       const EntryRecord& rec) const {
+    return std::string_view(key_heap_ + ns.key_offset + rec.key_offset,
+                            rec.key_length);
+  }
+  // `ns` must be one of this snapshot's namespace records. A paged value
+  // whose page cannot be decompressed reads as not found.
+  ValueRef value(const NamespaceRecord& ns, const EntryRecord& rec) const {
+    if (rec.flags & kRecordPaged) return PagedValue(ns, rec);
+    if (static_cast<ValueType>(rec.type) != ValueType::kString) {
+      return ValueRef(&rec, nullptr);
+    }
+    return ValueRef(&rec, value_heap_ + ns.value_offset + rec.value);
+  }
+
+  uint32_t schema_field_count() const { return header_->schema_field_count; }
+  const SchemaSlot& schema_slot(uint32_t i) const { return slots_[i]; }
+
+  // The byte ranges a namespace owns. Being position independent, they can
+  // be copied verbatim into another snapshot.
+  std::string_view EntryBlock(const NamespaceRecord& ns) const;
+  std::string_view IndexBlock(const NamespaceRecord& ns) const;
+  std::string_view KeyBlock(const NamespaceRecord& ns) const;
+  std::string_view ValueBlock(const NamespaceRecord& ns) const;
+
+  // Keys of other namespaces that the values of `ns` reference, as sorted
+  // `ns/key` lines joined by '\n'.
+  std::string_view References(const NamespaceRecord& ns) const {
+    return std::string_view(
+        key_heap_ + ns.key_offset + ns.key_size - ns.refs_size,
+        ns.refs_size);
+  }
+
+  // Returns the index of namespace `ns`, or -1. Hot paths should resolve
+  // their namespace once and then use the index overload of Find().
+  int64_t FindNamespace(std::string_view ns) const;
+
+  // Looks `key` up in namespace `ns_index` with one perfect hash probe and
+  // one key comparison.
+  ValueRef Find(uint32_t ns_index, std::string_view key) const {
+    const EntryRecord* rec = FindEntry(ns_index, key);
+    return rec ? value(namespaces_[ns_index], *rec) : ValueRef();
+  }
+
+  ValueRef Find(std::string_view ns, std::string_view key) const {
+    int64_t n = FindNamespace(ns);
+    return n < 0 ? ValueRef() : Find(static_cast<uint32_t>(n), key);
+  }
+
+ private:
+  Status Init();
+  const uint32_t* IndexTable(uint64_t offset) const {
+    return reinterpret_cast<const uint32_t*>(file_.data().data() + offset);
+  }
+  const EntryRecord* FindEntry(uint32_t ns_index, std::string_view key) const;
+
+  // Reads page `page` of `ns` from the page table and locates its
+  // compressed bytes and the namespace's dictionary. Returns false if the
+  // table or the page lies outside the value block.
+  bool PageAt(const NamespaceRecord& ns, uint32_t page, PageRecord* rec,
+              std::string_view* compressed,
+              std::string_view* dictionary) const;
+  // The digested `dictionary` of namespace `n`, prepared on first use.
+  const PageDictionary& DictionaryOf(uint32_t n,
+                                     std::string_view dictionary) const;
+  ValueRef PagedValue(const NamespaceRecord& ns,
+                      const EntryRecord& rec) const;
+
+  MappedFile file_;
+  const SnapshotHeader* header_ = nullptr;
+  const SchemaSlot* slots_ = nullptr;
+  const NamespaceRecord* namespaces_ = nullptr;
+  const EntryRecord* entries_ = nullptr;
+  const char* key_heap_ = nullptr;
+  const char* value_heap_ = nullptr;
+  PageCache pages_;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_SNAPSHOT_H_
@@ -0,0 +1,177 @@
+// On-disk layout of a compiled snapshot. The file is designed to be mapped
+// read-only and used in place: every reference is an offset, every table is
+// naturally aligned, and nothing needs to be decoded before a lookup.
+//
+//   +--------------------+  0
+//   | SnapshotHeader     |
+//   +--------------------+  schema_offset (always sizeof(SnapshotHeader))
+//   | SchemaSlot[]       |  one per schema field, see below
+//   +--------------------+  namespace_offset
+//   | NamespaceRecord[]  |  sorted by name
+//   +--------------------+  entry_offset
+//   | EntryRecord[]      |  grouped by namespace, sorted by key within one
+//   +--------------------+  index_offset
+//   | perfect hash index |  see below
+//   +--------------------+  key_heap_offset
+//   | key bytes          |  namespace names, then one key block per namespace
+//   |                    |  (its keys, then its external references)
+//   +--------------------+  value_heap_offset (8-byte aligned)
+//   | value bytes        |  one value block per namespace, see below, then
+//   |                    |  uncompressed copies of paged schema fields
+//   +--------------------+  file_size
+//
+// Entry records address keys and values relative to their namespace's
+// blocks, so everything a namespace owns (its entry records, index table,
+// key block and value block) is position independent. An incremental
+// compile splices an unchanged namespace from the previous snapshot by
+// copying those four byte ranges.
+//
+// The index section holds one perfect hash table (perfect_hash.h) over the
+// namespace names, followed by one per namespace over its keys. A table
+// over n items is u32 displacements[PerfectHashBuckets(n)] followed by
+// u32 slots[n], where slots[s] is the item (namespace index, or entry index
+// relative to the namespace's first entry) that hashes to slot s. Names
+// are hashed with Hash64(name, namespace_seed), keys with
+// Hash64(key, NamespaceRecord::seed).
+//
+// Values are stored with their `${...}` references already evaluated
+// (references.h). The last refs_size bytes of a key block list the keys
+// of other namespaces that its values reference, as sorted `ns/key` lines
+// joined by '\n', so an incremental compile can tell whether a spliced
+// namespace's values are still current.
+//
+// A value block holds the namespace's decoded string values back to back.
+// In a namespace with compressed pages (page_count > 0), string values of
+// at least kPagedValueMin bytes live in pages instead: the plain values
+// are followed, at page_table_offset, by PageRecord[page_count], then
+// dictionary_size bytes of compression dictionary trained on the paged
+// values, then the compressed pages. Each page holds whole values,
+// decompresses on its own with the dictionary, and is referenced by
+// entries flagged kRecordPaged. A page is decompressed on demand the
+// first time a lookup touches it.
+//
+// A snapshot compiled against a schema (schema.h) starts with one
+// SchemaSlot per declared field, in schema order, holding a copy of the
+// field's value. The block sits at a fixed offset, so slot i is always at
+// SchemaSlotOffset(i) and generated accessors (codegen.h) read a field with
+// a single load at a compile-time constant offset. schema_hash identifies
+// the field list; it is 0 and the block empty when there is no schema. A
+// string field whose value is paged points at an uncompressed copy stored
+// after the last value block.
+//
+// All integers are little-endian. `checksum` is XXH64 (seed 0) over every
+// byte after the header.
+
+#ifndef CCC_SNAPSHOT_FORMAT_H_
+#define CCC_SNAPSHOT_FORMAT_H_
+
+#include <cstdint>
+
+#include "perfect_hash.h"
+
+namespace ccc {
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "snapshots are mapped in place and require a little-endian host"
+#endif
+
+inline constexpr uint32_t kSnapshotMagic = 0x53434343;  // "CCCS"
+inline constexpr uint32_t kSnapshotVersion = 6;
+
+// String values at least this long go to compressed pages, in namespaces
+// that have them.
+inline constexpr uint32_t kPagedValueMin = 64;
+// Uncompressed bytes per page. A value never spans pages, so a page that
+// starts with a longer value holds only that value.
+inline constexpr uint32_t kValuePageSize = 16 << 10;
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t file_size;
+  uint64_t checksum;
+  uint32_t namespace_count;
+  uint32_t entry_count;
+  uint64_t namespace_offset;
+  uint64_t entry_offset;
+  uint64_t index_offset;
+  uint64_t key_heap_offset;
+  uint64_t value_heap_offset;
+  uint32_t namespace_seed;
+  uint32_t schema_field_count;
+  uint64_t schema_hash;
+  uint64_t schema_offset;
+};
+static_assert(sizeof(SnapshotHeader) == 96, "SnapshotHeader layout");
+
+struct SchemaSlot {
+  // Inline payload as in EntryRecord, or for strings the absolute file
+  // offset of the value bytes.
+  uint64_t value;
+  uint32_t value_length;
+  uint32_t entry;  // Absolute index of the field's entry record.
+};
+static_assert(sizeof(SchemaSlot) == 16, "SchemaSlot layout");
+
+inline constexpr uint64_t SchemaSlotOffset(uint32_t field) {
+  return sizeof(SnapshotHeader) + uint64_t{field} * sizeof(SchemaSlot);
+}
+
+struct NamespaceRecord {
+  uint32_t name_offset;  // Into the key heap.
+  uint32_t name_length;
+  uint32_t first_entry;
+  uint32_t entry_count;
+  uint64_t index_offset;  // Absolute offset of this namespace's key table.
+  uint64_t key_offset;    // Key block, relative to the key heap.
+  uint64_t key_size;
+  uint64_t value_offset;  // Value block, relative to the value heap.
+  uint64_t value_size;
+  uint64_t content_hash;  // Hash64 of the namespace's source file.
+  uint32_t seed;          // Key hash seed.
+  uint32_t page_count;    // Compressed value pages; 0 if none.
+  uint64_t page_table_offset;  // Relative to the value block.
+  uint32_t dictionary_size;    // Follows the page table.
+  uint32_t flags;
+  uint32_t refs_size;  // Trailing bytes of the key block; see above.
+  uint32_t reserved;
+};
+static_assert(sizeof(NamespaceRecord) == 96, "NamespaceRecord layout");
+
+// NamespaceRecord flags.
+// Compiled with value compression, whether or not that produced pages. A
+// namespace's blocks can be reused only by a compile with the same setting.
+inline constexpr uint32_t kNamespaceCompressed = 1 << 0;
+
+struct PageRecord {
+  uint64_t offset;  // Compressed bytes, relative to the value block.
+  uint32_t compressed_size;
+  uint32_t raw_size;
+};
+static_assert(sizeof(PageRecord) == 16, "PageRecord layout");
+
+// EntryRecord flags.
+inline constexpr uint8_t kRecordPaged = 1 << 0;
+
+struct EntryRecord {
+  // Int, double and bool values are stored inline (bools as 0/1); string
+  // values hold their offset into the namespace's value block, or with
+  // kRecordPaged, page << 32 | offset into the uncompressed page.
+  uint64_t value;
+  uint32_t key_offset;  // Into the namespace's key block.
+  uint32_t key_length;
+  uint32_t value_length;  // String length; 8 for int/double, 1 for bool.
+  uint8_t type;           // ValueType.
+  uint8_t flags;
+  uint16_t reserved;
+};
+static_assert(sizeof(EntryRecord) == 24, "EntryRecord layout");
+
+// Size in bytes of a perfect hash table over `n` items.
+inline uint64_t IndexTableSize(uint32_t n) {
+  return 4 * (uint64_t{PerfectHashBuckets(n)} + n);
+}
+
+}  // namespace ccc
+
+#endif  // CCC_SNAPSHOT_FORMAT_H_
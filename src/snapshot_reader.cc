@@ -0,0 +1,65 @@
+#include "snapshot_reader.h"
+
+#include <utility>
+
+namespace ccc {
+
+SnapshotReader::~SnapshotReader() {
+  delete current_.load(std::memory_order_relaxed);
+  for (const Retired& r : retired_) delete r.snap;
+}
+
+SnapshotReader::Handle SnapshotReader::Acquire() const {
+  // Pin before loading the pointer; see EpochDomain::Guard.
+  EpochDomain::Guard guard = EpochDomain::Global().Pin();
+  const Snapshot* snap = current_.load(std::memory_order_seq_cst);
+  return Handle(std::move(guard), snap);
+}
+
+Status SnapshotReader::Load(const std::string& path) {
+  Snapshot snap;
+  CCC_RETURN_IF_ERROR(Snapshot::Open(path, &snap));
+  Status status = snap.Verify();
+  if (!status.ok()) return Status::Corrupt(path + ": " + status.message());
+  Publish(std::move(snap));
+  return Status::Ok();
+}
+
+void SnapshotReader::Publish(Snapshot snap) {
+  const Snapshot* fresh = new Snapshot(std::move(snap));
+  std::lock_guard<std::mutex> lock(writer_mu_);
+  const Snapshot* old = current_.exchange(fresh, std::memory_order_seq_cst);
+  generation_.fetch_add(1, std::memory_order_release);
+  if (old != nullptr) {
+    // A reader pinned at an earlier epoch may hold `old`; one pinned at
+    // this epoch or later loaded the pointer after the exchange.
+    retired_.push_back({old, EpochDomain::Global().Advance()});
+  }
+  ReclaimLocked();
+}
+
+void SnapshotReader::Reclaim() {
+  std::lock_guard<std::mutex> lock(writer_mu_);
+  ReclaimLocked();
+}
+
+void SnapshotReader::ReclaimLocked() {
+  if (retired_.empty()) return;
+  const uint64_t min_pinned = EpochDomain::Global().MinPinned();
+  size_t kept = 0;
+  for (const Retired& r : retired_) {
+    if (r.epoch <= min_pinned) {
+      delete r.snap;
+    } else {
+      retired_[kept++] = r;
+    }
+  }
+  retired_.resize(kept);
+}
+
+size_t SnapshotReader::retired_count() const {
+  std::lock_guard<std::mutex> lock(writer_mu_);
+  return retired_.size();
+}
+
+}  // namespace ccc
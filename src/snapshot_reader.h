@@ -0,0 +1,107 @@
+// Hot-swappable snapshot for long-running clients. A writer (typically a
+// reload thread) publishes a newly opened snapshot with one atomic pointer
+// exchange; readers acquire the current one without taking a lock or
+// waiting. A replaced snapshot stays mapped until every reader that could
+// have seen it has released its handle, and is then unmapped by a later
+// Publish() or Reclaim() (src/epoch.h).
+//
+//   ccc::SnapshotReader reader;
+//   reader.Load("/etc/config/current.snap");     // and again on change
+//   ...
+//   ccc::SnapshotReader::Handle snap = reader.Acquire();
+//   ccc::ValueRef v = snap->Find("payments", "db.port");
+
+#ifndef CCC_SNAPSHOT_READER_H_
+#define CCC_SNAPSHOT_READER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+#include "snapshot.h"
+#include "status.h"
+
+namespace ccc {
+
+class SnapshotReader {
+ public:
+  // A pinned snapshot. Valid (non-null) once anything has been published.
+  // Handles should be short-lived: a held handle delays unmapping every
+  // snapshot replaced after it was acquired, across all readers.
+  //
+  // A handle pins the thread that acquired it and must be released on
+  // that thread. It can be moved within the thread (returned, stored in a
+  // local), but not handed to another one; call Acquire() there instead.
+  // Debug builds assert this when the handle is released.
+  class Handle {
+   public:
+    Handle() = default;
+    Handle(Handle&&) = default;
+    Handle& operator=(Handle&&) = default;
+
+    const Snapshot* get() const { return snap_; }
+    const Snapshot& operator*() const { return *snap_; }
+    const Snapshot* operator->() const { return snap_; }
+    explicit operator bool() const { return snap_ != nullptr; }
+
+   private:
+    friend class SnapshotReader;
+    Handle(EpochDomain::Guard guard, const Snapshot* snap)
+        : guard_(std::move(guard)), snap_(snap) {}
+
+    EpochDomain::Guard guard_;
+    const Snapshot* snap_ = nullptr;
+  };
+
+  SnapshotReader() = default;
+  // Unmaps every snapshot. No handle may outlive the reader.
+  ~SnapshotReader();
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  // Lock-free: a few atomic operations and no allocation after the
+  // calling thread's first acquisition.
+  Handle Acquire() const;
+
+  // Opens and fully verifies `path`, then publishes it. On error the
+  // current snapshot stays in place.
+  Status Load(const std::string& path);
+
+  // Makes `snap` current. Writers serialize among themselves; readers
+  // are never blocked.
+  void Publish(Snapshot snap);
+
+  // Unmaps replaced snapshots that no reader can still see. Publish()
+  // does this too; call it periodically if publishes are rare and
+  // handles may be held across one.
+  void Reclaim();
+
+  // Number of Publish() calls so far.
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+  // Replaced snapshots still waiting for readers to move on.
+  size_t retired_count() const;
+
+ private:
+  struct Retired {
+    const Snapshot* snap;
+    uint64_t epoch;  // Freeable once no thread is pinned before it.
+  };
+
+  void ReclaimLocked();
+
+  std::atomic<const Snapshot*> current_{nullptr};
+  std::atomic<uint64_t> generation_{0};
+  mutable std::mutex writer_mu_;
+  std::vector<Retired> retired_;  // Guarded by writer_mu_.
+};
+
+}  // namespace ccc
+
+#endif  // CCC_SNAPSHOT_READER_H_
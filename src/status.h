@@ -0,0 +1,51 @@
+// Lightweight error propagation used throughout the compiler. Functions that
+// can fail return a Status; the hot paths never throw.
+
+#ifndef CCC_STATUS_H_
+#define CCC_STATUS_H_
+
+#include <string>
+#include <utility>
+
+namespace ccc {
+
+class Status {
+ public:
+  enum class Code { kOk, kInvalidArgument, kIoError, kParseError, kCorrupt };
+
+  Status() = default;
+
+  static Status Ok() { return Status(); }
+  static Status InvalidArgument(std::string msg) {
+    return Status(Code::kInvalidArgument, std::move(msg));
+  }
+  static Status IoError(std::string msg) {
+    return Status(Code::kIoError, std::move(msg));
+  }
+  static Status ParseError(std::string msg) {
+    return Status(Code::kParseError, std::move(msg));
+  }
+  static Status Corrupt(std::string msg) {
+    return Status(Code::kCorrupt, std::move(msg));
+  }
+
+  bool ok() const { return code_ == Code::kOk; }
+  Code code() const { return code_; }
+  const std::string& message() const { return message_; }
+
+ private:
+  Status(Code code, std::string msg) : code_(code), message_(std::move(msg)) {}
+
+  Code code_ = Code::kOk;
+  std::string message_;
+};
+
+#define CCC_RETURN_IF_ERROR(expr)                \
+  do {                                           \
+    ::ccc::Status _ccc_status = (expr);          \
+    if (!_ccc_status.ok()) return _ccc_status;   \
+  } while (0)
+
+}  // namespace ccc
+
+#endif  // CCC_STATUS_H_
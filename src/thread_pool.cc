@@ -0,0 +1,135 @@
+#include "thread_pool.h"
+
+#include <utility>
+
+namespace ccc {
+
+namespace {
+
+// Identifies the pool and queue of the current worker thread, so tasks that
+// submit more tasks keep them local.
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local unsigned tls_queue = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  for (unsigned i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  threads_.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mu_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& t : threads_) t.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  unsigned q = tls_pool == this
+                   ? tls_queue
+                   : next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                         queues_.size();
+  // Counted before it is published, so a worker that takes and finishes
+  // it at once never drives the count below zero.
+  pending_.fetch_add(1, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(queues_[q]->mu);
+    queues_[q]->tasks.push_back(std::move(task));
+  }
+  {
+    // Pairs with the predicate check in WorkerLoop so a worker that is
+    // about to sleep cannot miss this task.
+    std::lock_guard<std::mutex> lock(wake_mu_);
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::TryTake(unsigned self, std::function<void()>* task) {
+  const unsigned n = static_cast<unsigned>(queues_.size());
+  {
+    Queue& own = *queues_[self % n];
+    std::lock_guard<std::mutex> lock(own.mu);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  for (unsigned i = 1; i < n; ++i) {
+    Queue& victim = *queues_[(self + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mu);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned self) {
+  tls_pool = this;
+  tls_queue = self;
+  std::function<void()> task;
+  for (;;) {
+    if (TryTake(self, &task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(wake_mu_);
+    wake_.wait(lock, [this] {
+      return stop_ || pending_.load(std::memory_order_acquire) > 0;
+    });
+    if (stop_ && pending_.load(std::memory_order_acquire) == 0) return;
+  }
+}
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)>& fn) {
+  if (n == 0) return;
+  struct Group {
+    std::atomic<size_t> remaining;
+    std::mutex mu;
+    std::condition_variable done;
+  };
+  auto group = std::make_shared<Group>();
+  group->remaining.store(n, std::memory_order_relaxed);
+  for (size_t i = 0; i < n; ++i) {
+    Submit([group, &fn, i] {
+      fn(i);
+      if (group->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(group->mu);
+        group->done.notify_all();
+      }
+    });
+  }
+
+  // Help out rather than block; sleep only once nothing is left to take.
+  unsigned self = tls_pool == this ? tls_queue : 0;
+  std::function<void()> task;
+  while (group->remaining.load(std::memory_order_acquire) != 0) {
+    if (TryTake(self, &task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(group->mu);
+    group->done.wait(lock, [&] {
+      return group->remaining.load(std::memory_order_acquire) == 0;
+    });
+  }
+}
+
+}  // namespace ccc
@@ -0,0 +1,58 @@
+// Work-stealing thread pool. Each worker owns a deque: it pushes and pops
+// its own work at the back and, when idle, steals from the front of the
+// other workers' deques. Tasks submitted from outside the pool are dealt
+// round-robin across the deques.
+
+#ifndef CCC_THREAD_POOL_H_
+#define CCC_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ccc {
+
+class ThreadPool {
+ public:
+  // `threads` == 0 sizes the pool to the hardware concurrency.
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+  void Submit(std::function<void()> task);
+
+  // Runs fn(0) .. fn(n - 1) on the pool and returns when all have finished.
+  // The calling thread executes tasks too while it waits.
+  void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+ private:
+  struct Queue {
+    std::mutex mu;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void WorkerLoop(unsigned self);
+  // Pops from queue `self` (back) or steals from another (front).
+  bool TryTake(unsigned self, std::function<void()>* task);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<unsigned> next_queue_{0};
+  std::mutex wake_mu_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+};
+
+}  // namespace ccc
+
+#endif  // CCC_THREAD_POOL_H_
@@ -0,0 +1,145 @@
+#include "arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+// Fills each allocation with its own byte and checks that none of them
+// was overwritten by another.
+class Tracker {
+ public:
+  void Add(void* p, size_t n) {
+    const char fill = static_cast<char>(blocks_.size() * 37 + 1);
+    std::memset(p, fill, n);
+    blocks_.push_back({static_cast<char*>(p), n, fill});
+  }
+  bool Intact() const {
+    for (const Block& b : blocks_) {
+      for (size_t i = 0; i < b.size; ++i) {
+        if (b.data[i] != b.fill) return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  struct Block {
+    char* data;
+    size_t size;
+    char fill;
+  };
+  std::vector<Block> blocks_;
+};
+
+TEST(ArenaTest, Alignment) {
+  Arena arena(4096);
+  Tracker tracker;
+  for (size_t alignment : {1, 2, 4, 8, 16, 32, 64, 256, 4096}) {
+    for (size_t bytes : {1, 3, 8, 17, 100, 1000, 5000}) {
+      void* p = arena.Allocate(bytes, alignment);
+      ASSERT_TRUE(p != nullptr);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, uintptr_t{0})
+          << bytes << " bytes aligned to " << alignment;
+      tracker.Add(p, bytes);
+    }
+  }
+  EXPECT_TRUE(tracker.Intact());
+  EXPECT_EQ(arena.allocations(), uint64_t{9 * 7});
+}
+
+TEST(ArenaTest, GrowsByChunks) {
+  const size_t chunk = 1024;
+  Arena arena(chunk);
+  const uint64_t initial = arena.bytes_reserved();
+  EXPECT_GE(initial, uint64_t{chunk});
+  Tracker tracker;
+  // Well past one chunk, in pieces small enough to share chunks.
+  for (int i = 0; i < 100; ++i) tracker.Add(arena.Allocate(100), 100);
+  EXPECT_TRUE(tracker.Intact());
+  EXPECT_EQ(arena.allocations(), uint64_t{100});
+  EXPECT_EQ(arena.bytes_allocated(), uint64_t{100 * 100});
+  EXPECT_GE(arena.bytes_reserved(), uint64_t{100 * 100});
+  // Each chunk holds several allocations.
+  EXPECT_LT(arena.bytes_reserved(), uint64_t{50 * chunk});
+
+  // A large request gets a chunk of its own.
+  const uint64_t before = arena.bytes_reserved();
+  tracker.Add(arena.Allocate(10 * chunk), 10 * chunk);
+  EXPECT_GE(arena.bytes_reserved() - before, uint64_t{10 * chunk});
+  tracker.Add(arena.Allocate(8), 8);
+  EXPECT_TRUE(tracker.Intact());
+}
+
+TEST(ArenaTest, ResetKeepsOneChunk) {
+  Arena arena(1024);
+  for (int i = 0; i < 100; ++i) arena.Allocate(100);
+  arena.Allocate(1 << 20);
+  arena.Reset();
+  EXPECT_EQ(arena.allocations(), uint64_t{0});
+  EXPECT_EQ(arena.bytes_allocated(), uint64_t{0});
+  const uint64_t reserved = arena.bytes_reserved();
+  EXPECT_LT(reserved, uint64_t{2048});
+
+  // The kept chunk is reused from its start.
+  void* first = arena.Allocate(64);
+  arena.Allocate(64);
+  arena.Reset();
+  EXPECT_TRUE(arena.Allocate(64) == first);
+  EXPECT_EQ(arena.bytes_reserved(), reserved);
+}
+
+TEST(ArenaTest, BacksPmrContainers) {
+  Arena arena(4096);
+  std::pmr::vector<std::pmr::string> strings(&arena);
+  for (int i = 0; i < 1000; ++i) {
+    strings.emplace_back("a string long enough to leave SSO " +
+                         std::to_string(i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(std::string(strings[i]),
+              "a string long enough to leave SSO " + std::to_string(i));
+  }
+  EXPECT_TRUE(strings.get_allocator().resource() == &arena);
+  EXPECT_GT(arena.allocations(), uint64_t{1000});
+}
+
+TEST(ArenaTest, ConcurrentAllocation) {
+  Arena arena(4096);
+  constexpr int kThreads = 8;
+  constexpr int kPerThread = 5000;
+  std::vector<std::vector<char*>> blocks(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        // Mostly small, sometimes large enough for a chunk of its own.
+        const size_t n = i % 500 == 0 ? 2000 : 24;
+        char* p = static_cast<char*>(arena.Allocate(n, 8));
+        std::memset(p, t + 1, n);
+        blocks[t].push_back(p);
+      }
+    });
+  }
+  for (std::thread& t : threads) t.join();
+  for (int t = 0; t < kThreads; ++t) {
+    for (int i = 0; i < kPerThread; ++i) {
+      const size_t n = i % 500 == 0 ? 2000 : 24;
+      for (size_t j = 0; j < n; ++j) {
+        ASSERT_EQ(blocks[t][i][j], static_cast<char>(t + 1))
+            << "thread " << t << " block " << i;
+      }
+    }
+  }
+  EXPECT_EQ(arena.allocations(), uint64_t{kThreads * kPerThread});
+}
+
+}  // namespace
+}  // namespace ccc
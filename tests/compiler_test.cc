@@ -0,0 +1,164 @@
+#include "compiler.h"
+
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include "page_codec.h"
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteSources;
+
+// A namespace with short values of every type and enough long JSON values
+// to be paged when the codec is available.
+std::string Source(const std::string& name, int version) {
+  std::string out = "version = " + std::to_string(version) + "\n";
+  for (int i = 0; i < 300; ++i) {
+    const std::string n = std::to_string(i);
+    out += "flag." + n + " = " + (i % 2 ? "true" : "false") + "\n";
+    out += "ratio." + n + " = " + n + ".25\n";
+    out += "limits." + n + " = {\"service\": \"" + name +
+           "\", \"rps\": " + n + ", \"burst\": 50, \"region\": \"eu-west\"}\n";
+  }
+  return out;
+}
+
+class CompilerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    sources_ = {{"alpha", Source("alpha", 1)},
+                {"beta", Source("beta", 1)},
+                {"gamma", Source("gamma", 1)},
+                {"delta", Source("delta", 1)}};
+    WriteSources(dir_.path(), sources_);
+  }
+
+  // Compiles the sources as they are now with `base`, and again from
+  // scratch, and expects the two snapshots to be equal.
+  void ExpectIncrementalMatchesFull(const std::string& base,
+                                    CompileOptions options,
+                                    CompileStats* stats) {
+    options.base = base;
+    const std::string incremental = out_.Join("incremental.snap");
+    ASSERT_TRUE(CompileDir(dir_.path(), incremental, options, stats).ok());
+    options.base.clear();
+    const std::string full = out_.Join("full.snap");
+    ASSERT_TRUE(CompileDir(dir_.path(), full, options).ok());
+    EXPECT_TRUE(ReadFile(incremental) == ReadFile(full));
+  }
+
+  TempDir dir_;
+  TempDir out_;
+  std::map<std::string, std::string> sources_;
+};
+
+TEST_F(CompilerTest, IncrementalMatchesFull) {
+  const std::string base = out_.Join("base.snap");
+  ASSERT_TRUE(CompileDir(dir_.path(), base).ok());
+
+  WriteSources(dir_.path(), {{"beta", Source("beta", 2)}});
+  CompileStats stats;
+  ExpectIncrementalMatchesFull(base, CompileOptions(), &stats);
+  EXPECT_TRUE(stats.base_loaded);
+  EXPECT_EQ(stats.namespaces_reused, 3u);
+  EXPECT_EQ(stats.namespaces_compiled, 1u);
+
+  // Unchanged sources reuse everything.
+  ExpectIncrementalMatchesFull(out_.Join("full.snap"), CompileOptions(),
+                               &stats);
+  EXPECT_EQ(stats.namespaces_reused, 4u);
+  EXPECT_EQ(stats.namespaces_compiled, 0u);
+}
+
+TEST_F(CompilerTest, AddedAndRemovedNamespaces) {
+  const std::string base = out_.Join("base.snap");
+  ASSERT_TRUE(CompileDir(dir_.path(), base).ok());
+
+  std::filesystem::remove(dir_.Join("gamma.conf"));
+  WriteSources(dir_.path(), {{"epsilon", Source("epsilon", 1)}});
+  CompileStats stats;
+  ExpectIncrementalMatchesFull(base, CompileOptions(), &stats);
+  EXPECT_EQ(stats.namespaces_reused, 3u);
+  EXPECT_EQ(stats.namespaces_compiled, 1u);
+}
+
+TEST_F(CompilerTest, CompressionChangeForcesReparse) {
+  const std::string base = out_.Join("base.snap");
+  ASSERT_TRUE(CompileDir(dir_.path(), base).ok());
+
+  CompileOptions options;
+  options.compress = false;
+  CompileStats stats;
+  ExpectIncrementalMatchesFull(base, options, &stats);
+  if (PageCodecAvailable()) {
+    EXPECT_EQ(stats.namespaces_reused, 0u);
+    EXPECT_GT(ReadFile(out_.Join("full.snap")).size(),
+              ReadFile(base).size());
+  } else {
+    // Without the codec both settings produce the same blocks.
+    EXPECT_EQ(stats.namespaces_reused, 4u);
+  }
+
+  // And back again.
+  ExpectIncrementalMatchesFull(out_.Join("full.snap"), CompileOptions(),
+                               &stats);
+  EXPECT_EQ(stats.namespaces_reused, PageCodecAvailable() ? 0u : 4u);
+  EXPECT_TRUE(ReadFile(out_.Join("full.snap")) == ReadFile(base));
+}
+
+TEST_F(CompilerTest, OutputDoesNotDependOnThreads) {
+  CompileOptions options;
+  options.threads = 1;
+  CompileStats stats;
+  ASSERT_TRUE(
+      CompileDir(dir_.path(), out_.Join("1.snap"), options, &stats).ok());
+  EXPECT_EQ(stats.threads, 1u);
+  const std::string expected = ReadFile(out_.Join("1.snap"));
+  for (unsigned threads : {2u, 3u, 8u, 0u}) {
+    options.threads = threads;
+    const std::string path = out_.Join(std::to_string(threads) + ".snap");
+    ASSERT_TRUE(CompileDir(dir_.path(), path, options, &stats).ok());
+    if (threads != 0) {
+      EXPECT_EQ(stats.threads, threads);
+    }
+    EXPECT_TRUE(ReadFile(path) == expected) << threads << " threads";
+  }
+}
+
+TEST_F(CompilerTest, ElapsedCountsEachEmitOnce) {
+  CompileOptions options;
+  options.inputs = {dir_.path()};
+  options.output = out_.Join("out.snap");
+  Compiler compiler(options);
+  ASSERT_TRUE(compiler.Compile().ok());
+  const double compile = compiler.stats().elapsed;
+  ASSERT_TRUE(compiler.Emit().ok());
+  ASSERT_TRUE(compiler.Emit().ok());
+  const CompileStats& stats = compiler.stats();
+  EXPECT_GT(stats.times.emit, 0.0);
+  EXPECT_LT(std::abs(stats.elapsed - (compile + stats.times.emit)), 1e-9);
+}
+
+TEST_F(CompilerTest, BadBaseFallsBackToFullCompile) {
+  const std::string base = out_.Join("base.snap");
+  testing::WriteFile(base, "not a snapshot");
+  CompileStats stats;
+  ExpectIncrementalMatchesFull(base, CompileOptions(), &stats);
+  EXPECT_FALSE(stats.base_loaded);
+  EXPECT_EQ(stats.namespaces_reused, 0u);
+
+  ExpectIncrementalMatchesFull(out_.Join("missing.snap"), CompileOptions(),
+                               &stats);
+  EXPECT_FALSE(stats.base_loaded);
+}
+
+}  // namespace
+}  // namespace ccc
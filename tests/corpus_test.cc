@@ -0,0 +1,129 @@
+#include "corpus.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include "snapshot.h"
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+
+// Every file in `dir` by name.
+std::map<std::string, std::string> ReadDir(const std::string& dir) {
+  std::map<std::string, std::string> files;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    files[entry.path().filename().string()] = ReadFile(entry.path());
+  }
+  return files;
+}
+
+CorpusOptions SmallCorpus(uint32_t reference_percent) {
+  CorpusOptions options;
+  options.keys = 20000;
+  options.namespaces = 5;
+  options.seed = 7;
+  options.reference_percent = reference_percent;
+  return options;
+}
+
+// Generates `options` twice and expects identical files and stats.
+void ExpectDeterministic(const CorpusOptions& options) {
+  TempDir a;
+  TempDir b;
+  CorpusStats stats_a;
+  CorpusStats stats_b;
+  ASSERT_TRUE(GenerateCorpus(options, a.path(), &stats_a).ok());
+  ASSERT_TRUE(GenerateCorpus(options, b.path(), &stats_b).ok());
+  const std::map<std::string, std::string> files = ReadDir(a.path());
+  EXPECT_EQ(files.size(), size_t{options.namespaces});
+  EXPECT_TRUE(files == ReadDir(b.path()));
+  EXPECT_EQ(stats_a.keys, options.keys);
+  EXPECT_EQ(stats_a.keys, stats_b.keys);
+  EXPECT_EQ(stats_a.source_bytes, stats_b.source_bytes);
+  EXPECT_EQ(stats_a.references, stats_b.references);
+
+  // Regenerating over an existing corpus replaces it exactly.
+  ASSERT_TRUE(GenerateCorpus(options, a.path(), &stats_a).ok());
+  EXPECT_TRUE(files == ReadDir(a.path()));
+}
+
+// Generates and compiles `options`, and checks the snapshot holds every
+// key.
+void ExpectCompiles(const CorpusOptions& options) {
+  TempDir dir;
+  TempDir out;
+  CorpusStats corpus;
+  ASSERT_TRUE(GenerateCorpus(options, dir.path(), &corpus).ok());
+  CompileStats stats;
+  Status status =
+      CompileDir(dir.path(), out.Join("out.snap"), CompileOptions(), &stats);
+  ASSERT_TRUE(status.ok()) << status.message();
+  EXPECT_EQ(stats.entries, corpus.keys);
+  EXPECT_EQ(stats.source_bytes, corpus.source_bytes);
+  EXPECT_EQ(stats.templates > 0, corpus.references > 0);
+
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out.Join("out.snap"), &snap).ok());
+  status = snap.Verify();
+  EXPECT_TRUE(status.ok()) << status.message();
+  EXPECT_EQ(snap.namespace_count(), corpus.namespaces);
+}
+
+TEST(CorpusTest, SameSeedSameBytes) {
+  ExpectDeterministic(SmallCorpus(0));
+}
+
+TEST(CorpusTest, SameSeedSameBytesWithReferences) {
+  ExpectDeterministic(SmallCorpus(10));
+}
+
+TEST(CorpusTest, SeedChangesCorpus) {
+  TempDir a;
+  TempDir b;
+  CorpusStats stats;
+  CorpusOptions options = SmallCorpus(0);
+  ASSERT_TRUE(GenerateCorpus(options, a.path(), &stats).ok());
+  ++options.seed;
+  ASSERT_TRUE(GenerateCorpus(options, b.path(), &stats).ok());
+  EXPECT_FALSE(ReadDir(a.path()) == ReadDir(b.path()));
+}
+
+TEST(CorpusTest, ReferencesAreOptIn) {
+  TempDir dir;
+  CorpusStats stats;
+  ASSERT_TRUE(GenerateCorpus(SmallCorpus(0), dir.path(), &stats).ok());
+  EXPECT_EQ(stats.references, 0u);
+  ASSERT_TRUE(GenerateCorpus(SmallCorpus(10), dir.path(), &stats).ok());
+  EXPECT_GT(stats.references, 0u);
+  EXPECT_LT(stats.references, stats.keys / 5);
+}
+
+TEST(CorpusTest, CompilesCleanly) {
+  ExpectCompiles(SmallCorpus(0));
+}
+
+TEST(CorpusTest, CompilesCleanlyWithReferences) {
+  ExpectCompiles(SmallCorpus(10));
+}
+
+TEST(CorpusTest, DefaultNamespaces) {
+  CorpusOptions options;
+  options.keys = 1000;
+  EXPECT_EQ(CorpusNamespaces(options), 1u);
+  options.keys = 100000;
+  EXPECT_EQ(CorpusNamespaces(options), 10u);
+  options.keys = 100000000;
+  EXPECT_EQ(CorpusNamespaces(options), 256u);
+  options.namespaces = 3;
+  EXPECT_EQ(CorpusNamespaces(options), 3u);
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,320 @@
+#include "daemon.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "snapshot.h"
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::TempDir;
+using testing::WriteSources;
+
+class DaemonTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    WriteSources(dir_.path(), {{"app", "port = 1\n"}, {"db", "host = a\n"}});
+    options_.socket_path = dir_.Join("daemon.sock");
+    options_.compile.inputs = {dir_.path()};
+    options_.compile.output = dir_.Join("out.snap");
+  }
+
+  void TearDown() override {
+    if (serve_.joinable()) {
+      daemon_->Stop();
+      serve_.join();
+    }
+  }
+
+  // Starts serving on a thread, and returns once the socket accepts.
+  void Start() {
+    daemon_ = std::make_unique<CompileDaemon>(options_);
+    daemon_->set_batch_callback([this](const BatchStats& stats) {
+      std::unique_lock<std::mutex> lock(mu_);
+      batches_.push_back(stats);
+      batch_done_.notify_all();
+      // The callback runs on the write thread, so this holds up writing.
+      batch_done_.wait(lock, [&] { return !hold_writes_; });
+    });
+    serve_ = std::thread([this] { serve_status_ = daemon_->Serve(); });
+    for (int i = 0; i < 500; ++i) {
+      int fd = Connect();
+      if (fd >= 0) {
+        close(fd);
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(false) << "daemon did not start";
+  }
+
+  // Connects to the daemon without sending anything; -1 on failure. The
+  // daemon drops a connection that closes without a request.
+  int Connect() {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, options_.socket_path.c_str(),
+                 sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 &&
+        connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) !=
+            0) {
+      close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+
+  // Sends `request` and returns the connection, to read the reply from
+  // later. The daemon accepts connections in order and reads the ones it
+  // has before accepting more, so requests are handled in send order.
+  int Send(const std::string& request) {
+    int fd = Connect();
+    const std::string line = request + "\n";
+    if (fd >= 0 && send(fd, line.data(), line.size(), MSG_NOSIGNAL) !=
+                       static_cast<ssize_t>(line.size())) {
+      close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+
+  // Reads the reply line of a connection from Send() and closes it.
+  static std::string Reply(int fd) {
+    std::string reply;
+    char buf[256];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+      reply.append(buf, static_cast<size_t>(n));
+    }
+    close(fd);
+    if (!reply.empty() && reply.back() == '\n') reply.pop_back();
+    return reply;
+  }
+
+  // The batches reported so far, once there are at least `n`. Clients
+  // get their replies before the callback runs, so this has to wait.
+  std::vector<BatchStats> Batches(size_t n) {
+    std::unique_lock<std::mutex> lock(mu_);
+    batch_done_.wait_for(lock, std::chrono::seconds(30),
+                         [&] { return batches_.size() >= n; });
+    return batches_;
+  }
+
+  // Lets the write thread go on after HoldWrites().
+  void ReleaseWrites() {
+    std::lock_guard<std::mutex> lock(mu_);
+    hold_writes_ = false;
+    batch_done_.notify_all();
+  }
+
+  TempDir dir_;
+  DaemonOptions options_;
+  std::unique_ptr<CompileDaemon> daemon_;
+  std::thread serve_;
+  Status serve_status_;
+  std::mutex mu_;
+  std::condition_variable batch_done_;
+  std::vector<BatchStats> batches_;
+  // Set before Start() to stop the write thread after its first batch,
+  // until ReleaseWrites().
+  bool hold_writes_ = false;
+};
+
+TEST_F(DaemonTest, CoalescesBursts) {
+  options_.quiet_ms = 300;
+  options_.max_delay_ms = 10000;
+  Start();
+
+  std::string reply;
+  ASSERT_TRUE(
+      SendDaemonRequest(options_.socket_path, "publish app", &reply).ok());
+  EXPECT_EQ(reply, "ok 1");
+
+  const int a = Send("publish db");
+  const int b = Send("publish app db");
+  const int c = Send("publish");
+  ASSERT_GE(a, 0);
+  ASSERT_GE(b, 0);
+  ASSERT_GE(c, 0);
+  EXPECT_EQ(Reply(a), "ok 2");
+  EXPECT_EQ(Reply(b), "ok 2");
+  EXPECT_EQ(Reply(c), "ok 2");
+
+  std::vector<BatchStats> batches = Batches(2);
+  ASSERT_EQ(batches.size(), size_t{2});
+  EXPECT_EQ(batches[0].generation, 1u);
+  EXPECT_EQ(batches[0].requests, 1u);
+  EXPECT_EQ(batches[1].generation, 2u);
+  EXPECT_EQ(batches[1].requests, 3u);
+  EXPECT_TRUE(batches[1].namespaces ==
+              std::vector<std::string>({"app", "db"}));
+  EXPECT_TRUE(batches[1].status.ok());
+  // Nothing changed since the first snapshot.
+  EXPECT_EQ(batches[1].compile.namespaces_reused, 2u);
+
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(options_.compile.output, &snap).ok());
+  EXPECT_EQ(snap.Find("db", "host").string_value(), "a");
+}
+
+TEST_F(DaemonTest, PicksUpEdits) {
+  options_.quiet_ms = 10;
+  Start();
+  std::string reply;
+  ASSERT_TRUE(SendDaemonRequest(options_.socket_path, "publish", &reply).ok());
+  EXPECT_EQ(reply, "ok 1");
+  WriteSources(dir_.path(), {{"db", "host = b\n"}});
+  ASSERT_TRUE(
+      SendDaemonRequest(options_.socket_path, "publish db", &reply).ok());
+  EXPECT_EQ(reply, "ok 2");
+  std::vector<BatchStats> batches = Batches(2);
+  ASSERT_EQ(batches.size(), size_t{2});
+  EXPECT_EQ(batches[1].compile.namespaces_reused, 1u);
+  EXPECT_EQ(batches[1].compile.namespaces_compiled, 1u);
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(options_.compile.output, &snap).ok());
+  EXPECT_EQ(snap.Find("db", "host").string_value(), "b");
+}
+
+TEST_F(DaemonTest, SourcesChangeBeforeWrite) {
+  // A batch is compiled while the previous one is being written. Its
+  // sources may be rewritten before its own turn to be written comes; the
+  // snapshot must still be the one its sources compiled to.
+  options_.quiet_ms = 0;
+  hold_writes_ = true;
+  Start();
+  const int first = Send("publish");
+  ASSERT_GE(first, 0);
+  EXPECT_EQ(Reply(first), "ok 1");
+  Batches(1);
+
+  std::string before;
+  for (int i = 0; i < 2000; ++i) {
+    before += "key." + std::to_string(i) + " = 2\n";
+  }
+  WriteSources(dir_.path(), {{"app", before}});
+  const int second = Send("publish app");
+  ASSERT_GE(second, 0);
+  // Give the batch time to compile; it cannot be written yet.
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  {
+    // In place, breaking the key order...
+    std::fstream app(dir_.Join("app.conf"),
+                     std::ios::in | std::ios::out | std::ios::binary);
+    app.write("zzz", 3);
+  }
+  // ...then truncated and shorter, which drops the pages the old text was
+  // on.
+  WriteSources(dir_.path(), {{"app", "key.0 = 3\n"}});
+  ReleaseWrites();
+  EXPECT_EQ(Reply(second), "ok 2");
+
+  std::vector<BatchStats> batches = Batches(2);
+  ASSERT_EQ(batches.size(), size_t{2});
+  ASSERT_TRUE(batches[1].status.ok()) << batches[1].status.message();
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(options_.compile.output, &snap).ok());
+  Status status = snap.Verify();
+  EXPECT_TRUE(status.ok()) << status.message();
+  // Whichever text the batch read, the snapshot holds exactly that.
+  const CompileStats& compile = batches[1].compile;
+  ASSERT_EQ(compile.namespaces.size(), size_t{2});
+  ASSERT_EQ(compile.namespaces[0].name, "app");
+  if (compile.namespaces[0].source_bytes == before.size()) {
+    EXPECT_EQ(compile.namespaces[0].entries, 2000u);
+    for (int i = 0; i < 2000; ++i) {
+      EXPECT_EQ(snap.Find("app", "key." + std::to_string(i)).int_value(), 2);
+    }
+  } else {
+    EXPECT_EQ(compile.namespaces[0].entries, 1u);
+    EXPECT_EQ(snap.Find("app", "key.0").int_value(), 3);
+  }
+
+  std::string reply;
+  ASSERT_TRUE(
+      SendDaemonRequest(options_.socket_path, "publish app", &reply).ok());
+  EXPECT_EQ(reply, "ok 3");
+  ASSERT_TRUE(Snapshot::Open(options_.compile.output, &snap).ok());
+  EXPECT_EQ(snap.Find("app", "key.0").int_value(), 3);
+  EXPECT_FALSE(static_cast<bool>(snap.Find("app", "key.1")));
+}
+
+TEST_F(DaemonTest, ShutdownDrainsPendingBatches) {
+  // The batch would wait far longer than the test, unless shutdown
+  // flushes it.
+  options_.quiet_ms = 60000;
+  options_.max_delay_ms = 60000;
+  Start();
+
+  const int a = Send("publish app");
+  const int b = Send("publish db");
+  const int stop = Send("shutdown");
+  ASSERT_GE(a, 0);
+  ASSERT_GE(b, 0);
+  ASSERT_GE(stop, 0);
+  EXPECT_EQ(Reply(a), "ok 1");
+  EXPECT_EQ(Reply(b), "ok 1");
+  EXPECT_EQ(Reply(stop), "ok 1");
+  serve_.join();
+  EXPECT_TRUE(serve_status_.ok()) << serve_status_.message();
+
+  std::vector<BatchStats> batches = Batches(1);
+  ASSERT_EQ(batches.size(), size_t{1});
+  EXPECT_EQ(batches[0].requests, 2u);
+  EXPECT_EQ(batches[0].generation, 1u);
+  Snapshot snap;
+  EXPECT_TRUE(Snapshot::Open(options_.compile.output, &snap).ok());
+  // The socket is gone.
+  EXPECT_EQ(Connect(), -1);
+}
+
+TEST_F(DaemonTest, BadRequests) {
+  Start();
+  std::string reply;
+  ASSERT_TRUE(SendDaemonRequest(options_.socket_path, "frobnicate", &reply)
+                  .ok());
+  EXPECT_EQ(reply, "error unknown request 'frobnicate'");
+  ASSERT_TRUE(
+      SendDaemonRequest(options_.socket_path, "publish ../x", &reply).ok());
+  EXPECT_EQ(reply, "error invalid namespace name '../x'");
+
+  // A client that never finishes its request and never reads the reply
+  // does not hold up anyone else.
+  const int silent = Connect();
+  ASSERT_GE(silent, 0);
+  const std::string junk(2 << 20, 'x');
+  std::thread flood([&] {
+    send(silent, junk.data(), junk.size(), MSG_NOSIGNAL);
+  });
+  ASSERT_TRUE(SendDaemonRequest(options_.socket_path, "publish", &reply).ok());
+  EXPECT_EQ(reply, "ok 1");
+  shutdown(silent, SHUT_RDWR);
+  flood.join();
+  close(silent);
+}
+
+TEST_F(DaemonTest, RefusesSecondDaemon) {
+  Start();
+  CompileDaemon second(options_);
+  Status status = second.Serve();
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("another daemon"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace ccc
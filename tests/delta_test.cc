@@ -0,0 +1,218 @@
+#include "delta.h"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compiler.h"
+#include "page_codec.h"
+#include "snapshot.h"
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteFile;
+using testing::WriteSources;
+
+// Long JSON values, so namespaces are paged when the codec is available.
+std::string Values(const std::string& name, int from, int to) {
+  std::string out;
+  for (int i = from; i < to; ++i) {
+    const std::string n = std::to_string(i);
+    out += "limits." + n + " = {\"service\": \"" + name + "\", \"rps\": " +
+           n + ", \"burst\": 50, \"region\": \"eu-west\"}\n";
+    out += "port." + n + " = " + std::to_string(8000 + i) + "\n";
+  }
+  return out;
+}
+
+class DeltaTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    base_path_ = out_.Join("base.snap");
+    target_path_ = out_.Join("target.snap");
+    delta_path_ = out_.Join("delta");
+  }
+
+  // Compiles the base and target sources, makes the delta between them
+  // and expects applying it to the base to reproduce the target.
+  void ExpectRoundTrip(const std::map<std::string, std::string>& base,
+                       const std::map<std::string, std::string>& target,
+                       bool compress) {
+    CompileOptions options;
+    options.compress = compress;
+    TempDir base_dir;
+    TempDir target_dir;
+    WriteSources(base_dir.path(), base);
+    WriteSources(target_dir.path(), target);
+    ASSERT_TRUE(CompileDir(base_dir.path(), base_path_, options).ok());
+    ASSERT_TRUE(CompileDir(target_dir.path(), target_path_, options).ok());
+
+    Snapshot base_snap;
+    Snapshot target_snap;
+    ASSERT_TRUE(Snapshot::Open(base_path_, &base_snap).ok());
+    ASSERT_TRUE(Snapshot::Open(target_path_, &target_snap).ok());
+    ASSERT_TRUE(MakeDelta(base_snap, target_snap, delta_path_).ok());
+
+    const std::string applied = out_.Join("applied.snap");
+    Status status = ApplyDelta(base_snap, delta_path_, applied);
+    ASSERT_TRUE(status.ok()) << status.message();
+    EXPECT_TRUE(ReadFile(applied) == ReadFile(target_path_));
+  }
+
+  std::map<std::string, std::string> Sources() const {
+    return {{"app", "name = shop\nurl = \"http://${db/host}:${db/port}/\"\n" +
+                        Values("app", 0, 200)},
+            {"db", "host = db-1\nport = 5432\n" + Values("db", 0, 200)},
+            {"old", Values("old", 0, 50)}};
+  }
+
+  std::map<std::string, std::string> EditedSources() const {
+    return {{"app", "name = shop\nurl = \"http://${db/host}:${db/port}/\"\n" +
+                        Values("app", 0, 200)},
+            {"db", "host = db-2\nport = 5432\n" + Values("db", 10, 230)},
+            {"new", Values("new", 0, 50)}};
+  }
+
+  TempDir out_;
+  std::string base_path_;
+  std::string target_path_;
+  std::string delta_path_;
+};
+
+TEST_F(DeltaTest, RoundTrip) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  ExpectRoundTrip(EditedSources(), Sources(), false);
+  ExpectRoundTrip(Sources(), Sources(), false);
+  ExpectRoundTrip({{"a", "x = 1\n"}}, {{"b", "y = 2\n"}}, false);
+}
+
+TEST_F(DeltaTest, RoundTripCompressed) {
+  if (!PageCodecAvailable()) return;
+  ExpectRoundTrip(Sources(), EditedSources(), true);
+  ExpectRoundTrip(EditedSources(), Sources(), true);
+  ExpectRoundTrip(Sources(), Sources(), true);
+}
+
+TEST_F(DeltaTest, ApplyInPlace) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  Snapshot base;
+  ASSERT_TRUE(Snapshot::Open(base_path_, &base).ok());
+  ASSERT_TRUE(ApplyDelta(base, delta_path_, base_path_).ok());
+  EXPECT_TRUE(ReadFile(base_path_) == ReadFile(target_path_));
+  // The old mapping stays valid.
+  EXPECT_TRUE(base.VerifyChecksum().ok());
+}
+
+TEST_F(DeltaTest, ConcurrentAppliesToOneOutput) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  Snapshot base;
+  ASSERT_TRUE(Snapshot::Open(base_path_, &base).ok());
+  const std::string output = out_.Join("shared.snap");
+  std::vector<Status> results(8);
+  std::vector<std::thread> threads;
+  for (Status& result : results) {
+    threads.emplace_back(
+        [&] { result = ApplyDelta(base, delta_path_, output); });
+  }
+  for (std::thread& t : threads) t.join();
+  for (const Status& result : results) {
+    EXPECT_TRUE(result.ok()) << result.message();
+  }
+  EXPECT_TRUE(ReadFile(output) == ReadFile(target_path_));
+  // No temporary file is left behind.
+  size_t files = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(out_.path())) {
+    (void)entry;
+    ++files;
+  }
+  EXPECT_EQ(files, size_t{5});  // base, target, delta, applied, shared.
+}
+
+TEST_F(DeltaTest, CorruptDelta) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  Snapshot base;
+  ASSERT_TRUE(Snapshot::Open(base_path_, &base).ok());
+  const std::string delta = ReadFile(delta_path_);
+  const std::string output = out_.Join("corrupt.snap");
+
+  std::string flipped = delta;
+  flipped[delta.size() / 2] ^= 0x20;
+  WriteFile(delta_path_, flipped);
+  Status status = ApplyDelta(base, delta_path_, output);
+  EXPECT_EQ(status.code(), Status::Code::kCorrupt);
+  EXPECT_NE(status.message().find("checksum mismatch"), std::string::npos);
+
+  WriteFile(delta_path_, delta.substr(0, 20));
+  EXPECT_FALSE(ApplyDelta(base, delta_path_, output).ok());
+
+  WriteFile(delta_path_, std::string(sizeof(DeltaHeader) + 8, 'x'));
+  status = ApplyDelta(base, delta_path_, output);
+  EXPECT_NE(status.message().find("not a delta"), std::string::npos);
+
+  EXPECT_FALSE(std::filesystem::exists(output));
+}
+
+TEST_F(DeltaTest, CorruptHeader) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  Snapshot base;
+  ASSERT_TRUE(Snapshot::Open(base_path_, &base).ok());
+  const std::string delta = ReadFile(delta_path_);
+  const std::string output = out_.Join("corrupt.snap");
+
+  // The header is outside the body checksum, so its counts are checked on
+  // their own.
+  for (uint32_t count : {0x7fffffffu, 0xffffffffu, 4u, 0u}) {
+    std::string patched = delta;
+    std::memcpy(patched.data() + offsetof(DeltaHeader, namespace_count),
+                &count, sizeof(count));
+    WriteFile(delta_path_, patched);
+    Status status = ApplyDelta(base, delta_path_, output);
+    EXPECT_EQ(status.code(), Status::Code::kCorrupt) << count;
+    EXPECT_NE(status.message().find("malformed delta"), std::string::npos)
+        << count << ": " << status.message();
+  }
+  EXPECT_FALSE(std::filesystem::exists(output));
+}
+
+TEST_F(DeltaTest, CorruptBase) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  // Damage the base's body but keep its header, so the delta still names
+  // it as its base.
+  std::string bytes = ReadFile(base_path_);
+  bytes[bytes.size() - 1] ^= 0x01;
+  WriteFile(base_path_, bytes);
+  Snapshot base;
+  ASSERT_TRUE(Snapshot::Open(base_path_, &base).ok());
+  const std::string output = out_.Join("corrupt.snap");
+  Status status = ApplyDelta(base, delta_path_, output);
+  EXPECT_EQ(status.code(), Status::Code::kCorrupt);
+  EXPECT_NE(status.message().find("base snapshot: checksum mismatch"),
+            std::string::npos)
+      << status.message();
+  EXPECT_FALSE(std::filesystem::exists(output));
+}
+
+TEST_F(DeltaTest, WrongBase) {
+  ExpectRoundTrip(Sources(), EditedSources(), false);
+  Snapshot target;
+  ASSERT_TRUE(Snapshot::Open(target_path_, &target).ok());
+  const std::string output = out_.Join("wrong.snap");
+  Status status = ApplyDelta(target, delta_path_, output);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("made against another base"),
+            std::string::npos);
+  EXPECT_FALSE(std::filesystem::exists(output));
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,67 @@
+#include "lexer.h"
+
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+std::vector<Token> LexAll(std::string_view source) {
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  for (;;) {
+    Token tok = lexer.Next();
+    tokens.push_back(tok);
+    if (tok.kind == TokenKind::kEnd || tok.kind == TokenKind::kError) break;
+  }
+  return tokens;
+}
+
+std::string FirstError(std::string_view source) {
+  std::vector<Token> tokens = LexAll(source);
+  const Token& last = tokens.back();
+  return last.kind == TokenKind::kError ? last.error : "";
+}
+
+TEST(LexerTest, Assignments) {
+  std::vector<Token> t = LexAll("a = 1\n# note\nb=\"x\\ty\"\r\nc =  \n");
+  ASSERT_EQ(t.size(), 14u);
+  EXPECT_EQ(t[0].kind, TokenKind::kKey);
+  EXPECT_EQ(t[0].text, "a");
+  EXPECT_EQ(t[1].kind, TokenKind::kAssign);
+  EXPECT_EQ(t[2].kind, TokenKind::kRaw);
+  EXPECT_EQ(t[2].text, "1");
+  EXPECT_EQ(t[3].kind, TokenKind::kNewline);
+  EXPECT_EQ(t[4].kind, TokenKind::kNewline);  // After the comment.
+  EXPECT_EQ(t[5].text, "b");
+  EXPECT_EQ(t[5].line, 3u);
+  EXPECT_EQ(t[7].kind, TokenKind::kString);
+  EXPECT_EQ(t[7].text, "x\\ty");
+  EXPECT_TRUE(t[7].has_escapes);
+  EXPECT_EQ(t[8].kind, TokenKind::kNewline);
+  EXPECT_EQ(t[11].kind, TokenKind::kRaw);  // An empty value.
+  EXPECT_EQ(t[11].text, "");
+  EXPECT_EQ(t[12].kind, TokenKind::kNewline);
+  EXPECT_EQ(t[13].kind, TokenKind::kEnd);
+}
+
+TEST(LexerTest, KeyWithoutAssignment) {
+  EXPECT_EQ(FirstError("foo\nbar\n"), "expected '=' after key");
+  EXPECT_EQ(FirstError("a = 1\nlonely"), "expected '=' after key");
+  EXPECT_EQ(FirstError("foo\r\nbar = 1\n"), "expected '=' after key");
+  EXPECT_EQ(FirstError("foo bar = 1\n"), "expected '=' after key");
+}
+
+TEST(LexerTest, Errors) {
+  EXPECT_EQ(FirstError("=1\n"), "expected key");
+  EXPECT_EQ(FirstError("a = \"open\n"), "unterminated string");
+  EXPECT_EQ(FirstError("a = \"open"), "unterminated string");
+  EXPECT_EQ(FirstError("a = \"\\q\"\n"), "unknown escape sequence");
+  EXPECT_EQ(FirstError("a = \"\\u12\"\n"), "malformed \\u escape");
+  EXPECT_EQ(FirstError("a = \"x\" y\n"), "unexpected characters after value");
+}
+
+}  // namespace
+}  // namespace ccc
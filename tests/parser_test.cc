@@ -0,0 +1,70 @@
+#include "parser.h"
+
+#include <memory_resource>
+#include <string>
+
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+Status Parse(std::string_view source, std::pmr::vector<Entry>* entries) {
+  return ParseSource(source, "a.conf", entries);
+}
+
+TEST(ParserTest, TypesAndOrder) {
+  std::pmr::vector<Entry> entries;
+  ASSERT_TRUE(Parse("z = \"q\"\ny = 42\nx = -1.5e3\nw = true\nv = 1x\n"
+                    "u = 99999999999999999999\n",
+                    &entries)
+                  .ok());
+  ASSERT_EQ(entries.size(), 6u);
+  EXPECT_EQ(entries[0].key, "u");
+  EXPECT_EQ(entries[0].type, ValueType::kString);  // Overflows int64.
+  EXPECT_EQ(entries[1].type, ValueType::kString);
+  EXPECT_EQ(entries[2].type, ValueType::kBool);
+  EXPECT_EQ(entries[3].type, ValueType::kDouble);
+  EXPECT_EQ(entries[4].type, ValueType::kInt);
+  EXPECT_EQ(entries[4].line, 2u);
+  EXPECT_EQ(entries[5].type, ValueType::kString);
+  EXPECT_EQ(entries[5].value, "q");
+}
+
+TEST(ParserTest, KeyWithoutAssignmentIsAnError) {
+  std::pmr::vector<Entry> entries;
+  Status status = Parse("foo\nbar\nlonely", &entries);
+  ASSERT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "a.conf:1: expected '=' after key");
+
+  status = Parse("a = 1\nlonely", &entries);
+  ASSERT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "a.conf:2: expected '=' after key");
+}
+
+TEST(ParserTest, Errors) {
+  std::pmr::vector<Entry> entries;
+  Status status = Parse("a = 1\nb = 2\na = 3\n", &entries);
+  ASSERT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("duplicate key 'a'"), std::string::npos);
+
+  status = Parse("a = \"\xff\"\n", &entries);
+  ASSERT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "a.conf:1: invalid UTF-8");
+
+  status = Parse("a = 1\n = 2\n", &entries);
+  ASSERT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "a.conf:2: expected key");
+}
+
+TEST(ParserTest, ClassifyRaw) {
+  EXPECT_EQ(ClassifyRaw("0"), ValueType::kInt);
+  EXPECT_EQ(ClassifyRaw("-7"), ValueType::kInt);
+  EXPECT_EQ(ClassifyRaw("0.25"), ValueType::kDouble);
+  EXPECT_EQ(ClassifyRaw("false"), ValueType::kBool);
+  EXPECT_EQ(ClassifyRaw("inf"), ValueType::kString);
+  EXPECT_EQ(ClassifyRaw("-"), ValueType::kString);
+  EXPECT_EQ(ClassifyRaw(""), ValueType::kString);
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,90 @@
+#include "perfect_hash.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+// Checks that `slots` is a permutation of [0, n) and that every hash maps
+// to the slot holding it.
+void ExpectPerfect(const std::pmr::vector<uint64_t>& hashes,
+                   const std::pmr::vector<uint32_t>& displacements,
+                   const std::pmr::vector<uint32_t>& slots) {
+  const uint32_t n = static_cast<uint32_t>(hashes.size());
+  ASSERT_EQ(slots.size(), hashes.size());
+  ASSERT_EQ(displacements.size(), size_t{PerfectHashBuckets(n)});
+  std::vector<bool> seen(n, false);
+  for (uint32_t s = 0; s < n; ++s) {
+    ASSERT_LT(slots[s], n);
+    EXPECT_FALSE(seen[slots[s]]) << "slot " << s;
+    seen[slots[s]] = true;
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t s = PerfectHashSlot(hashes[i], displacements.data(),
+                                 PerfectHashBuckets(n), n);
+    ASSERT_LT(s, n);
+    EXPECT_EQ(slots[s], i) << "hash " << i;
+  }
+}
+
+TEST(PerfectHashTest, EveryHashFindsItsSlot) {
+  std::mt19937_64 rng(7);
+  for (uint32_t n : {1u, 2u, 3u, 4u, 10u, 97u, 1000u, 100000u}) {
+    std::pmr::vector<uint64_t> hashes(n);
+    for (uint64_t& h : hashes) h = rng();
+    std::pmr::vector<uint32_t> displacements;
+    std::pmr::vector<uint32_t> slots;
+    ASSERT_TRUE(BuildPerfectHash(hashes, &displacements, &slots)) << n;
+    ExpectPerfect(hashes, displacements, slots);
+  }
+}
+
+TEST(PerfectHashTest, Deterministic) {
+  std::pmr::vector<uint64_t> hashes;
+  for (uint64_t i = 0; i < 5000; ++i) {
+    hashes.push_back(Hash64("k" + std::to_string(i)));
+  }
+  std::pmr::vector<uint32_t> d1, s1, d2, s2;
+  ASSERT_TRUE(BuildPerfectHash(hashes, &d1, &s1));
+  ASSERT_TRUE(BuildPerfectHash(hashes, &d2, &s2));
+  EXPECT_TRUE(d1 == d2);
+  EXPECT_TRUE(s1 == s2);
+}
+
+TEST(PerfectHashTest, DuplicateHashesFail) {
+  std::pmr::vector<uint64_t> hashes = {1, 2, 3, 2};
+  std::pmr::vector<uint32_t> displacements;
+  std::pmr::vector<uint32_t> slots;
+  EXPECT_FALSE(BuildPerfectHash(hashes, &displacements, &slots));
+}
+
+TEST(PerfectHashTest, IndexTableResolvesEveryKey) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; ++i) {
+    keys.push_back("svc." + std::to_string(i % 37) + ".key" +
+                   std::to_string(i));
+  }
+  IndexTable table;
+  std::pmr::vector<uint64_t> hashes;
+  ASSERT_TRUE(BuildIndexTable(
+      static_cast<uint32_t>(keys.size()),
+      [&](uint32_t i) { return std::string_view(keys[i]); }, &hashes,
+      &table));
+  const uint32_t n = static_cast<uint32_t>(keys.size());
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t s = PerfectHashSlot(Hash64(keys[i], table.seed),
+                                 table.displacements.data(),
+                                 PerfectHashBuckets(n), n);
+    ASSERT_EQ(table.slots[s], i) << keys[i];
+  }
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,156 @@
+#include "references.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include "compiler.h"
+#include "snapshot.h"
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteSources;
+
+class ReferencesTest : public testing::Test {
+ protected:
+  // Compiles `sources` and opens the result into snap_.
+  Status Compile(const std::map<std::string, std::string>& sources,
+                 CompileStats* stats = nullptr,
+                 const std::string& base = std::string()) {
+    WriteSources(dir_.path(), sources);
+    CompileOptions options;
+    options.base = base;
+    const std::string path = out_.Join("out.snap");
+    Status status = CompileDir(dir_.path(), path, options, stats);
+    if (!status.ok()) return status;
+    return Snapshot::Open(path, &snap_);
+  }
+
+  // The error of compiling `sources`, or "" if it succeeds.
+  std::string CompileError(const std::map<std::string, std::string>& sources) {
+    Status status = Compile(sources);
+    return status.ok() ? std::string() : status.message();
+  }
+
+  TempDir dir_;
+  TempDir out_;
+  Snapshot snap_;
+};
+
+TEST_F(ReferencesTest, Interpolation) {
+  Status status = Compile(
+      {{"db", "host = db-1\nport = 5432\nratio = 0.1\nssl = true\n"
+              "name = \"caf\\u00e9\"\n"},
+       {"app", "url = \"postgres://${db/host}:${db/port}/${db/name}\"\n"
+               "local = ${url}\n"
+               "chain = ${local}/x\n"
+               "escaped = $${db/host} costs $$5\n"}});
+  ASSERT_TRUE(status.ok()) << status.message();
+  EXPECT_EQ(snap_.Find("app", "url").string_value(),
+            "postgres://db-1:5432/caf\xc3\xa9");
+  EXPECT_EQ(snap_.Find("app", "local").string_value(),
+            "postgres://db-1:5432/caf\xc3\xa9");
+  EXPECT_EQ(snap_.Find("app", "chain").string_value(),
+            "postgres://db-1:5432/caf\xc3\xa9/x");
+  EXPECT_EQ(snap_.Find("app", "escaped").string_value(),
+            "${db/host} costs $$5");
+}
+
+TEST_F(ReferencesTest, RawValuesAreTypedAfterInterpolation) {
+  Status status = Compile(
+      {{"db", "port = 5432\nratio = 0.1\nssl = true\nhost = db-1\n"},
+       {"app", "port = ${db/port}\n"
+               "quoted = \"${db/port}\"\n"
+               "ratio = ${db/ratio}\n"
+               "ssl = ${db/ssl}\n"
+               "joined = ${db/port}${db/port}\n"
+               "mixed = ${db/host}:${db/port}\n"
+               "exp = ${db/port}e2\n"}});
+  ASSERT_TRUE(status.ok()) << status.message();
+  EXPECT_EQ(snap_.Find("app", "port").type(), ValueType::kInt);
+  EXPECT_EQ(snap_.Find("app", "port").int_value(), 5432);
+  EXPECT_EQ(snap_.Find("app", "quoted").type(), ValueType::kString);
+  EXPECT_EQ(snap_.Find("app", "quoted").string_value(), "5432");
+  EXPECT_EQ(snap_.Find("app", "ratio").type(), ValueType::kDouble);
+  EXPECT_EQ(snap_.Find("app", "ratio").double_value(), 0.1);
+  EXPECT_EQ(snap_.Find("app", "ssl").type(), ValueType::kBool);
+  EXPECT_TRUE(snap_.Find("app", "ssl").bool_value());
+  EXPECT_EQ(snap_.Find("app", "joined").int_value(), 54325432);
+  EXPECT_EQ(snap_.Find("app", "mixed").string_value(), "db-1:5432");
+  EXPECT_EQ(snap_.Find("app", "exp").type(), ValueType::kDouble);
+  EXPECT_EQ(snap_.Find("app", "exp").double_value(), 543200.0);
+}
+
+TEST_F(ReferencesTest, SelfReference) {
+  std::string error = CompileError({{"app", "x = 1\na = ${a}\n"}});
+  EXPECT_NE(error.find("app.conf:2: reference cycle: app/a -> app/a"),
+            std::string::npos)
+      << error;
+}
+
+TEST_F(ReferencesTest, CycleAcrossNamespaces) {
+  std::string error = CompileError(
+      {{"one", "a = ${two/b}\n"}, {"two", "b = x${one/a}\n"}});
+  EXPECT_NE(error.find("reference cycle: "), std::string::npos) << error;
+  EXPECT_NE(error.find("one/a"), std::string::npos) << error;
+  EXPECT_NE(error.find("two/b"), std::string::npos) << error;
+
+  // A longer cycle inside one namespace, behind a value that is fine.
+  error = CompileError(
+      {{"one", "ok = ${a}\na = ${b}\nb = ${c}\nc = ${a}\n"}});
+  EXPECT_NE(error.find("reference cycle: "), std::string::npos) << error;
+}
+
+TEST_F(ReferencesTest, UndefinedAndMalformedReferences) {
+  std::string error = CompileError({{"app", "a = 1\nb = ${missing}\n"}});
+  EXPECT_NE(error.find("app.conf:2: undefined reference ${missing}"),
+            std::string::npos)
+      << error;
+  error = CompileError({{"app", "b = ${nowhere/key}\n"}});
+  EXPECT_NE(error.find("undefined reference ${nowhere/key}"),
+            std::string::npos)
+      << error;
+  error = CompileError({{"app", "b = ${unterminated\n"}});
+  EXPECT_NE(error.find("malformed reference"), std::string::npos) << error;
+}
+
+TEST_F(ReferencesTest, IncrementalCompileOfReferencedNamespace) {
+  std::map<std::string, std::string> sources = {
+      {"db", "host = db-1\nport = 5432\nunused = 1\n"},
+      {"app", "url = \"${db/host}:${db/port}\"\n"},
+      {"other", "x = 1\n"}};
+  ASSERT_TRUE(Compile(sources).ok());
+  const std::string base = out_.Join("base.snap");
+  std::filesystem::rename(out_.Join("out.snap"), base);
+
+  // Only db changes, in a value app references: app is recompiled even
+  // though its own source did not change.
+  sources["db"] = "host = db-2\nport = 5432\nunused = 1\n";
+  CompileStats stats;
+  Status status = Compile(sources, &stats, base);
+  ASSERT_TRUE(status.ok()) << status.message();
+  EXPECT_EQ(snap_.Find("app", "url").string_value(), "db-2:5432");
+  EXPECT_EQ(stats.namespaces_stale, 1u);
+  EXPECT_EQ(stats.namespaces_reused, 1u);
+  EXPECT_EQ(stats.namespaces_compiled, 2u);
+  const std::string incremental = ReadFile(out_.Join("out.snap"));
+  ASSERT_TRUE(Compile(sources).ok());
+  EXPECT_TRUE(incremental == ReadFile(out_.Join("out.snap")));
+
+  // A change to a value nobody references leaves app reused.
+  std::filesystem::rename(out_.Join("out.snap"), base);
+  sources["db"] = "host = db-2\nport = 5432\nunused = 2\n";
+  ASSERT_TRUE(Compile(sources, &stats, base).ok());
+  EXPECT_EQ(stats.namespaces_stale, 0u);
+  EXPECT_EQ(stats.namespaces_reused, 2u);
+  EXPECT_EQ(snap_.Find("app", "url").string_value(), "db-2:5432");
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,311 @@
+#include "report.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteSources;
+
+// Just enough of a strict JSON parser to check the reports: the whole
+// grammar, with numbers kept as doubles.
+struct Json {
+  enum class Kind { kNull, kBool, kNumber, kString, kArray, kObject };
+  Kind kind = Kind::kNull;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<Json> array;
+  std::map<std::string, Json> object;
+
+  const Json& operator[](const std::string& key) const {
+    static const Json null;
+    auto it = object.find(key);
+    return it == object.end() ? null : it->second;
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view text) : text_(text) {}
+
+  // False unless all of the text is one JSON value.
+  bool Parse(Json* out) {
+    if (!Value(out)) return false;
+    Space();
+    return pos_ == text_.size();
+  }
+
+ private:
+  void Space() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\n' ||
+            text_[pos_] == '\t' || text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(std::string_view token) {
+    if (text_.substr(pos_, token.size()) != token) return false;
+    pos_ += token.size();
+    return true;
+  }
+
+  bool Value(Json* out) {
+    Space();
+    if (pos_ == text_.size()) return false;
+    const char c = text_[pos_];
+    if (c == '{') return Object(out);
+    if (c == '[') return Array(out);
+    if (c == '"') {
+      out->kind = Json::Kind::kString;
+      return String(&out->string);
+    }
+    if (Consume("true")) {
+      out->kind = Json::Kind::kBool;
+      out->boolean = true;
+      return true;
+    }
+    if (Consume("false")) {
+      out->kind = Json::Kind::kBool;
+      return true;
+    }
+    if (Consume("null")) return true;
+    return Number(out);
+  }
+
+  bool Object(Json* out) {
+    out->kind = Json::Kind::kObject;
+    ++pos_;
+    Space();
+    if (Consume("}")) return true;
+    for (;;) {
+      Space();
+      std::string key;
+      if (pos_ == text_.size() || text_[pos_] != '"' || !String(&key)) {
+        return false;
+      }
+      Space();
+      if (!Consume(":")) return false;
+      if (out->object.count(key) != 0) return false;
+      if (!Value(&out->object[key])) return false;
+      Space();
+      if (Consume("}")) return true;
+      if (!Consume(",")) return false;
+    }
+  }
+
+  bool Array(Json* out) {
+    out->kind = Json::Kind::kArray;
+    ++pos_;
+    Space();
+    if (Consume("]")) return true;
+    for (;;) {
+      out->array.emplace_back();
+      if (!Value(&out->array.back())) return false;
+      Space();
+      if (Consume("]")) return true;
+      if (!Consume(",")) return false;
+    }
+  }
+
+  bool Number(Json* out) {
+    const size_t start = pos_;
+    Consume("-");
+    if (!Consume("0") && !Digits()) return false;
+    if (Consume(".") && !Digits()) return false;
+    if (Consume("e") || Consume("E")) {
+      if (!Consume("+")) Consume("-");
+      if (!Digits()) return false;
+    }
+    out->kind = Json::Kind::kNumber;
+    out->number =
+        std::strtod(std::string(text_.substr(start, pos_ - start)).c_str(),
+                    nullptr);
+    return true;
+  }
+
+  bool Digits() {
+    const size_t start = pos_;
+    while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+      ++pos_;
+    }
+    return pos_ > start;
+  }
+
+  // Decodes to UTF-8. Surrogate pairs are not needed here and rejected.
+  bool String(std::string* out) {
+    ++pos_;
+    while (pos_ < text_.size()) {
+      const unsigned char c = static_cast<unsigned char>(text_[pos_++]);
+      if (c == '"') return true;
+      if (c < 0x20) return false;
+      if (c != '\\') {
+        *out += static_cast<char>(c);
+        continue;
+      }
+      if (pos_ == text_.size()) return false;
+      const char e = text_[pos_++];
+      switch (e) {
+        case '"': case '\\': case '/': *out += e; break;
+        case 'b': *out += '\b'; break;
+        case 'f': *out += '\f'; break;
+        case 'n': *out += '\n'; break;
+        case 'r': *out += '\r'; break;
+        case 't': *out += '\t'; break;
+        case 'u': {
+          if (pos_ + 4 > text_.size()) return false;
+          const std::string hex(text_.substr(pos_, 4));
+          char* end;
+          const unsigned long u = std::strtoul(hex.c_str(), &end, 16);
+          if (end != hex.c_str() + 4 || (u >= 0xD800 && u <= 0xDFFF)) {
+            return false;
+          }
+          pos_ += 4;
+          if (u < 0x80) {
+            *out += static_cast<char>(u);
+          } else if (u < 0x800) {
+            *out += static_cast<char>(0xC0 | (u >> 6));
+            *out += static_cast<char>(0x80 | (u & 0x3F));
+          } else {
+            *out += static_cast<char>(0xE0 | (u >> 12));
+            *out += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+            *out += static_cast<char>(0x80 | (u & 0x3F));
+          }
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  std::string_view text_;
+  size_t pos_ = 0;
+};
+
+// Expects `stages` to hold exactly `names`, each a finite, non-negative
+// number of seconds.
+void ExpectStages(const Json& stages, const std::vector<std::string>& names) {
+  ASSERT_TRUE(stages.kind == Json::Kind::kObject);
+  EXPECT_EQ(stages.object.size(), names.size());
+  for (const std::string& name : names) {
+    const Json& t = stages[name];
+    ASSERT_TRUE(t.kind == Json::Kind::kNumber) << name;
+    EXPECT_TRUE(std::isfinite(t.number)) << name;
+    EXPECT_GE(t.number, 0.0) << name;
+  }
+}
+
+class ReportTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(dir_.path().empty());
+    src_ = dir_.Join("src");
+    std::filesystem::create_directory(src_);
+    WriteSources(src_, {{"app", "name = checkout\nport = 8080\n"
+                                "url = http://${app/name}:${app/port}/\n"},
+                        {"db", "host = db.internal\n"}});
+  }
+
+  // Compiles the sources into `output`, writes the report and parses it.
+  void CompileWithReport(const std::string& output, Json* report) {
+    CompileStats stats;
+    Status status = CompileDir(src_, output, CompileOptions(), &stats);
+    ASSERT_TRUE(status.ok()) << status.message();
+    const std::string path = dir_.Join("report.json");
+    ASSERT_TRUE(WriteCompileReport(path, output, stats).ok());
+    const std::string json = ReadFile(path);
+    ASSERT_TRUE(JsonParser(json).Parse(report)) << json;
+  }
+
+  TempDir dir_;
+  std::string src_;
+};
+
+TEST_F(ReportTest, StagesAndCounts) {
+  Json report;
+  CompileWithReport(dir_.Join("out.snap"), &report);
+  ASSERT_TRUE(report.kind == Json::Kind::kObject);
+  EXPECT_EQ(report["output"].string, dir_.Join("out.snap"));
+  EXPECT_GE(report["elapsed_seconds"].number, 0.0);
+  EXPECT_GE(report["threads"].number, 1.0);
+  EXPECT_FALSE(report["base_loaded"].boolean);
+  EXPECT_EQ(report["namespaces_compiled"].number, 2.0);
+  EXPECT_EQ(report["entries"].number, 4.0);
+  EXPECT_EQ(report["templates"].number, 1.0);
+  EXPECT_GT(report["output_bytes"].number, 0.0);
+  EXPECT_GT(report["allocations"]["count"].number, 0.0);
+  ExpectStages(report["stage_seconds"],
+               {"read", "lex", "parse", "validate", "index", "compress",
+                "resolve", "emit"});
+
+  const Json& namespaces = report["namespace_stats"];
+  ASSERT_TRUE(namespaces.kind == Json::Kind::kArray);
+  ASSERT_EQ(namespaces.array.size(), 2u);
+  EXPECT_EQ(namespaces.array[0]["name"].string, "app");
+  EXPECT_EQ(namespaces.array[0]["entries"].number, 3.0);
+  EXPECT_EQ(namespaces.array[1]["name"].string, "db");
+  for (const Json& ns : namespaces.array) {
+    EXPECT_FALSE(ns["reused"].boolean);
+    ExpectStages(ns["stage_seconds"], {"read", "lex", "parse", "validate",
+                                       "index", "compress"});
+  }
+}
+
+TEST_F(ReportTest, EscapesPaths) {
+  // Quotes, backslashes, control characters and non-ASCII text survive a
+  // round trip.
+  const std::string odd = "we\"ird\\name\tcaf\xc3\xa9";
+  std::filesystem::create_directory(dir_.Join(odd));
+  const std::string output = dir_.Join(odd) + "/out.snap";
+  Json report;
+  CompileWithReport(output, &report);
+  EXPECT_EQ(report["output"].string, output);
+}
+
+TEST_F(ReportTest, ReplacesMalformedUtf8) {
+  CompileStats stats;
+  const std::string json =
+      CompileReportJson("a\xff" "b\xe2\x82" "c", stats);
+  Json report;
+  ASSERT_TRUE(JsonParser(json).Parse(&report)) << json;
+  EXPECT_EQ(report["output"].string,
+            "a\xef\xbf\xbd" "b\xef\xbf\xbd\xef\xbf\xbd" "c");
+  EXPECT_EQ(report["namespace_stats"].array.size(), 0u);
+}
+
+TEST_F(ReportTest, ReusedNamespaces) {
+  const std::string base = dir_.Join("base.snap");
+  ASSERT_TRUE(CompileDir(src_, base).ok());
+  CompileOptions options;
+  options.base = base;
+  CompileStats stats;
+  ASSERT_TRUE(
+      CompileDir(src_, dir_.Join("out.snap"), options, &stats).ok());
+  Json report;
+  const std::string json = CompileReportJson(dir_.Join("out.snap"), stats);
+  ASSERT_TRUE(JsonParser(json).Parse(&report)) << json;
+  EXPECT_TRUE(report["base_loaded"].boolean);
+  EXPECT_EQ(report["namespaces_reused"].number, 2.0);
+  for (const Json& ns : report["namespace_stats"].array) {
+    EXPECT_TRUE(ns["reused"].boolean);
+  }
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,237 @@
+#include "schema.h"
+
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include "codegen.h"
+#include "mapped_file.h"
+#include "page_codec.h"
+#include "snapshot.h"
+#include "snapshot_format.h"
+#include "test.h"
+#include "test_util.h"
+
+// Generated at build time from tests/testdata/schema by the codegen
+// command.
+#include "test_app_config.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteFile;
+using testing::WriteSources;
+
+// Long enough to be paged when the codec is available.
+std::string Banner() {
+  std::string out;
+  for (int i = 0; i < 40; ++i) {
+    out += "{\"line\": " + std::to_string(i) + ", \"text\": \"welcome\"} ";
+  }
+  return out;
+}
+
+// Sources defining every field of tests/testdata/schema, plus filler that
+// the schema does not mention.
+std::map<std::string, std::string> Sources() {
+  std::string app = "banner = " + Banner() + "\n" +
+                    "feature.enabled = true\n"
+                    "name = checkout\n"
+                    "ratio = 0.75\n"
+                    "retries = 3\n";
+  for (int i = 0; i < 400; ++i) {
+    const std::string n = std::to_string(i);
+    app += "limits." + n + " = {\"service\": \"checkout\", \"rps\": " + n +
+           ", \"burst\": 50, \"region\": \"eu-west\"}\n";
+  }
+  return {{"app", app},
+          {"db", "host = db.internal\npool = 8\nport = 5432\n"}};
+}
+
+class SchemaTest : public testing::Test {
+ protected:
+  void SetUp() override { WriteSources(dir_.path(), Sources()); }
+
+  // Compiles the sources against the test schema and returns the status.
+  Status Compile() {
+    CompileOptions options;
+    options.schemas = {CCC_TEST_SCHEMA_DIR};
+    return CompileDir(dir_.path(), out_.Join("out.snap"), options);
+  }
+
+  TempDir dir_;
+  TempDir out_;
+};
+
+TEST_F(SchemaTest, LoadsSortedFields) {
+  Schema schema;
+  ASSERT_TRUE(LoadSchema({CCC_TEST_SCHEMA_DIR}, &schema).ok());
+  ASSERT_EQ(schema.fields.size(), 7u);
+  EXPECT_EQ(schema.fields[0].ns, "app");
+  EXPECT_EQ(schema.fields[0].key, "banner");
+  EXPECT_TRUE(schema.fields[1].type == ValueType::kBool);
+  EXPECT_EQ(schema.fields[6].ns, "db");
+  EXPECT_EQ(schema.fields[6].key, "port");
+  EXPECT_TRUE(schema.fields[6].type == ValueType::kInt);
+  EXPECT_EQ(SchemaHash(schema), test::AppConfig::kSchemaHash);
+}
+
+TEST_F(SchemaTest, RejectsMissingField) {
+  WriteSources(dir_.path(), {{"db", "host = db.internal\n"}});
+  Status status = Compile();
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "schema field db/port is not defined");
+}
+
+TEST_F(SchemaTest, RejectsMissingNamespace) {
+  std::filesystem::remove(dir_.Join("db.conf"));
+  Status status = Compile();
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "schema field db/host is not defined");
+}
+
+TEST_F(SchemaTest, RejectsMistypedField) {
+  WriteSources(dir_.path(), {{"db", "host = db.internal\nport = 54.32\n"}});
+  Status status = Compile();
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(status.message(),
+            "schema field db/port is declared int but defined as double");
+}
+
+TEST_F(SchemaTest, RejectsUnknownTypesAndNames) {
+  TempDir schemas;
+  Schema schema;
+  WriteFile(schemas.Join("db.schema"), "port = integer\n");
+  Status status = LoadSchema({schemas.path()}, &schema);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("unknown type 'integer'"),
+            std::string::npos) << status.message();
+
+  schema.fields = {{"db", "port", ValueType::kInt},
+                   {"db", "port", ValueType::kString}};
+  status = NormalizeSchema(&schema);
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(status.message(), "schema declares db/port twice");
+
+  schema.fields = {{"Bad Namespace", "port", ValueType::kInt}};
+  EXPECT_FALSE(NormalizeSchema(&schema).ok());
+}
+
+TEST_F(SchemaTest, SlotsMatchFind) {
+  ASSERT_TRUE(Compile().ok());
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_.Join("out.snap"), &snap).ok());
+  ASSERT_TRUE(snap.Verify().ok());
+
+  Schema schema;
+  ReadSchema(snap, &schema);
+  Schema declared;
+  ASSERT_TRUE(LoadSchema({CCC_TEST_SCHEMA_DIR}, &declared).ok());
+  ASSERT_EQ(schema.fields.size(), declared.fields.size());
+  for (size_t i = 0; i < schema.fields.size(); ++i) {
+    EXPECT_EQ(schema.fields[i].ns, declared.fields[i].ns);
+    EXPECT_EQ(schema.fields[i].key, declared.fields[i].key);
+  }
+
+  // Every slot at its constant offset holds what a lookup finds.
+  const std::string image = ReadFile(out_.Join("out.snap"));
+  for (uint32_t i = 0; i < declared.fields.size(); ++i) {
+    const SchemaField& field = declared.fields[i];
+    ValueRef value = snap.Find(field.ns, field.key);
+    ASSERT_TRUE(static_cast<bool>(value)) << field.ns << "/" << field.key;
+    SchemaSlot slot;
+    std::memcpy(&slot, image.data() + SchemaSlotOffset(i), sizeof(slot));
+    switch (field.type) {
+      case ValueType::kString:
+        EXPECT_EQ(image.substr(slot.value, slot.value_length),
+                  std::string(value.string_value()));
+        break;
+      case ValueType::kInt:
+        EXPECT_EQ(static_cast<int64_t>(slot.value), value.int_value());
+        break;
+      case ValueType::kDouble: {
+        double d;
+        std::memcpy(&d, &slot.value, sizeof(d));
+        EXPECT_EQ(d, value.double_value());
+        break;
+      }
+      case ValueType::kBool:
+        EXPECT_EQ(slot.value != 0, value.bool_value());
+        break;
+    }
+  }
+}
+
+TEST_F(SchemaTest, GeneratedAccessorsReadSnapshot) {
+  ASSERT_TRUE(Compile().ok());
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_.Join("out.snap"), &snap).ok());
+  MappedFile file;
+  ASSERT_TRUE(MappedFile::Open(out_.Join("out.snap"), &file).ok());
+
+  test::AppConfig config;
+  ASSERT_TRUE(
+      test::AppConfig::Bind(file.data().data(), file.data().size(), &config));
+  EXPECT_TRUE(config.bound());
+  EXPECT_EQ(config.app_banner(), snap.Find("app", "banner").string_value());
+  EXPECT_EQ(config.app_banner(), Banner().substr(0, Banner().size() - 1));
+  // Paged string fields are read from their uncompressed copy.
+  EXPECT_EQ((snap.Find("app", "banner").record()->flags & kRecordPaged) != 0,
+            PageCodecAvailable());
+  EXPECT_TRUE(config.app_feature_enabled());
+  EXPECT_EQ(config.app_name(), "checkout");
+  EXPECT_EQ(config.app_ratio(), 0.75);
+  EXPECT_EQ(config.app_retries(), 3);
+  EXPECT_EQ(config.db_host(), "db.internal");
+  EXPECT_EQ(config.db_port(), 5432);
+}
+
+TEST_F(SchemaTest, GeneratedAccessorsRejectOtherSnapshots) {
+  // No schema.
+  ASSERT_TRUE(CompileDir(dir_.path(), out_.Join("plain.snap")).ok());
+  const std::string plain = ReadFile(out_.Join("plain.snap"));
+  test::AppConfig config;
+  EXPECT_FALSE(test::AppConfig::Bind(plain.data(), plain.size(), &config));
+
+  // A different schema.
+  TempDir schemas;
+  WriteFile(schemas.Join("db.schema"), "port = int\n");
+  CompileOptions options;
+  options.schemas = {schemas.path()};
+  ASSERT_TRUE(CompileDir(dir_.path(), out_.Join("other.snap"), options).ok());
+  const std::string other = ReadFile(out_.Join("other.snap"));
+  EXPECT_FALSE(test::AppConfig::Bind(other.data(), other.size(), &config));
+
+  // The right schema, but a truncated image.
+  ASSERT_TRUE(Compile().ok());
+  const std::string image = ReadFile(out_.Join("out.snap"));
+  EXPECT_FALSE(test::AppConfig::Bind(image.data(), image.size() - 1, &config));
+  EXPECT_FALSE(config.bound());
+  EXPECT_TRUE(test::AppConfig::Bind(image.data(), image.size(), &config));
+}
+
+TEST_F(SchemaTest, GeneratedHeaderIsCurrent) {
+  // The header compiled into this test matches what codegen emits now.
+  Schema schema;
+  ASSERT_TRUE(LoadSchema({CCC_TEST_SCHEMA_DIR}, &schema).ok());
+  CodegenOptions options;
+  options.output = out_.Join("test_app_config.h");
+  options.cpp_namespace = "ccc::test";
+  options.class_name = "AppConfig";
+  ASSERT_TRUE(GenerateAccessors(schema, options).ok());
+  EXPECT_TRUE(ReadFile(options.output) == ReadFile(CCC_TEST_APP_CONFIG));
+
+  // Names of the generated class's own members are taken.
+  options.class_name = "Load";
+  EXPECT_FALSE(GenerateAccessors(schema, options).ok());
+  options.class_name = "AppConfig";
+  options.cpp_namespace = "ccc::9bad";
+  EXPECT_FALSE(GenerateAccessors(schema, options).ok());
+}
+
+}  // namespace
+}  // namespace ccc
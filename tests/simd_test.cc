@@ -0,0 +1,192 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+// Every level this CPU supports, scalar first.
+std::vector<const SimdKernels*> Levels() {
+  std::vector<const SimdKernels*> levels;
+  for (SimdLevel level :
+       {SimdLevel::kScalar, SimdLevel::kSse42, SimdLevel::kAvx2}) {
+    if (const SimdKernels* k = GetSimdKernels(level)) levels.push_back(k);
+  }
+  return levels;
+}
+
+// Offsets around the 16-, 32- and 64-byte block boundaries of the kernels.
+const size_t kOffsets[] = {0,  1,  14, 15, 16, 17, 30, 31, 32,
+                           33, 47, 62, 63, 64, 65, 95, 127, 128};
+
+struct Utf8Case {
+  const char* name;
+  std::string bytes;
+  bool valid;
+};
+
+const Utf8Case kUtf8Cases[] = {
+    {"ascii", "abc", true},
+    {"two bytes", "\xC3\xA9", true},
+    {"three bytes", "\xE2\x82\xAC", true},
+    {"four bytes", "\xF0\x9F\x98\x80", true},
+    {"max code point", "\xF4\x8F\xBF\xBF", true},
+    {"last before surrogates", "\xED\x9F\xBF", true},
+    {"first after surrogates", "\xEE\x80\x80", true},
+    {"overlong two bytes", "\xC0\xAF", false},
+    {"overlong C1", "\xC1\xBF", false},
+    {"overlong three bytes", "\xE0\x80\xAF", false},
+    {"overlong four bytes", "\xF0\x80\x80\xAF", false},
+    {"surrogate low", "\xED\xA0\x80", false},
+    {"surrogate high", "\xED\xBF\xBF", false},
+    {"above U+10FFFF", "\xF4\x90\x80\x80", false},
+    {"F5 lead", "\xF5\x80\x80\x80", false},
+    {"FF byte", "\xFF", false},
+    {"lone continuation", "\x80", false},
+    {"truncated two bytes", "\xC3", false},
+    {"truncated three bytes", "\xE2\x82", false},
+    {"truncated four bytes", "\xF0\x9F\x98", false},
+    {"bad continuation", "\xE2\x28\xA1", false},
+    {"too many continuations", "\xC3\xA9\xA9", false},
+};
+
+TEST(SimdTest, ValidUtf8) {
+  for (const SimdKernels* k : Levels()) {
+    const char* level = SimdLevelName(k->level);
+    for (const Utf8Case& c : kUtf8Cases) {
+      for (size_t offset : kOffsets) {
+        // Inside the text, and at its very end.
+        for (size_t tail : {size_t{0}, size_t{1}, size_t{40}}) {
+          std::string text =
+              std::string(offset, 'a') + c.bytes + std::string(tail, 'b');
+          EXPECT_EQ(k->valid_utf8(text.data(), text.size()), c.valid)
+              << level << ": " << c.name << " at " << offset << ", tail "
+              << tail;
+          if (!c.valid) {
+            EXPECT_EQ(Utf8ErrorOffset(text) >= offset, true) << c.name;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(SimdTest, ValidUtf8MatchesScalarOnRandomText) {
+  const std::vector<const SimdKernels*> levels = Levels();
+  std::mt19937 rng(3);
+  // Mostly valid text with occasional damage, so both outcomes occur.
+  const std::string pieces[] = {"a", "\xC3\xA9", "\xE2\x82\xAC",
+                                "\xF0\x9F\x98\x80", " "};
+  for (int round = 0; round < 2000; ++round) {
+    std::string text;
+    const int n = static_cast<int>(rng() % 60);
+    for (int i = 0; i < n; ++i) text += pieces[rng() % 5];
+    if (!text.empty() && rng() % 2) {
+      text[rng() % text.size()] = static_cast<char>(rng());
+    }
+    const bool expected = levels[0]->valid_utf8(text.data(), text.size());
+    EXPECT_EQ(expected, Utf8ErrorOffset(text) == text.size());
+    for (const SimdKernels* k : levels) {
+      EXPECT_EQ(k->valid_utf8(text.data(), text.size()), expected)
+          << SimdLevelName(k->level) << " round " << round;
+    }
+  }
+}
+
+// Runs every scanning kernel of `k` over `text` and expects the results
+// of `scalar`.
+void ExpectScansMatch(const SimdKernels& k, const SimdKernels& scalar,
+                      const std::string& text, const std::string& what) {
+  const char* begin = text.data();
+  const char* end = begin + text.size();
+  const char* level = SimdLevelName(k.level);
+  EXPECT_EQ(k.count_newlines(begin, text.size()),
+            scalar.count_newlines(begin, text.size()))
+      << level << ": " << what;
+  EXPECT_EQ(k.find_quote_or_escape(begin, end) - begin,
+            scalar.find_quote_or_escape(begin, end) - begin)
+      << level << ": " << what;
+  EXPECT_EQ(k.skip_key_chars(begin, end) - begin,
+            scalar.skip_key_chars(begin, end) - begin)
+      << level << ": " << what;
+
+  std::string got(text.size(), '\0');
+  std::string want(text.size(), '\0');
+  char* got_out = got.data();
+  char* want_out = want.data();
+  EXPECT_EQ(k.copy_until_backslash(begin, end, &got_out) - begin,
+            scalar.copy_until_backslash(begin, end, &want_out) - begin)
+      << level << ": " << what;
+  const size_t copied = static_cast<size_t>(want_out - want.data());
+  EXPECT_EQ(static_cast<size_t>(got_out - got.data()), copied)
+      << level << ": " << what;
+  EXPECT_TRUE(got.compare(0, copied, want, 0, copied) == 0)
+      << level << ": " << what;
+}
+
+TEST(SimdTest, ScansMatchScalarAtBlockBoundaries) {
+  const std::vector<const SimdKernels*> levels = Levels();
+  const SimdKernels& scalar = *levels[0];
+  for (size_t length : {size_t{0}, size_t{1}, size_t{15}, size_t{16},
+                        size_t{17}, size_t{31}, size_t{32}, size_t{33},
+                        size_t{63}, size_t{64}, size_t{65}, size_t{130}}) {
+    const std::string plain(length, 'k');
+    for (const SimdKernels* k : levels) {
+      ExpectScansMatch(*k, scalar, plain, "plain " + std::to_string(length));
+    }
+    for (char special : {'"', '\\', '\n', ' ', '=', '\x80'}) {
+      for (size_t offset : kOffsets) {
+        if (offset >= length) continue;
+        std::string text = plain;
+        text[offset] = special;
+        // A second special character later must not be found first.
+        if (offset + 20 < length) text[offset + 20] = '"';
+        const std::string what = "byte " + std::to_string(special) + " at " +
+                                 std::to_string(offset) + " of " +
+                                 std::to_string(length);
+        for (const SimdKernels* k : levels) {
+          ExpectScansMatch(*k, scalar, text, what);
+        }
+      }
+    }
+  }
+}
+
+TEST(SimdTest, ScalarScansAreCorrect) {
+  const SimdKernels& scalar = *GetSimdKernels(SimdLevel::kScalar);
+  const std::string text = "db.host-1_x = \"a\\\"b\"\n\nc";
+  const char* begin = text.data();
+  const char* end = begin + text.size();
+  EXPECT_EQ(scalar.count_newlines(begin, text.size()), size_t{2});
+  EXPECT_EQ(scalar.skip_key_chars(begin, end) - begin, 11);
+  EXPECT_EQ(scalar.find_quote_or_escape(begin, end) - begin, 14);
+  std::string out(text.size(), '\0');
+  char* p = out.data();
+  EXPECT_EQ(scalar.copy_until_backslash(begin, end, &p) - begin, 16);
+  EXPECT_EQ(std::string(out.data(), p), text.substr(0, 16));
+}
+
+TEST(SimdTest, ScansMatchScalarOnRandomText) {
+  const std::vector<const SimdKernels*> levels = Levels();
+  std::mt19937 rng(5);
+  const char alphabet[] = "abcXYZ019_.-\"\\\n =\x80\xC3";
+  for (int round = 0; round < 2000; ++round) {
+    std::string text(rng() % 150, 'a');
+    // Sparse specials, so the kernels scan whole blocks before a hit.
+    for (char& c : text) {
+      if (rng() % 40 == 0) c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    for (const SimdKernels* k : levels) {
+      ExpectScansMatch(*k, *levels[0], text, "round " + std::to_string(round));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace ccc
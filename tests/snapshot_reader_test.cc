@@ -0,0 +1,218 @@
+#include "snapshot_reader.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::TempDir;
+using testing::WriteSources;
+
+constexpr int kSnapshots = 4;
+constexpr int kKeys = 64;
+
+class SnapshotReaderTest : public testing::Test {
+ protected:
+  // Compiles snapshot `g` of kSnapshots, where every key holds `g`.
+  void SetUp() override {
+    ASSERT_FALSE(dir_.path().empty());
+    for (int g = 0; g < kSnapshots; ++g) {
+      const std::string src = dir_.Join("src" + std::to_string(g));
+      std::filesystem::create_directory(src);
+      std::string app;
+      for (int i = 0; i < kKeys; ++i) {
+        app += "key." + std::to_string(i) + " = " + std::to_string(g) + "\n";
+      }
+      WriteSources(src, {{"app", app}});
+      ASSERT_TRUE(CompileDir(src, Path(g)).ok());
+    }
+  }
+
+  std::string Path(int g) const {
+    return dir_.Join(std::to_string(g) + ".snap");
+  }
+
+  // Whether this process still has snapshot `g` mapped.
+  bool Mapped(int g) const {
+    std::ifstream maps("/proc/self/maps");
+    const std::string path = std::filesystem::canonical(Path(g)).string();
+    std::string line;
+    while (std::getline(maps, line)) {
+      if (line.size() >= path.size() &&
+          line.compare(line.size() - path.size(), path.size(), path) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static int64_t Version(const SnapshotReader::Handle& snap) {
+    return snap->Find("app", "key.0").int_value();
+  }
+
+  TempDir dir_;
+};
+
+TEST_F(SnapshotReaderTest, EmptyUntilLoaded) {
+  SnapshotReader reader;
+  EXPECT_FALSE(static_cast<bool>(reader.Acquire()));
+  EXPECT_EQ(reader.generation(), 0u);
+  EXPECT_FALSE(reader.Load(dir_.Join("missing.snap")).ok());
+  EXPECT_FALSE(static_cast<bool>(reader.Acquire()));
+  ASSERT_TRUE(reader.Load(Path(0)).ok());
+  EXPECT_EQ(reader.generation(), 1u);
+  EXPECT_EQ(Version(reader.Acquire()), 0);
+}
+
+TEST_F(SnapshotReaderTest, HeldHandleKeepsOldGeneration) {
+  SnapshotReader reader;
+  ASSERT_TRUE(reader.Load(Path(0)).ok());
+  SnapshotReader::Handle old = reader.Acquire();
+  ASSERT_TRUE(reader.Load(Path(1)).ok());
+  EXPECT_EQ(reader.generation(), 2u);
+
+  // The held handle still reads the snapshot it pinned; a new one sees
+  // the replacement.
+  EXPECT_EQ(Version(old), 0);
+  EXPECT_EQ(Version(reader.Acquire()), 1);
+  for (int i = 0; i < kKeys; ++i) {
+    EXPECT_EQ(old->Find("app", "key." + std::to_string(i)).int_value(), 0);
+  }
+  EXPECT_EQ(reader.retired_count(), 1u);
+}
+
+TEST_F(SnapshotReaderTest, RetiredFreedAfterLastHandle) {
+  SnapshotReader reader;
+  ASSERT_TRUE(reader.Load(Path(0)).ok());
+  SnapshotReader::Handle first = reader.Acquire();
+  SnapshotReader::Handle second = reader.Acquire();
+  ASSERT_TRUE(reader.Load(Path(1)).ok());
+  ASSERT_TRUE(reader.Load(Path(2)).ok());
+
+  // Snapshot 1 was replaced after the handles were pinned, so it waits
+  // for them as well.
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 2u);
+  EXPECT_TRUE(Mapped(0));
+  EXPECT_TRUE(Mapped(1));
+
+  first = SnapshotReader::Handle();
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 2u);
+  EXPECT_TRUE(Mapped(0));
+  EXPECT_EQ(Version(second), 0);
+
+  second = SnapshotReader::Handle();
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 0u);
+  EXPECT_FALSE(Mapped(0));
+  EXPECT_FALSE(Mapped(1));
+  EXPECT_TRUE(Mapped(2));
+}
+
+TEST_F(SnapshotReaderTest, HandleOnAnotherThreadDelaysReclaim) {
+  SnapshotReader reader;
+  ASSERT_TRUE(reader.Load(Path(0)).ok());
+
+  std::mutex mu;
+  std::condition_variable cv;
+  bool pinned = false;
+  bool release = false;
+  int64_t seen = -1;
+  std::thread holder([&] {
+    SnapshotReader::Handle snap = reader.Acquire();
+    std::unique_lock<std::mutex> lock(mu);
+    pinned = true;
+    cv.notify_all();
+    cv.wait(lock, [&] { return release; });
+    seen = Version(snap);
+  });
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&] { return pinned; });
+  }
+
+  ASSERT_TRUE(reader.Load(Path(1)).ok());
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 1u);
+  EXPECT_TRUE(Mapped(0));
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    release = true;
+  }
+  cv.notify_all();
+  holder.join();
+  EXPECT_EQ(seen, 0);
+
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 0u);
+  EXPECT_FALSE(Mapped(0));
+}
+
+// Meant to be run under ThreadSanitizer (and AddressSanitizer, which
+// catches a read from an unmapped snapshot): readers acquire and read
+// every key while a writer cycles through the snapshots.
+TEST_F(SnapshotReaderTest, ReadersRaceWriter) {
+  SnapshotReader reader;
+  ASSERT_TRUE(reader.Load(Path(0)).ok());
+
+  constexpr int kReaders = 4;
+  constexpr int kLoads = 200;
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+  std::atomic<uint64_t> reads{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < kReaders; ++t) {
+    readers.emplace_back([&] {
+      uint64_t generation = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        // Generations never go backwards for a reader.
+        const uint64_t before = reader.generation();
+        if (before < generation) ++torn;
+        generation = before;
+        SnapshotReader::Handle snap = reader.Acquire();
+        // Every key of one snapshot holds the same value.
+        const int64_t version = Version(snap);
+        for (int i = 0; i < kKeys; ++i) {
+          ValueRef v = snap->Find("app", "key." + std::to_string(i));
+          if (!v || v.int_value() != version) ++torn;
+        }
+        reads.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  // Start once every reader is running.
+  while (reads.load(std::memory_order_relaxed) < kReaders) {
+    std::this_thread::yield();
+  }
+  for (int i = 1; i <= kLoads; ++i) {
+    Status status = reader.Load(Path(i % kSnapshots));
+    EXPECT_TRUE(status.ok()) << status.message();
+    if (!status.ok()) break;
+    if (i % 16 == 0) reader.Reclaim();
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : readers) t.join();
+
+  EXPECT_EQ(torn.load(), 0);
+  EXPECT_GT(reads.load(), 0u);
+  EXPECT_EQ(reader.generation(), uint64_t{kLoads + 1});
+  EXPECT_EQ(Version(reader.Acquire()), kLoads % kSnapshots);
+  reader.Reclaim();
+  EXPECT_EQ(reader.retired_count(), 0u);
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,178 @@
+#include "snapshot.h"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+#include "hash.h"
+#include "page_codec.h"
+#include "snapshot_format.h"
+#include "test_util.h"
+
+namespace ccc {
+namespace {
+
+using testing::CompileDir;
+using testing::ReadFile;
+using testing::TempDir;
+using testing::WriteFile;
+using testing::WriteSources;
+
+class SnapshotTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(dir_.path().empty());
+    src_ = dir_.Join("src");
+    std::filesystem::create_directory(src_);
+    std::string big;
+    for (int i = 0; i < 5000; ++i) {
+      big += "key." + std::to_string(i) + " = " + std::to_string(i * 7) +
+             "\n";
+    }
+    WriteSources(src_, {{"app", "name = \"caf\\u00e9\\n\"\nport = 8080\n"
+                                "ratio = 0.25\nenabled = false\n"
+                                "raw = hello world\nempty =\n"},
+                        {"big", big}});
+    out_ = dir_.Join("out.snap");
+    ASSERT_TRUE(CompileDir(src_, out_).ok());
+  }
+
+  // Rewrites the snapshot's checksum to match its body, so that a
+  // corruption gets past VerifyChecksum() and has to be found by Verify().
+  void FixChecksum() {
+    std::string bytes = ReadFile(out_);
+    SnapshotHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    header.checksum = Hash64(std::string_view(bytes).substr(sizeof(header)));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    WriteFile(out_, bytes);
+  }
+
+  TempDir dir_;
+  std::string src_;
+  std::string out_;
+};
+
+TEST_F(SnapshotTest, RoundTrip) {
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_, &snap).ok());
+  ASSERT_TRUE(snap.Verify().ok());
+  EXPECT_EQ(snap.namespace_count(), 2u);
+  EXPECT_EQ(snap.entry_count(), 5006u);
+
+  ValueRef v = snap.Find("app", "name");
+  ASSERT_TRUE(v);
+  EXPECT_EQ(v.type(), ValueType::kString);
+  EXPECT_EQ(v.string_value(), "caf\xc3\xa9\n");
+  EXPECT_EQ(snap.Find("app", "port").int_value(), 8080);
+  EXPECT_EQ(snap.Find("app", "ratio").double_value(), 0.25);
+  EXPECT_EQ(snap.Find("app", "enabled").type(), ValueType::kBool);
+  EXPECT_FALSE(snap.Find("app", "enabled").bool_value());
+  EXPECT_EQ(snap.Find("app", "raw").string_value(), "hello world");
+  EXPECT_EQ(snap.Find("app", "empty").string_value(), "");
+  EXPECT_FALSE(snap.Find("app", "missing"));
+  EXPECT_FALSE(snap.Find("nope", "name"));
+  EXPECT_EQ(snap.FindNamespace("nope"), -1);
+}
+
+TEST_F(SnapshotTest, EveryKeyResolves) {
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_, &snap).ok());
+  int64_t ns = snap.FindNamespace("big");
+  ASSERT_GE(ns, 0);
+  for (int i = 0; i < 5000; ++i) {
+    std::string key = "key." + std::to_string(i);
+    ValueRef v = snap.Find(static_cast<uint32_t>(ns), key);
+    ASSERT_TRUE(v) << key;
+    EXPECT_EQ(v.int_value(), i * 7) << key;
+    EXPECT_FALSE(snap.Find(static_cast<uint32_t>(ns), key + "x")) << key;
+  }
+}
+
+TEST_F(SnapshotTest, ChecksumCatchesCorruption) {
+  std::string bytes = ReadFile(out_);
+  bytes[bytes.size() - 1] ^= 1;
+  WriteFile(out_, bytes);
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_, &snap).ok());
+  EXPECT_EQ(snap.VerifyChecksum().message(), "checksum mismatch");
+  EXPECT_FALSE(snap.Verify().ok());
+}
+
+TEST_F(SnapshotTest, VerifyCatchesBadRecords) {
+  std::string bytes = ReadFile(out_);
+  SnapshotHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  EntryRecord rec;
+  std::memcpy(&rec, bytes.data() + header.entry_offset, sizeof(rec));
+  rec.key_length = 1u << 30;
+  std::memcpy(bytes.data() + header.entry_offset, &rec, sizeof(rec));
+  WriteFile(out_, bytes);
+  FixChecksum();
+
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_, &snap).ok());
+  EXPECT_TRUE(snap.VerifyChecksum().ok());
+  Status status = snap.Verify();
+  ASSERT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("bad key"), std::string::npos);
+}
+
+TEST_F(SnapshotTest, OpenRejectsBadFiles) {
+  std::string bytes = ReadFile(out_);
+  Snapshot snap;
+  WriteFile(out_, bytes.substr(0, 10));
+  EXPECT_FALSE(Snapshot::Open(out_, &snap).ok());
+  WriteFile(out_, bytes.substr(0, bytes.size() - 8));
+  EXPECT_FALSE(Snapshot::Open(out_, &snap).ok());
+  std::string bad_magic = bytes;
+  bad_magic[0] ^= 1;
+  WriteFile(out_, bad_magic);
+  EXPECT_FALSE(Snapshot::Open(out_, &snap).ok());
+  EXPECT_FALSE(Snapshot::Open(dir_.Join("missing.snap"), &snap).ok());
+}
+
+TEST_F(SnapshotTest, PagedValuesFromManyThreads) {
+  if (!PageCodecAvailable()) return;
+  auto value = [](int i) {
+    return "{\"service\": \"payments\", \"shard\": " + std::to_string(i) +
+           ", \"region\": \"eu-west\", \"burst\": 50}";
+  };
+  std::string source;
+  for (int i = 0; i < 3000; ++i) {
+    source += "limits." + std::to_string(i) + " = " + value(i) + "\n";
+  }
+  WriteSources(src_, {{"paged", source}});
+  ASSERT_TRUE(CompileDir(src_, out_).ok());
+
+  Snapshot snap;
+  ASSERT_TRUE(Snapshot::Open(out_, &snap).ok());
+  const int64_t ns = snap.FindNamespace("paged");
+  ASSERT_GE(ns, 0);
+  ASSERT_GT(snap.namespace_at(static_cast<uint32_t>(ns)).page_count, 1u);
+  ASSERT_TRUE(snap.Verify().ok());
+
+  // Threads race to decompress the same pages and prepare the same
+  // dictionary; every lookup must see the right value.
+  std::vector<std::thread> threads;
+  std::atomic<int> wrong{0};
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      for (int k = 0; k < 3000; ++k) {
+        const int i = (k * 7 + t * 1000) % 3000;
+        ValueRef v = snap.Find(static_cast<uint32_t>(ns),
+                               "limits." + std::to_string(i));
+        if (!v || v.string_value() != value(i)) wrong.fetch_add(1);
+      }
+    });
+  }
+  for (std::thread& t : threads) t.join();
+  EXPECT_EQ(wrong.load(), 0);
+}
+
+}  // namespace
+}  // namespace ccc
@@ -0,0 +1,162 @@
+// A minimal unit test harness, so the tests need nothing beyond this
+// library. It follows the GoogleTest spelling for the subset it offers:
+//
+//   TEST(Suite, Name) { EXPECT_EQ(Add(1, 2), 3) << "context"; }
+//   TEST_F(Fixture, Name) { ... }   // Fixture derives from testing::Test.
+//
+// EXPECT_* records a failure and carries on; ASSERT_* also returns from the
+// test body (or SetUp()). Each test binary links tests/test_main.cc, which
+// runs every registered test, or those whose "Suite.Name" contains the
+// first argument.
+
+#ifndef CCC_TESTS_TEST_H_
+#define CCC_TESTS_TEST_H_
+
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace ccc {
+namespace testing {
+
+class Test {
+ public:
+  virtual ~Test() = default;
+  virtual void SetUp() {}
+  virtual void TearDown() {}
+  virtual void TestBody() = 0;
+};
+
+// Adds a test to the registry; returns true so it can initialize a static.
+bool RegisterTest(const char* suite, const char* name, Test* (*factory)());
+
+// True once the running test has recorded a failure.
+bool HasFailure();
+
+// Collects a failure message and reports it at the end of the statement.
+class Failure {
+ public:
+  Failure(const char* file, int line, std::string message);
+  ~Failure();
+  Failure(const Failure&) = delete;
+  Failure& operator=(const Failure&) = delete;
+
+  template <typename T>
+  Failure& operator<<(const T& value) {
+    extra_ << value;
+    return *this;
+  }
+
+ private:
+  const char* file_;
+  int line_;
+  std::string message_;
+  std::ostringstream extra_;
+};
+
+// Lets ASSERT_* return from a void function after streaming a message.
+struct ReturnFromTest {
+  void operator=(const Failure&) const {}
+};
+
+template <typename T, typename = void>
+struct IsStreamable : std::false_type {};
+template <typename T>
+struct IsStreamable<T, std::void_t<decltype(std::declval<std::ostream&>()
+                                            << std::declval<const T&>())>>
+    : std::true_type {};
+
+template <typename T>
+std::string Print(const T& value) {
+  std::ostringstream out;
+  if constexpr (std::is_enum_v<T>) {
+    out << static_cast<long long>(value);
+  } else if constexpr (std::is_same_v<T, bool>) {
+    out << (value ? "true" : "false");
+  } else if constexpr (IsStreamable<T>::value) {
+    out << value;
+  } else {
+    out << "<" << sizeof(T) << "-byte value>";
+  }
+  return out.str();
+}
+
+// Returns a failure message if `a op b` does not hold.
+#define CCC_TEST_DEFINE_COMPARE_(Name, op)                                  \
+  template <typename A, typename B>                                         \
+  std::optional<std::string> Name(const char* a_text, const char* b_text,   \
+                                  const A& a, const B& b) {                 \
+    if (a op b) return std::nullopt;                                        \
+    return std::string("expected ") + a_text + " " #op " " + b_text +       \
+           "\n  actual: " + Print(a) + " vs " + Print(b);                   \
+  }
+CCC_TEST_DEFINE_COMPARE_(CompareEq, ==)
+CCC_TEST_DEFINE_COMPARE_(CompareNe, !=)
+CCC_TEST_DEFINE_COMPARE_(CompareLt, <)
+CCC_TEST_DEFINE_COMPARE_(CompareLe, <=)
+CCC_TEST_DEFINE_COMPARE_(CompareGt, >)
+CCC_TEST_DEFINE_COMPARE_(CompareGe, >=)
+#undef CCC_TEST_DEFINE_COMPARE_
+
+}  // namespace testing
+}  // namespace ccc
+
+#define CCC_TEST_CLASS_(suite, name) suite##_##name##_Test
+
+#define CCC_TEST_(suite, name, base)                                        \
+  class CCC_TEST_CLASS_(suite, name) : public base {                        \
+   public:                                                                  \
+    void TestBody() override;                                               \
+    static ::ccc::testing::Test* Create() {                                 \
+      return new CCC_TEST_CLASS_(suite, name);                              \
+    }                                                                       \
+    static const bool registered_;                                          \
+  };                                                                        \
+  const bool CCC_TEST_CLASS_(suite, name)::registered_ =                    \
+      ::ccc::testing::RegisterTest(#suite, #name,                           \
+                                   &CCC_TEST_CLASS_(suite, name)::Create);  \
+  void CCC_TEST_CLASS_(suite, name)::TestBody()
+
+#define TEST(suite, name) CCC_TEST_(suite, name, ::ccc::testing::Test)
+#define TEST_F(fixture, name) CCC_TEST_(fixture, name, fixture)
+
+#define CCC_TEST_CHECK_(cond, text, on_failure)                             \
+  if (cond) {                                                               \
+  } else                                                                    \
+    on_failure ::ccc::testing::Failure(__FILE__, __LINE__, text)
+
+#define CCC_TEST_COMPARE_(compare, a, b, on_failure)                        \
+  if (auto ccc_test_message_ = ::ccc::testing::compare(#a, #b, (a), (b));   \
+      !ccc_test_message_) {                                                 \
+  } else                                                                    \
+    on_failure ::ccc::testing::Failure(__FILE__, __LINE__,                  \
+                                       *ccc_test_message_)
+
+#define CCC_TEST_CONTINUE_
+#define CCC_TEST_RETURN_ return ::ccc::testing::ReturnFromTest() =
+
+#define EXPECT_TRUE(cond) \
+  CCC_TEST_CHECK_(cond, "expected " #cond, CCC_TEST_CONTINUE_)
+#define EXPECT_FALSE(cond) \
+  CCC_TEST_CHECK_(!(cond), "expected !(" #cond ")", CCC_TEST_CONTINUE_)
+#define ASSERT_TRUE(cond) \
+  CCC_TEST_CHECK_(cond, "expected " #cond, CCC_TEST_RETURN_)
+#define ASSERT_FALSE(cond) \
+  CCC_TEST_CHECK_(!(cond), "expected !(" #cond ")", CCC_TEST_RETURN_)
+
+#define EXPECT_EQ(a, b) CCC_TEST_COMPARE_(CompareEq, a, b, CCC_TEST_CONTINUE_)
+#define EXPECT_NE(a, b) CCC_TEST_COMPARE_(CompareNe, a, b, CCC_TEST_CONTINUE_)
+#define EXPECT_LT(a, b) CCC_TEST_COMPARE_(CompareLt, a, b, CCC_TEST_CONTINUE_)
+#define EXPECT_LE(a, b) CCC_TEST_COMPARE_(CompareLe, a, b, CCC_TEST_CONTINUE_)
+#define EXPECT_GT(a, b) CCC_TEST_COMPARE_(CompareGt, a, b, CCC_TEST_CONTINUE_)
+#define EXPECT_GE(a, b) CCC_TEST_COMPARE_(CompareGe, a, b, CCC_TEST_CONTINUE_)
+#define ASSERT_EQ(a, b) CCC_TEST_COMPARE_(CompareEq, a, b, CCC_TEST_RETURN_)
+#define ASSERT_NE(a, b) CCC_TEST_COMPARE_(CompareNe, a, b, CCC_TEST_RETURN_)
+#define ASSERT_LT(a, b) CCC_TEST_COMPARE_(CompareLt, a, b, CCC_TEST_RETURN_)
+#define ASSERT_LE(a, b) CCC_TEST_COMPARE_(CompareLe, a, b, CCC_TEST_RETURN_)
+#define ASSERT_GT(a, b) CCC_TEST_COMPARE_(CompareGt, a, b, CCC_TEST_RETURN_)
+#define ASSERT_GE(a, b) CCC_TEST_COMPARE_(CompareGe, a, b, CCC_TEST_RETURN_)
+
+#endif  // CCC_TESTS_TEST_H_
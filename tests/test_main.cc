@@ -0,0 +1,77 @@
+// Runner for the harness in test.h.
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+namespace ccc {
+namespace testing {
+
+namespace {
+
+struct Registration {
+  const char* suite;
+  const char* name;
+  Test* (*factory)();
+};
+
+std::vector<Registration>& Registry() {
+  static std::vector<Registration> registry;
+  return registry;
+}
+
+bool current_failed = false;
+
+}  // namespace
+
+bool RegisterTest(const char* suite, const char* name, Test* (*factory)()) {
+  Registry().push_back({suite, name, factory});
+  return true;
+}
+
+bool HasFailure() { return current_failed; }
+
+Failure::Failure(const char* file, int line, std::string message)
+    : file_(file), line_(line), message_(std::move(message)) {}
+
+Failure::~Failure() {
+  current_failed = true;
+  std::string extra = extra_.str();
+  std::fprintf(stderr, "%s:%d: failure\n  %s%s%s\n", file_, line_,
+               message_.c_str(), extra.empty() ? "" : "\n  ", extra.c_str());
+}
+
+}  // namespace testing
+}  // namespace ccc
+
+int main(int argc, char** argv) {
+  using ccc::testing::Registry;
+  const char* filter = argc > 1 ? argv[1] : "";
+  std::vector<std::string> failed;
+  int run = 0;
+  for (const auto& test : Registry()) {
+    std::string full = std::string(test.suite) + "." + test.name;
+    if (full.find(filter) == std::string::npos) continue;
+    ++run;
+    std::fprintf(stderr, "[ RUN      ] %s\n", full.c_str());
+    ccc::testing::current_failed = false;
+    std::unique_ptr<ccc::testing::Test> instance(test.factory());
+    instance->SetUp();
+    if (!ccc::testing::current_failed) instance->TestBody();
+    instance->TearDown();
+    instance.reset();
+    if (ccc::testing::current_failed) failed.push_back(full);
+    std::fprintf(stderr, "[ %s ] %s\n",
+                 ccc::testing::current_failed ? " FAILED " : "      OK",
+                 full.c_str());
+  }
+  std::fprintf(stderr, "%d tests, %zu failed\n", run, failed.size());
+  for (const std::string& name : failed) {
+    std::fprintf(stderr, "  FAILED %s\n", name.c_str());
+  }
+  return failed.empty() ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+// Helpers shared by the unit tests: scratch directories, whole-file reads
+// and writes, and compiling a set of sources.
+
+#ifndef CCC_TESTS_TEST_UTIL_H_
+#define CCC_TESTS_TEST_UTIL_H_
+
+#include <stdlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "compiler.h"
+#include "status.h"
+
+namespace ccc {
+namespace testing {
+
+// A fresh directory under the system temp dir, removed with its contents
+// on destruction.
+class TempDir {
+ public:
+  TempDir() {
+    std::string pattern =
+        (std::filesystem::temp_directory_path() / "ccc_test.XXXXXX").string();
+    if (mkdtemp(pattern.data()) != nullptr) path_ = pattern;
+  }
+  ~TempDir() {
+    std::error_code ec;
+    if (!path_.empty()) std::filesystem::remove_all(path_, ec);
+  }
+  TempDir(const TempDir&) = delete;
+  TempDir& operator=(const TempDir&) = delete;
+
+  const std::string& path() const { return path_; }
+  // `name` inside the directory.
+  std::string Join(const std::string& name) const {
+    return path_ + "/" + name;
+  }
+
+ private:
+  std::string path_;
+};
+
+inline void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << content;
+}
+
+inline std::string ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+// Writes `<dir>/<name>.conf` for each name => source.
+inline void WriteSources(const std::string& dir,
+                         const std::map<std::string, std::string>& sources) {
+  for (const auto& [name, source] : sources) {
+    WriteFile(dir + "/" + name + ".conf", source);
+  }
+}
+
+// Compiles every source in `dir` into `output`, with `options` otherwise.
+// Fills `stats` if it is not null.
+inline Status CompileDir(const std::string& dir, const std::string& output,
+                         CompileOptions options = CompileOptions(),
+                         CompileStats* stats = nullptr) {
+  options.inputs = {dir};
+  options.output = output;
+  Compiler compiler(std::move(options));
+  Status status = compiler.Run();
+  if (stats != nullptr) *stats = compiler.stats();
+  return status;
+}
+
+}  // namespace testing
+}  // namespace ccc
+
+#endif  // CCC_TESTS_TEST_UTIL_H_
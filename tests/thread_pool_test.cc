@@ -0,0 +1,45 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "test.h"
+
+namespace ccc {
+namespace {
+
+TEST(ThreadPoolTest, ParallelForRunsEveryIndexOnce) {
+  for (unsigned threads : {1u, 2u, 7u}) {
+    ThreadPool pool(threads);
+    EXPECT_EQ(pool.size(), threads);
+    for (size_t n : {size_t{0}, size_t{1}, size_t{5}, size_t{10000}}) {
+      std::vector<std::atomic<int>> runs(n);
+      pool.ParallelFor(n, [&](size_t i) { runs[i].fetch_add(1); });
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(runs[i].load(), 1) << "index " << i << " of " << n;
+      }
+    }
+  }
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+  ThreadPool pool(3);
+  std::atomic<size_t> sum{0};
+  pool.ParallelFor(50, [&](size_t i) {
+    pool.ParallelFor(100, [&](size_t j) { sum.fetch_add(i * 100 + j); });
+  });
+  EXPECT_EQ(sum.load(), size_t{5000 * 4999 / 2});
+}
+
+TEST(ThreadPoolTest, SubmittedTasksFinishBeforeDestruction) {
+  std::atomic<int> done{0};
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 1000; ++i) pool.Submit([&] { done.fetch_add(1); });
+  }
+  EXPECT_EQ(done.load(), 1000);
+}
+
+}  // namespace
+}  // namespace ccc